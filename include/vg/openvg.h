@@ -116,7 +116,21 @@ typedef enum {
   VG_MAX_IMAGE_PIXELS                         = 0x1167,
   VG_MAX_IMAGE_BYTES                          = 0x1168,
   VG_MAX_FLOAT                                = 0x1169,
-  VG_MAX_GAUSSIAN_STD_DEVIATION               = 0x116A
+  VG_MAX_GAUSSIAN_STD_DEVIATION               = 0x116A,
+
+  /* ShaderVG extensions */
+  VG_DEFERRED_DRAW_SH                         = 0x1180,
+  VG_GL_ERROR_MODE_SH                         = 0x1181,
+  VG_GL_ERROR_COUNT_SH                        = 0x1182,
+  VG_GL_LAST_ERROR_SH                         = 0x1183,
+  VG_GL_STATE_CHANGES_SH                      = 0x1184,
+  VG_GL_STATE_ELIDED_SH                       = 0x1185,
+  VG_STROKES_DIRECT_SH                        = 0x1186,
+  VG_STROKES_STENCILED_SH                     = 0x1187,
+  VG_GPU_CURVES_SH                            = 0x1188,
+  VG_IMPLICIT_CURVES_SH                       = 0x1189,
+  VG_WORKER_THREADS_SH                        = 0x118A,
+  VG_GPU_STROKES_SH                           = 0x118B
 } VGParamType;
 
 typedef enum {
@@ -622,10 +636,23 @@ VG_API_CALL const VGubyte * vgGetString(VGStringID name);
 #define OVG_SH_blend_dst_atop         1
 
 VG_API_CALL VGboolean vgCreateContextSH(VGint width, VGint height);
+VG_API_CALL VGboolean vgCreateContextAttribsSH(VGint width, VGint height,
+                                               const VGint *attribList);
 VG_API_CALL void vgResizeSurfaceSH(VGint width, VGint height);
 VG_API_CALL void vgDestroyContextSH(void);
+VG_API_CALL void vgInvalidateGLStateSH(void);
+VG_API_CALL void vgDrawPathInstancedSH(VGPath path, VGbitfield paintModes,
+                                       VGint count, const VGfloat *matrices,
+                                       const VGfloat *colors);
+VG_API_CALL void vgTrimPathSH(VGPath path);
 
 /* Extensions for ShaderVG */
+typedef enum {
+  VG_GL_ERROR_OFF_SH                          = 0x3000,
+  VG_GL_ERROR_DEFERRED_SH                     = 0x3001,
+  VG_GL_ERROR_STRICT_SH                       = 0x3002
+} VGGLErrorModeSH;
+
 #define VG_FRAGMENT_SHADER_SH         0
 #define VG_VERTEX_SHADER_SH           1
 
@@ -208,16 +208,14 @@ int JN(_FUNC_T,PushBack) (_ARRAY_T *a, _ITEM_T item)
 #ifdef _ARRAY_DEFINE
 {
   if (a->capacity == 0) {
-    JN(_FUNC_T,Realloc)(a, 1);
-    if (a->outofmemory)
+    if (!JN(_FUNC_T,Realloc)(a, 1))
       return 0;
   }
   
-  if (a->size + 1 > a->capacity)
-    JN(_FUNC_T,ReserveAndCopy)(a, a->capacity*2);
-  
-  if (a->outofmemory)
-    return 0;
+  if (a->size + 1 > a->capacity) {
+    if (!JN(_FUNC_T,ReserveAndCopy)(a, a->capacity*2))
+      return 0;
+  }
   
   a->items[a->size++] = item;
   return 1;
@@ -231,16 +229,14 @@ int JN(_FUNC_T,PushBackP) (_ARRAY_T *a, _ITEM_T *item)
 #ifdef _ARRAY_DEFINE
 {
   if (a->capacity == 0) {
-    JN(_FUNC_T,Realloc)(a, 1);
-    if (a->outofmemory)
+    if (!JN(_FUNC_T,Realloc)(a, 1))
       return 0;
   }
   
-  if (a->size + 1 > a->capacity)
-    JN(_FUNC_T,ReserveAndCopy)(a, a->capacity*2);
-  
-  if (a->outofmemory)
-    return 0;
+  if (a->size + 1 > a->capacity) {
+    if (!JN(_FUNC_T,ReserveAndCopy)(a, a->capacity*2))
+      return 0;
+  }
   
   a->items[a->size++] = *item;
   return 1;
@@ -33,9 +33,28 @@
  * to bind to. 
  *-----------------------------------------------------*/
 
+#define _ITEM_T SHDrawCommand
+#define _ARRAY_T SHDrawCommandArray
+#define _FUNC_T shDrawCommandArray
+#define _COMPARE_T(c1,c2) 0
+#define _ARRAY_DEFINE
+#include "shArrayBase.h"
+
 static VGContext *g_context = NULL;
 
 VG_API_CALL VGboolean vgCreateContextSH(VGint width, VGint height)
+{
+  return vgCreateContextAttribsSH(width, height, NULL);
+}
+
+/*-----------------------------------------------------
+ * Same as above but applies a list of (VGParamType,
+ * value) pairs terminated by 0 before any GL resources
+ * are created, e.g. to select the GL error mode.
+ *-----------------------------------------------------*/
+
+VG_API_CALL VGboolean vgCreateContextAttribsSH(VGint width, VGint height,
+                                               const VGint *attribList)
 {
   /* return if already created */
   if (g_context) return VG_TRUE;
@@ -48,6 +67,12 @@ VG_API_CALL VGboolean vgCreateContextSH(VGint width, VGint height)
   g_context->surfaceWidth = width;
   g_context->surfaceHeight = height;
   
+  /* apply creation attributes */
+  if (attribList) {
+    for (; attribList[0] != 0; attribList += 2)
+      vgSeti((VGParamType)attribList[0], attribList[1]);
+  }
+  
   /* setup GL projection */
   glViewport(0,0,width,height);
   
@@ -58,6 +83,22 @@ VG_API_CALL VGboolean vgCreateContextSH(VGint width, VGint height)
  
   /* Setup shaders for making color ramp */
   shInitRampShaders();
+  
+  /* Setup shaders for curve evaluation on the GPU */
+  shInitCurveShaders();
+  
+  /* Setup shaders for implicit curve fills */
+  shInitImplicitShaders();
+  
+  /* Setup shaders for strokes expanded on the GPU */
+  shInitStrokeShaders();
+  
+  /* Setup buffers for streamed geometry and per-draw state */
+  shInitStreamBuffer(g_context);
+  shInitDrawBlock(g_context);
+  
+  /* Hook up GL error reporting */
+  shSetGLErrorMode(g_context, g_context->glErrorMode);
 
   return VG_TRUE;
 }
@@ -66,6 +107,9 @@ VG_API_CALL void vgResizeSurfaceSH(VGint width, VGint height)
 {
   VG_GETCONTEXT(VG_NO_RETVAL);
   
+  /* submit draws recorded for the old surface */
+  shFlushDrawCommands(context);
+  
   /* update surface info */
   context->surfaceWidth = width;
   context->surfaceHeight = height;
@@ -77,7 +121,13 @@ VG_API_CALL void vgResizeSurfaceSH(VGint width, VGint height)
   float mat[16];
   float volume = fmax(width, height) / 2;
   shCalcOrtho2D(mat, 0, width, 0, height, -volume, volume);
-  glUseProgram(context->progDraw);
+  shGLUseProgram(&context->gl, context->progCurve);
+  glUniformMatrix4fv(context->locationCurve.projection, 1, GL_FALSE, mat);
+  shGLUseProgram(&context->gl, context->progImplicit);
+  glUniformMatrix4fv(context->locationImplicit.projection, 1, GL_FALSE, mat);
+  shGLUseProgram(&context->gl, context->progStroke);
+  glUniformMatrix4fv(context->locationStroke.projection, 1, GL_FALSE, mat);
+  shGLUseProgram(&context->gl, context->progDraw);
   glUniformMatrix4fv(context->locationDraw.projection, 1, GL_FALSE, mat);
   GL_CEHCK_ERROR;
   
@@ -89,11 +139,31 @@ VG_API_CALL void vgDestroyContextSH()
   /* return if already released */
   if (!g_context) return;
   
+  /* drop pending draws and release GL buffers owned by context */
+  shDiscardDrawCommands(g_context);
+  shSetGLErrorMode(g_context, VG_GL_ERROR_OFF_SH);
+  shDeinitStreamBuffer(g_context);
+  shDeinitDrawBlock(g_context);
+  
   /* delete context object */
   SH_DELETEOBJ(VGContext, g_context);
   g_context = NULL;
 }
 
+/*-----------------------------------------------------
+ * Must be called by applications that change GL state
+ * themselves between OpenVG calls, so that the state
+ * tracker stops trusting its shadow copy.
+ *-----------------------------------------------------*/
+
+VG_API_CALL void vgInvalidateGLStateSH(void)
+{
+  VG_GETCONTEXT(VG_NO_RETVAL);
+  shFlushDrawCommands(context);
+  shGLStateInvalidate(&context->gl);
+  VG_RETURN(VG_NO_RETVAL);
+}
+
 VGContext* shGetContext()
 {
   SH_ASSERT(g_context);
@@ -108,6 +178,10 @@ void shLoadExtensions(void *c);
 
 void VGContext_ctor(VGContext *c)
 {
+  /* GL state tracker goes first, constructors below
+     already create GL objects */
+  SH_INITOBJ(SHGLState, c->gl);
+  
   /* Surface info */
   c->surfaceWidth = 0;
   c->surfaceHeight = 0;
@@ -139,6 +213,7 @@ void VGContext_ctor(VGContext *c)
   c->strokeDashPhase = 0.0f;
   c->strokeDashPhaseReset = VG_FALSE;
   SH_INITOBJ(SHFloatArray, c->strokeDashPattern);
+  c->strokeDashHash = 0;
   
   /* Edge fill color for vgConvolve and pattern paint */
   CSET(c->tileFillColor, 0,0,0,0);
@@ -172,6 +247,40 @@ void VGContext_ctor(VGContext *c)
   SH_INITOBJ(SHPathArray, c->paths);
   SH_INITOBJ(SHPaintArray, c->paints);
   SH_INITOBJ(SHImageArray, c->images);
+  
+  /* Stream buffer (created with GL resources) */
+  c->streamVAO = 0;
+  c->streamVBO = 0;
+  c->streamSize = 0;
+  c->streamOffset = 0;
+  
+  c->gpuCurves = VG_FALSE;
+  c->implicitCurves = VG_FALSE;
+  c->gpuStrokes = VG_FALSE;
+  
+  /* Deferred drawing */
+  c->deferredDraw = VG_FALSE;
+  SH_INITOBJ(SHDrawCommandArray, c->drawCommands);
+  SH_INITOBJ(SHVector2Array, c->drawVertices);
+  SH_INITOBJ(SHVector2Array, c->drawCovers);
+  SH_INITOBJ(SHIntArray, c->drawFirsts);
+  SH_INITOBJ(SHIntArray, c->drawCounts);
+  SH_INITOBJ(SHIntArray, c->drawIndices);
+  
+  /* Worker threads */
+  SH_INITOBJ(SHWorkerPool, c->workers);
+  c->workerThreads = 0;
+  SH_INITOBJ(SHPathArray, c->pendingPaths);
+  
+  /* Stroke statistics */
+  c->strokesDirect = 0;
+  c->strokesStenciled = 0;
+  
+  /* GL error reporting */
+  c->glErrorMode = VG_GL_ERROR_DEFERRED_SH;
+  c->glErrorCount = 0;
+  c->glLastError = GL_NO_ERROR;
+  c->glDebugCallback = VG_FALSE;
 
   shLoadExtensions(c);
 }
@@ -187,6 +296,16 @@ void VGContext_dtor(VGContext *c)
   SH_DEINITOBJ(SHRectArray, c->scissor);
   SH_DEINITOBJ(SHFloatArray, c->strokeDashPattern);
   
+  SH_DEINITOBJ(SHDrawCommandArray, c->drawCommands);
+  SH_DEINITOBJ(SHVector2Array, c->drawVertices);
+  SH_DEINITOBJ(SHVector2Array, c->drawCovers);
+  SH_DEINITOBJ(SHIntArray, c->drawFirsts);
+  SH_DEINITOBJ(SHIntArray, c->drawCounts);
+  SH_DEINITOBJ(SHIntArray, c->drawIndices);
+  
+  SH_DEINITOBJ(SHWorkerPool, c->workers);
+  SH_DEINITOBJ(SHPathArray, c->pendingPaths);
+  
   /* Destroy resources */
   for (i=0; i<c->paths.size; ++i)
     SH_DELETEOBJ(SHPath, c->paths.items[i]);
@@ -196,6 +315,8 @@ void VGContext_dtor(VGContext *c)
   
   for (i=0; i<c->images.size; ++i)
     SH_DELETEOBJ(SHImage, c->images.items[i]);
+  
+  SH_DEINITOBJ(SHGLState, c->gl);
 }
 
 /*--------------------------------------------------
@@ -265,9 +386,104 @@ VG_API_CALL VGErrorCode vgGetError(void)
   VG_RETURN(error);
 }
 
+/*-----------------------------------------------------
+ * GL error layer. In strict mode every check point
+ * queries glGetError and asserts. In deferred mode GL
+ * errors are only collected at vgFlush / vgFinish, or
+ * reported by a KHR_debug callback when running in a
+ * debug GL context. Off never queries GL errors.
+ *-----------------------------------------------------*/
+
+void shCheckGLError(const char *file, int line)
+{
+  GLenum err;
+  
+  if (!g_context || g_context->glErrorMode != VG_GL_ERROR_STRICT_SH)
+    return;
+  
+  err = glGetError();
+  if (err != GL_NO_ERROR) {
+    g_context->glErrorCount++;
+    g_context->glLastError = err;
+    printf("glGetError() -> 0x%x line:%d file:%s\r\n", err, line, file);
+    assert(0);
+  }
+}
+
+void shCollectGLErrors(VGContext *c)
+{
+  GLenum err;
+  int n;
+  
+  if (c->glErrorMode == VG_GL_ERROR_OFF_SH)
+    return;
+  
+  /* Bounded since a lost context may keep reporting errors */
+  for (n=0; n<16; ++n) {
+    err = glGetError();
+    if (err == GL_NO_ERROR) break;
+    
+    /* Errors already counted by the debug callback */
+    if (!c->glDebugCallback) c->glErrorCount++;
+    c->glLastError = err;
+    
+    if (err == GL_OUT_OF_MEMORY)
+      shSetError(c, VG_OUT_OF_MEMORY_ERROR);
+  }
+}
+
+static void APIENTRY shDebugMessageCallback(GLenum source, GLenum type,
+                                            GLuint id, GLenum severity,
+                                            GLsizei length, const GLchar *message,
+                                            const void *userParam)
+{
+  VGContext *c = (VGContext*)userParam;
+  
+  if (type == GL_DEBUG_TYPE_ERROR)
+    c->glErrorCount++;
+}
+
+void shSetGLErrorMode(VGContext *c, VGGLErrorModeSH mode)
+{
+  GLint flags = 0, major = 0, minor = 0;
+  GLvoid *current = NULL;
+  
+  /* Remove our callback when leaving deferred mode */
+  if (c->glDebugCallback && mode != VG_GL_ERROR_DEFERRED_SH) {
+    glDebugMessageCallback(NULL, NULL);
+    c->glDebugCallback = VG_FALSE;
+  }
+  
+  c->glErrorMode = mode;
+  if (mode != VG_GL_ERROR_DEFERRED_SH || c->glDebugCallback)
+    return;
+  
+  /* Only use the callback when debug output is already active
+     (debug context) and the application hasn't claimed it */
+  glGetIntegerv(GL_CONTEXT_FLAGS, &flags);
+  if (!(flags & GL_CONTEXT_FLAG_DEBUG_BIT))
+    return;
+  
+  glGetIntegerv(GL_MAJOR_VERSION, &major);
+  glGetIntegerv(GL_MINOR_VERSION, &minor);
+  if ((major < 4 || (major == 4 && minor < 3)) &&
+      !shIsExtensionSupported("GL_KHR_debug"))
+    return;
+  
+  glGetPointerv(GL_DEBUG_CALLBACK_FUNCTION, &current);
+  if (current != NULL)
+    return;
+  
+  glDebugMessageCallback(shDebugMessageCallback, c);
+  c->glDebugCallback = VG_TRUE;
+}
+
 VG_API_CALL void vgFlush(void)
 {
   VG_GETCONTEXT(VG_NO_RETVAL);
+  shFlushDrawCommands(context);
+  shGLStateRestoreDefaults(&context->gl);
+  shCollectGLErrors(context);
   glFlush();
   VG_RETURN(VG_NO_RETVAL);
 }
@@ -275,6 +491,9 @@ VG_API_CALL void vgFlush(void)
 VG_API_CALL void vgFinish(void)
 {
   VG_GETCONTEXT(VG_NO_RETVAL);
+  shFlushDrawCommands(context);
+  shGLStateRestoreDefaults(&context->gl);
+  shCollectGLErrors(context);
   glFinish();
   VG_RETURN(VG_NO_RETVAL);
 }
@@ -288,6 +507,9 @@ VG_API_CALL void vgClear(VGint x, VGint y, VGint width, VGint height)
 {
   VG_GETCONTEXT(VG_NO_RETVAL);
   
+  /* Keep ordering with recorded draws */
+  shFlushDrawCommands(context);
+  
   /* Clip to window */
   if (x < 0) x = 0;
   if (y < 0) y = 0;
@@ -299,9 +521,12 @@ VG_API_CALL void vgClear(VGint x, VGint y, VGint width, VGint height)
       width < context->surfaceWidth ||
       height < context->surfaceHeight) {
     
-    glScissor(x, y, width, height);
-    glEnable(GL_SCISSOR_TEST);
-  }
+    shGLScissor(&context->gl, x, y, width, height);
+    shGLEnable(&context->gl, GL_SCISSOR_TEST);
+  }else shGLDisable(&context->gl, GL_SCISSOR_TEST);
+  
+  /* Color writes might be masked by last stencil pass */
+  shGLColorMask(&context->gl, GL_TRUE);
   
   /* Clear GL color buffer */
   /* TODO: what about stencil and depth? when do we clear that?
@@ -317,8 +542,6 @@ VG_API_CALL void vgClear(VGint x, VGint y, VGint width, VGint height)
           GL_STENCIL_BUFFER_BIT |
           GL_DEPTH_BUFFER_BIT);
   
-  glDisable(GL_SCISSOR_TEST);
-  
   VG_RETURN(VG_NO_RETVAL);
 }
 
@@ -27,6 +27,8 @@
 #include "shPath.h"
 #include "shPaint.h"
 #include "shImage.h"
+#include "shGLState.h"
+#include "shWorkers.h"
 
 /*------------------------------------------------
  * VGContext object
@@ -40,6 +42,48 @@ typedef enum
   SH_RESOURCE_IMAGE     = 3
 } SHResourceType;
 
+/*------------------------------------------------
+ * Draw command recorded in deferred mode
+ *------------------------------------------------*/
+
+typedef struct
+{
+  VGPaintMode       mode;
+  SHColor           color;
+  VGBlendMode       blendMode;
+  VGFillRule        fillRule;
+  VGboolean         direct; /* drawn without stencil */
+  SHMatrix3x3       transform;
+  VGboolean         scissoring;
+  SHRectangle       scissor;
+  
+  /* Contour ranges into the recorded vertex stream */
+  SHint             rangeFirst;
+  SHint             rangeCount;
+  
+  /* Stroke triangles in the recorded index stream */
+  SHint             indexFirst;
+  SHint             indexCount;
+  
+  /* Cover triangles in the recorded cover stream */
+  SHint             coverFirst;
+  SHint             coverCount;
+  
+  /* Bounds of the stencil geometry in user space */
+  SHVector2         min, max;
+  
+  /* Path whose geometry gets copied at flush, once
+     worker threads have tessellated it */
+  SHPath*           path;
+  
+} SHDrawCommand;
+
+#define _ITEM_T SHDrawCommand
+#define _ARRAY_T SHDrawCommandArray
+#define _FUNC_T shDrawCommandArray
+#define _ARRAY_DECLARE
+#include "shArrayBase.h"
+
 typedef struct
 {
   /* Surface info (since no EGL yet) */
@@ -73,6 +117,7 @@ typedef struct
   SHFloatArray      strokeDashPattern;
   SHfloat           strokeDashPhase;
   VGboolean         strokeDashPhaseReset;
+  SHuint            strokeDashHash;
   
   /* Edge fill color for vgConvolve and pattern paint */
   SHColor           tileFillColor;
@@ -112,18 +157,12 @@ typedef struct
   struct {
       GLint pos            ;
       GLint textureUV      ;
-      GLint model          ;
+      GLint drawIndex      ;
       GLint projection     ;
-      GLint paintInverted  ;
-      GLint drawMode       ;
       GLint imageSampler   ;
-      GLint imageMode      ;
-      GLint paintType      ;
       GLint rampSampler    ;
       GLint patternSampler ;
       GLint userSampler    ;
-      GLint paintParams    ;
-      GLint paintColor     ;
       GLint scaleFactorBias;
   } locationDraw;
 
@@ -132,9 +171,31 @@ typedef struct
       GLuint stepColor;
   } locationColorRamp;
 
+  struct {
+      GLint drawIndex ;
+      GLint projection;
+      GLint pivot     ;
+      GLint tolerance ;
+  } locationCurve;
+
+  struct {
+      GLint drawIndex ;
+      GLint projection;
+  } locationImplicit;
+
+  struct {
+      GLint drawIndex ;
+      GLint projection;
+      GLint params;
+      GLint pass;
+  } locationStroke;
+
   /* GL programs */
   GLuint progDraw;
   GLuint progColorRamp;
+  GLuint progCurve;
+  GLuint progImplicit;
+  GLuint progStroke;
 
   /* GL shaders */
   const void* userShaderVertex;
@@ -142,6 +203,55 @@ typedef struct
   GLint vs;
   GLint fs;
 
+  /* Streaming vertex buffer (ring, orphaned on wrap) */
+  GLuint     streamVAO;
+  GLuint     streamVBO;
+  GLsizeiptr streamSize;
+  GLintptr   streamOffset;
+
+  /* Per-draw records (uniform block ring, orphaned on wrap) */
+  GLuint       drawBlockUBO;
+  SHint        drawBlockNext;
+  SHint        drawBlockLast;
+  SHDrawRecord drawBlockLastRecord;
+
+  /* Fill curves evaluated in the vertex stage */
+  VGboolean          gpuCurves;
+
+  /* Fill curves trimmed per fragment from their hulls */
+  VGboolean          implicitCurves;
+
+  /* Strokes expanded from the polyline on the GPU */
+  VGboolean          gpuStrokes;
+
+  /* Deferred drawing */
+  VGboolean          deferredDraw;
+  SHDrawCommandArray drawCommands;
+  SHVector2Array     drawVertices;
+  SHVector2Array     drawCovers;
+  SHIntArray         drawFirsts;
+  SHIntArray         drawCounts;
+  SHIntArray         drawIndices;
+
+  /* Paths drawn since the last flush, tessellated in
+     parallel when worker threads are enabled */
+  SHWorkerPool       workers;
+  VGint              workerThreads;
+  SHPathArray        pendingPaths;
+
+  /* Stroke statistics */
+  SHint              strokesDirect;
+  SHint              strokesStenciled;
+
+  /* GL error reporting */
+  VGGLErrorModeSH    glErrorMode;
+  SHint              glErrorCount;
+  GLenum             glLastError;
+  VGboolean          glDebugCallback;
+
+  /* Shadow copy of GL state set by the library */
+  SHGLState          gl;
+
 } VGContext;
 
 void VGContext_ctor(VGContext *c);
@@ -153,6 +263,17 @@ SHint shIsValidImage(VGContext *c, VGHandle h);
 SHResourceType shGetResourceType(VGContext *c, VGHandle h);
 VGContext* shGetContext();
 
+void shInitStreamBuffer(VGContext *c);
+void shDeinitStreamBuffer(VGContext *c);
+void shInitDrawBlock(VGContext *c);
+void shDeinitDrawBlock(VGContext *c);
+void shSubmitDrawRecord(VGContext *c, const SHDrawRecord *r);
+void shFlushDrawCommands(VGContext *c);
+void shDiscardDrawCommands(VGContext *c);
+void shFlushPendingPath(VGContext *c, SHPath *p);
+void shSetGLErrorMode(VGContext *c, VGGLErrorModeSH mode);
+void shCollectGLErrors(VGContext *c);
+
 /*----------------------------------------------------
  * TODO: Add mutex locking/unlocking to these macros
  * to assure sequentiallity in multithreading.
@@ -130,7 +130,37 @@ SHfloat getMaxFloat();
 #define SH_MAX_COLOR_RAMP_STOPS          256
 
 #define SH_MAX_VERTICES 999999999
-#define SH_MAX_RECURSE_DEPTH 16
+#define SH_MAX_CURVE_SEGMENTS 256
+#define SH_GPU_CURVE_SEGMENTS 64
+#define SH_MAX_ROUND_STEPS 128
+
+/* Path capacity hints are trusted up to this many
+   segments or coordinates when creating a path */
+#define SH_MAX_PATH_CAPACITY_HINT 65536
+
+/* Implicit curve fills approximate cubics with quadratics
+   to a fraction of the control polygon length */
+#define SH_IMPLICIT_CUBIC_PRECISION (1.0f / 4096)
+#define SH_MAX_IMPLICIT_QUADS 16
+
+/* Flattening tolerance in pixels per rendering quality */
+#define SH_FLATTEN_TOLERANCE        0.25f
+#define SH_FLATTEN_TOLERANCE_FASTER 1.0f
+
+/* Flattening tolerance of the arc-length table, relative
+   to the size of each curve */
+#define SH_LENGTH_TOLERANCE (1.0f / 4096)
+
+/* Tessellations cached per path besides the one in use,
+   keyed by power-of-two scale level */
+#define SH_MAX_TESS_LEVELS   4
+#define SH_MAX_TESS_LEVEL    24
+
+/* Strokes cached per path besides the one in use */
+#define SH_MAX_STROKE_ENTRIES  4
+
+/* Upper limit of VG_WORKER_THREADS_SH */
+#define SH_MAX_WORKER_THREADS  64
 
 #define SH_GRADIENT_TEX_WIDTH       1024
 #define SH_GRADIENT_TEX_HEIGHT      1
@@ -151,18 +181,60 @@ SHfloat getMaxFloat();
 #include "shExtensions.h"
 
 #define GL_GET_ERROR printf("glGetError() -> %d line:%d file:%s\r\n", glGetError(), __LINE__, __FILE__)
-#define GL_CEHCK_ERROR \
- { \
-   GLint err = glGetError(); \
-   if(err){\
-       printf("glGetError() -> %d \r\n", err);\
-       assert(0);\
-   }\
- }
+
+/* Checks for GL errors according to the error mode of the
+   current context. Only the strict mode calls glGetError. */
+void shCheckGLError(const char *file, int line);
+#define GL_CEHCK_ERROR shCheckGLError(__FILE__, __LINE__)
 
 // GL_TEXTURE0 :imageSampler
 // GL_TEXTURE1 :rampSampler or  patternSampler
 // GL_TEXTURE2 :User defined 
 #define SH_TEXTURE_USER_TOP GL_TEXTURE2
 
+/* Fixed vertex attribute locations of the pipeline program so
+   that vertex array objects survive shader recompilation */
+#define SH_ATTRIB_POS         0
+#define SH_ATTRIB_TEXTURE_UV  1
+
+/* Per-segment attributes of the curve program */
+#define SH_ATTRIB_CURVE_ENDS  0
+#define SH_ATTRIB_CURVE_CTRL  1
+#define SH_ATTRIB_CURVE_AXIS  2
+#define SH_ATTRIB_CURVE_INFO  3
+
+/* Vertex attributes of the implicit curve program */
+#define SH_ATTRIB_IMPLICIT_POS     0
+#define SH_ATTRIB_IMPLICIT_COORD   1
+#define SH_ATTRIB_IMPLICIT_WEIGHT  2
+
+/* Vertex attributes of the GPU stroke program, and what
+   its fragment stage does with the stroke distance */
+#define SH_ATTRIB_STROKE_ENDS  0
+#define SH_ATTRIB_STROKE_NEXT  1
+
+#define SH_STROKE_PASS_COVERAGE  0
+#define SH_STROKE_PASS_CLIP      1
+#define SH_STROKE_PASS_COVER     2
+
+/* Streaming vertex buffer for per-draw geometry */
+#define SH_STREAM_BUFFER_SIZE       (1 << 20)
+#define SH_DYNAMIC_PATH_REBUILDS    2
+
+/* Uniform block holding per-draw paint and transform state.
+   64 records of 192 bytes fit the 16KB minimum block size. */
+#define SH_DRAW_RECORDS             64
+#define SH_DRAW_BLOCK_BINDING       0
+
+/* Cover geometry of the paint pass: padding around the
+   stencil geometry, limits for per-contour boxes and hull
+   points, and the area ratio a tighter cover must reach */
+#define SH_COVER_PADDING            1.0f
+#define SH_COVER_MAX_BOXES          16
+#define SH_COVER_MAX_HULL_POINTS    4096
+#define SH_COVER_MIN_GAIN           0.9f
+
+#define SH_STRINGIFY_(x) #x
+#define SH_STRINGIFY(x) SH_STRINGIFY_(x)
+
 #endif /* __SHDEFS_H */
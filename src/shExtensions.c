@@ -22,6 +22,11 @@
 #include "shExtensions.h"
 #include <stdio.h>
 #include <string.h>
+
+/* Windows gets core entry points as pointers declared below */
+#if !defined(_WIN32)
+#  define GL_GLEXT_PROTOTYPES
+#endif
 #include <GL/glcorearb.h>
 
 /*-----------------------------------------------------
@@ -57,6 +62,28 @@
    PFNGLGETUNIFORMFVPROC             glGetUniformfv;
    PFNGLCREATEPROGRAMPROC            glCreateProgram;
    PFNGLACTIVETEXTUREPROC            glActiveTexture;
+   PFNGLBINDATTRIBLOCATIONPROC       glBindAttribLocation;
+   PFNGLGENBUFFERSPROC               glGenBuffers;
+   PFNGLDELETEBUFFERSPROC            glDeleteBuffers;
+   PFNGLBINDBUFFERPROC               glBindBuffer;
+   PFNGLBUFFERDATAPROC               glBufferData;
+   PFNGLBUFFERSUBDATAPROC            glBufferSubData;
+   PFNGLMAPBUFFERRANGEPROC           glMapBufferRange;
+   PFNGLUNMAPBUFFERPROC              glUnmapBuffer;
+   PFNGLGENVERTEXARRAYSPROC          glGenVertexArrays;
+   PFNGLDELETEVERTEXARRAYSPROC       glDeleteVertexArrays;
+   PFNGLBINDVERTEXARRAYPROC          glBindVertexArray;
+   PFNGLMULTIDRAWARRAYSPROC          glMultiDrawArrays;
+   PFNGLGETSTRINGIPROC               glGetStringi;
+   PFNGLDEBUGMESSAGECALLBACKPROC     glDebugMessageCallback;
+   PFNGLDEBUGMESSAGECONTROLPROC      glDebugMessageControl;
+   PFNGLGETUNIFORMBLOCKINDEXPROC     glGetUniformBlockIndex;
+   PFNGLUNIFORMBLOCKBINDINGPROC      glUniformBlockBinding;
+   PFNGLBINDBUFFERBASEPROC           glBindBufferBase;
+   PFNGLDRAWARRAYSINSTANCEDPROC      glDrawArraysInstanced;
+   PFNGLDRAWELEMENTSINSTANCEDPROC    glDrawElementsInstanced;
+   PFNGLSTENCILOPSEPARATEPROC        glStencilOpSeparate;
+   PFNGLVERTEXATTRIBDIVISORPROC      glVertexAttribDivisor;
 #endif
 
 /*-----------------------------------------------------
@@ -87,6 +114,25 @@ static int checkExtension(const char *extensions, const char *name)
   return 0;
 }
 
+/*-----------------------------------------------------
+ * Looks up an extension in the extension list of the
+ * current (3.0+) GL context
+ *-----------------------------------------------------*/
+int shIsExtensionSupported(const char *name)
+{
+  GLint i, count = 0;
+  const char *e;
+
+  glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+  for (i = 0; i < count; ++i) {
+    e = (const char*)glGetStringi(GL_EXTENSIONS, i);
+    if (e && strcmp(e, name) == 0)
+      return 1;
+  }
+
+  return 0;
+}
+
 typedef void (*PFVOID)();
 
 PFVOID shGetProcAddress(const char *name)
@@ -132,5 +178,27 @@ void shLoadExtensions(void *c)
     glGetUniformfv             = shGetProcAddress("glGetUniformfv");
     glCreateProgram            = shGetProcAddress("glCreateProgram");
     glActiveTexture            = shGetProcAddress("glActiveTexture");
+    glBindAttribLocation       = shGetProcAddress("glBindAttribLocation");
+    glGenBuffers               = shGetProcAddress("glGenBuffers");
+    glDeleteBuffers            = shGetProcAddress("glDeleteBuffers");
+    glBindBuffer               = shGetProcAddress("glBindBuffer");
+    glBufferData               = shGetProcAddress("glBufferData");
+    glBufferSubData            = shGetProcAddress("glBufferSubData");
+    glMapBufferRange           = shGetProcAddress("glMapBufferRange");
+    glUnmapBuffer              = shGetProcAddress("glUnmapBuffer");
+    glGenVertexArrays          = shGetProcAddress("glGenVertexArrays");
+    glDeleteVertexArrays       = shGetProcAddress("glDeleteVertexArrays");
+    glBindVertexArray          = shGetProcAddress("glBindVertexArray");
+    glMultiDrawArrays          = shGetProcAddress("glMultiDrawArrays");
+    glGetStringi               = shGetProcAddress("glGetStringi");
+    glDebugMessageCallback     = shGetProcAddress("glDebugMessageCallback");
+    glDebugMessageControl      = shGetProcAddress("glDebugMessageControl");
+    glGetUniformBlockIndex     = shGetProcAddress("glGetUniformBlockIndex");
+    glUniformBlockBinding      = shGetProcAddress("glUniformBlockBinding");
+    glBindBufferBase           = shGetProcAddress("glBindBufferBase");
+    glDrawArraysInstanced      = shGetProcAddress("glDrawArraysInstanced");
+    glDrawElementsInstanced    = shGetProcAddress("glDrawElementsInstanced");
+    glStencilOpSeparate        = shGetProcAddress("glStencilOpSeparate");
+    glVertexAttribDivisor      = shGetProcAddress("glVertexAttribDivisor");
   #endif
 }
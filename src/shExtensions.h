@@ -21,5 +21,7 @@
 #ifndef __SHEXTENSIONS_H
 #define __SHEXTENSIONS_H
 
+int shIsExtensionSupported(const char *name);
+
 
 #endif
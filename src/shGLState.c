@@ -0,0 +1,310 @@
+/*
+ * Copyright (c) 2007 Ivan Leben
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * 
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library in the file COPYING;
+ * if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include "shGLState.h"
+
+/*-----------------------------------------------------
+ * Texture object state
+ *-----------------------------------------------------*/
+
+void SHTextureState_ctor(SHTextureState *t)
+{
+  t->wrapS = -1;
+  t->wrapT = -1;
+  t->minFilter = -1;
+  t->magFilter = -1;
+}
+
+void SHTextureState_dtor(SHTextureState *t)
+{
+}
+
+/*-----------------------------------------------------
+ * Shadow state constructor / destructor
+ *-----------------------------------------------------*/
+
+void SHGLState_ctor(SHGLState *s)
+{
+  shGLStateInvalidate(s);
+  s->changes = 0;
+  s->elided = 0;
+}
+
+void SHGLState_dtor(SHGLState *s)
+{
+}
+
+/*-----------------------------------------------------
+ * Marks every shadowed value unknown, so that it gets
+ * set again on next use. Needed whenever GL state may
+ * have been changed behind the library's back.
+ *-----------------------------------------------------*/
+
+void shGLStateInvalidate(SHGLState *s)
+{
+  int i;
+  
+  s->program = -1;
+  s->blend = -1;
+  s->blendSrc = -1;
+  s->blendDst = -1;
+  s->stencilTest = -1;
+  s->stencilFunc = -1;
+  s->stencilRef = -1;
+  s->stencilMask = -1;
+  for (i=0; i<2; ++i) {
+    s->stencilFail[i] = -1;
+    s->stencilDepthFail[i] = -1;
+    s->stencilDepthPass[i] = -1;
+  }
+  s->colorMask = -1;
+  s->scissorTest = -1;
+  for (i=0; i<4; ++i) s->scissor[i] = -1;
+  
+  s->activeTexture = -1;
+  for (i=0; i<SH_GL_STATE_TEXTURE_UNITS; ++i) {
+    s->texture[i] = -1;
+    s->texture2D[i] = -1;
+  }
+  
+  s->drawBlockBuffer = -1;
+  
+  shGLStateInvalidateUniforms(s);
+}
+
+/*-----------------------------------------------------
+ * Uniforms are only lost when the program is relinked
+ *-----------------------------------------------------*/
+
+void shGLStateInvalidateUniforms(SHGLState *s)
+{
+  s->uniforms.drawIndex = SH_MIN_INT;
+  s->uniforms.imageSampler = SH_MIN_INT;
+  s->uniforms.rampSampler = SH_MIN_INT;
+  s->uniforms.patternSampler = SH_MIN_INT;
+  s->uniforms.curveDrawIndex = SH_MIN_INT;
+  s->uniforms.implicitDrawIndex = SH_MIN_INT;
+  s->uniforms.strokeDrawIndex = SH_MIN_INT;
+}
+
+/*-----------------------------------------------------
+ * Puts the state that affects application rendering
+ * back to GL defaults
+ *-----------------------------------------------------*/
+
+void shGLStateRestoreDefaults(SHGLState *s)
+{
+  shGLDisable(s, GL_BLEND);
+  shGLDisable(s, GL_STENCIL_TEST);
+  shGLDisable(s, GL_SCISSOR_TEST);
+  shGLColorMask(s, GL_TRUE);
+}
+
+/*-----------------------------------------------------
+ * State setters
+ *-----------------------------------------------------*/
+
+#define SH_GL_SAME(cond) \
+  if (cond) { s->elided++; return; } \
+  s->changes++;
+
+void shGLUseProgram(SHGLState *s, GLuint program)
+{
+  SH_GL_SAME(s->program == (GLint)program);
+  s->program = (GLint)program;
+  glUseProgram(program);
+}
+
+static GLint* shGLCapability(SHGLState *s, GLenum cap)
+{
+  switch (cap) {
+  case GL_BLEND: return &s->blend;
+  case GL_STENCIL_TEST: return &s->stencilTest;
+  case GL_SCISSOR_TEST: return &s->scissorTest;
+  case GL_TEXTURE_2D:
+    if (s->activeTexture >= 0 && s->activeTexture < SH_GL_STATE_TEXTURE_UNITS)
+      return &s->texture2D[s->activeTexture];
+  default: return NULL;
+  }
+}
+
+void shGLEnable(SHGLState *s, GLenum cap)
+{
+  GLint *v = shGLCapability(s, cap);
+  if (v) {
+    SH_GL_SAME(*v == 1);
+    *v = 1;
+  }
+  glEnable(cap);
+}
+
+void shGLDisable(SHGLState *s, GLenum cap)
+{
+  GLint *v = shGLCapability(s, cap);
+  if (v) {
+    SH_GL_SAME(*v == 0);
+    *v = 0;
+  }
+  glDisable(cap);
+}
+
+void shGLBlendFunc(SHGLState *s, GLenum src, GLenum dst)
+{
+  SH_GL_SAME(s->blendSrc == (GLint)src && s->blendDst == (GLint)dst);
+  s->blendSrc = (GLint)src;
+  s->blendDst = (GLint)dst;
+  glBlendFunc(src, dst);
+}
+
+void shGLStencilFunc(SHGLState *s, GLenum func, GLint ref, GLuint mask)
+{
+  SH_GL_SAME(s->stencilFunc == (GLint)func &&
+             s->stencilRef == ref &&
+             s->stencilMask == (GLint)mask);
+  s->stencilFunc = (GLint)func;
+  s->stencilRef = ref;
+  s->stencilMask = (GLint)mask;
+  glStencilFunc(func, ref, mask);
+}
+
+void shGLStencilOp(SHGLState *s, GLenum fail, GLenum zfail, GLenum zpass)
+{
+  int i;
+  
+  SH_GL_SAME(s->stencilFail[0] == (GLint)fail &&
+             s->stencilFail[1] == (GLint)fail &&
+             s->stencilDepthFail[0] == (GLint)zfail &&
+             s->stencilDepthFail[1] == (GLint)zfail &&
+             s->stencilDepthPass[0] == (GLint)zpass &&
+             s->stencilDepthPass[1] == (GLint)zpass);
+  for (i=0; i<2; ++i) {
+    s->stencilFail[i] = (GLint)fail;
+    s->stencilDepthFail[i] = (GLint)zfail;
+    s->stencilDepthPass[i] = (GLint)zpass;
+  }
+  glStencilOp(fail, zfail, zpass);
+}
+
+void shGLStencilOpSeparate(SHGLState *s, GLenum face,
+                           GLenum fail, GLenum zfail, GLenum zpass)
+{
+  int i = (face == GL_BACK ? 1 : 0);
+  
+  if (face == GL_FRONT_AND_BACK) {
+    shGLStencilOp(s, fail, zfail, zpass);
+    return;
+  }
+  
+  SH_GL_SAME(s->stencilFail[i] == (GLint)fail &&
+             s->stencilDepthFail[i] == (GLint)zfail &&
+             s->stencilDepthPass[i] == (GLint)zpass);
+  s->stencilFail[i] = (GLint)fail;
+  s->stencilDepthFail[i] = (GLint)zfail;
+  s->stencilDepthPass[i] = (GLint)zpass;
+  glStencilOpSeparate(face, fail, zfail, zpass);
+}
+
+void shGLColorMask(SHGLState *s, GLboolean mask)
+{
+  SH_GL_SAME(s->colorMask == (GLint)mask);
+  s->colorMask = (GLint)mask;
+  glColorMask(mask, mask, mask, mask);
+}
+
+void shGLScissor(SHGLState *s, GLint x, GLint y, GLsizei w, GLsizei h)
+{
+  SH_GL_SAME(s->scissor[0] == x && s->scissor[1] == y &&
+             s->scissor[2] == w && s->scissor[3] == h);
+  s->scissor[0] = x; s->scissor[1] = y;
+  s->scissor[2] = w; s->scissor[3] = h;
+  glScissor(x, y, w, h);
+}
+
+/*-----------------------------------------------------
+ * Texture units and objects
+ *-----------------------------------------------------*/
+
+void shGLActiveTexture(SHGLState *s, GLenum unit)
+{
+  SH_GL_SAME(s->activeTexture == (GLint)(unit - GL_TEXTURE0));
+  s->activeTexture = (GLint)(unit - GL_TEXTURE0);
+  glActiveTexture(unit);
+}
+
+void shGLBindTexture(SHGLState *s, GLuint texture)
+{
+  GLint unit = s->activeTexture;
+  
+  if (unit >= 0 && unit < SH_GL_STATE_TEXTURE_UNITS) {
+    SH_GL_SAME(s->texture[unit] == (GLint)texture);
+    s->texture[unit] = (GLint)texture;
+  }
+  glBindTexture(GL_TEXTURE_2D, texture);
+}
+
+/* Deleting a texture unbinds it from every unit */
+void shGLForgetTexture(SHGLState *s, GLuint texture)
+{
+  int i;
+  for (i=0; i<SH_GL_STATE_TEXTURE_UNITS; ++i)
+    if (s->texture[i] == (GLint)texture)
+      s->texture[i] = 0;
+}
+
+void shGLTexParameteri(SHGLState *s, SHTextureState *t, GLenum pname, GLint value)
+{
+  GLint *v;
+  
+  switch (pname) {
+  case GL_TEXTURE_WRAP_S: v = &t->wrapS; break;
+  case GL_TEXTURE_WRAP_T: v = &t->wrapT; break;
+  case GL_TEXTURE_MIN_FILTER: v = &t->minFilter; break;
+  case GL_TEXTURE_MAG_FILTER: v = &t->magFilter; break;
+  default: v = NULL;
+  }
+  
+  if (v) {
+    SH_GL_SAME(*v == value);
+    *v = value;
+  }
+  glTexParameteri(GL_TEXTURE_2D, pname, value);
+}
+
+/*-----------------------------------------------------
+ * Buffer backing the per-draw uniform block
+ *-----------------------------------------------------*/
+
+void shGLBindDrawBlock(SHGLState *s, GLuint buffer)
+{
+  SH_GL_SAME(s->drawBlockBuffer == (GLint)buffer);
+  s->drawBlockBuffer = (GLint)buffer;
+  glBindBufferBase(GL_UNIFORM_BUFFER, SH_DRAW_BLOCK_BINDING, buffer);
+}
+
+/*-----------------------------------------------------
+ * Uniforms of the currently bound pipeline program
+ *-----------------------------------------------------*/
+
+void shGLUniform1i(SHGLState *s, GLint location, GLint *cache, GLint v)
+{
+  SH_GL_SAME(*cache == v);
+  *cache = v;
+  glUniform1i(location, v);
+}
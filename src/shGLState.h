@@ -0,0 +1,133 @@
+/*
+ * Copyright (c) 2007 Ivan Leben
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * 
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library in the file COPYING;
+ * if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+#ifndef __SHGLSTATE_H
+#define __SHGLSTATE_H
+
+#include "shDefs.h"
+
+/*------------------------------------------------------------
+ * Shadow copy of the GL state controlled by the library.
+ * Setters compare against the shadow and skip GL calls that
+ * would not change anything. A value of -1 means "unknown"
+ * and always forces the next call through.
+ *------------------------------------------------------------*/
+
+#define SH_GL_STATE_TEXTURE_UNITS 8
+
+/* Per-draw paint and transform state. Mirrors one element of
+   the std140 SHDrawBlock uniform block of the pipeline program. */
+typedef struct
+{
+  GLfloat model[16];
+  GLfloat paintInverted[12]; /* mat3, columns padded to vec4 */
+  GLfloat paintColor[4];
+  GLfloat paintParams[12];   /* vec4[3], only xy used */
+  GLint   paintType;
+  GLint   drawMode;
+  GLint   imageMode;
+  GLint   padding;
+  
+} SHDrawRecord;
+
+/* Per-texture object parameters */
+typedef struct
+{
+  GLint wrapS;
+  GLint wrapT;
+  GLint minFilter;
+  GLint magFilter;
+  
+} SHTextureState;
+
+void SHTextureState_ctor(SHTextureState *t);
+void SHTextureState_dtor(SHTextureState *t);
+
+typedef struct
+{
+  GLint    program;
+  
+  GLint    blend;
+  GLint    blendSrc;
+  GLint    blendDst;
+  
+  GLint    stencilTest;
+  GLint    stencilFunc;
+  GLint    stencilRef;
+  GLint    stencilMask;
+  GLint    stencilFail[2];      /* front, back */
+  GLint    stencilDepthFail[2];
+  GLint    stencilDepthPass[2];
+  
+  GLint    colorMask;
+  
+  GLint    scissorTest;
+  GLint    scissor[4];
+  
+  GLint    activeTexture;
+  GLint    texture[SH_GL_STATE_TEXTURE_UNITS];
+  GLint    texture2D[SH_GL_STATE_TEXTURE_UNITS];
+  
+  GLint    drawBlockBuffer;
+  
+  /* Uniforms of the pipeline, curve, implicit and stroke programs */
+  struct {
+    GLint   drawIndex;
+    GLint   imageSampler;
+    GLint   rampSampler;
+    GLint   patternSampler;
+    GLint   curveDrawIndex;
+    GLint   implicitDrawIndex;
+    GLint   strokeDrawIndex;
+  } uniforms;
+  
+  /* Statistics */
+  SHint    changes;
+  SHint    elided;
+  
+} SHGLState;
+
+void SHGLState_ctor(SHGLState *s);
+void SHGLState_dtor(SHGLState *s);
+
+void shGLStateInvalidate(SHGLState *s);
+void shGLStateInvalidateUniforms(SHGLState *s);
+void shGLStateRestoreDefaults(SHGLState *s);
+
+void shGLUseProgram(SHGLState *s, GLuint program);
+void shGLEnable(SHGLState *s, GLenum cap);
+void shGLDisable(SHGLState *s, GLenum cap);
+void shGLBlendFunc(SHGLState *s, GLenum src, GLenum dst);
+void shGLStencilFunc(SHGLState *s, GLenum func, GLint ref, GLuint mask);
+void shGLStencilOp(SHGLState *s, GLenum fail, GLenum zfail, GLenum zpass);
+void shGLStencilOpSeparate(SHGLState *s, GLenum face,
+                           GLenum fail, GLenum zfail, GLenum zpass);
+void shGLColorMask(SHGLState *s, GLboolean mask);
+void shGLScissor(SHGLState *s, GLint x, GLint y, GLsizei w, GLsizei h);
+
+void shGLActiveTexture(SHGLState *s, GLenum unit);
+void shGLBindTexture(SHGLState *s, GLuint texture);
+void shGLForgetTexture(SHGLState *s, GLuint texture);
+void shGLTexParameteri(SHGLState *s, SHTextureState *t, GLenum pname, GLint value);
+
+void shGLBindDrawBlock(SHGLState *s, GLuint buffer);
+
+void shGLUniform1i(SHGLState *s, GLint location, GLint *cache, GLint v);
+
+#endif /* __SHGLSTATE_H */
@@ -22,247 +22,190 @@
 #include "openvg.h"
 #include "shContext.h"
 #include "shGeometry.h"
+#include "shKernels.h"
+#include <string.h>
 
 
-static int shAddVertex(SHPath *p, SHVertex *v, SHint *contourStart)
+/*--------------------------------------------------
+ * Accounts for the points flattened onto the end of
+ * the subdivision from [from] on as vertices of the
+ * contour, the last one with [flags]
+ *--------------------------------------------------*/
+
+static void shAddVertices(SHPath *p, SHint from, SHuint8 flags,
+                          SHint *contour)
 {
-  /* Assert contour was open */
-  SH_ASSERT((*contourStart) >= 0);
+  SHint i, n = p->vertices.size;
   
-  /* Check vertex limit */
-  if (p->vertices.size >= SH_MAX_VERTICES) return 0;
+  /* Assert contour was open */
+  SH_ASSERT((*contour) >= 0);
   
-  /* Add vertex to subdivision */
-  shVertexArrayPushBackP(&p->vertices, v);
+  for (i=from; i<n; ++i)
+    if (!shUint8ArrayPushBack(&p->vertexFlags, i+1 < n ? 0 : flags))
+      break;
   
-  /* Increment contour size. Its stored in
-     the flags of first contour vertex */
-  p->vertices.items[*contourStart].flags++;
+  /* Increment contour size */
+  p->vertices.size = i;
+  p->contours.items[*contour] += i - from;
+}
+
+/*--------------------------------------------------
+ * Curves are flattened into a number of segments
+ * computed up front from the flattening tolerance
+ * and evaluated by forward differencing. Only the
+ * inner points are added, the end point is added
+ * by the caller.
+ *--------------------------------------------------*/
+
+static int shPushCurvePoint(SHVector2Array *out, SHVector2 *v)
+{
+  if (out->size >= SH_MAX_VERTICES) return 0;
+  return shVector2ArrayPushBackP(out, v);
+}
+
+static SHint shCurveSegments(SHfloat n)
+{
+  /* Also catches NaN and infinity */
+  if (!(n < (SHfloat)SH_MAX_CURVE_SEGMENTS))
+    return SH_MAX_CURVE_SEGMENTS;
   
-  return 1;
+  return (n > 1.0f ? (SHint)SH_CEIL(n) : 1);
 }
 
-static void shSubrecurseQuad(SHPath *p, SHQuad *quad, SHint *contourStart)
+static void shFlattenQuad(SHVector2Array *out, SHQuad *q, SHfloat tol)
 {
-  SHVertex v;
-  SHVector2 mid, dif, c1, c2, c3;
-  SHQuad quads[SH_MAX_RECURSE_DEPTH];
-  SHQuad *q, *qleft, *qright;
-  SHint qindex=0;
-  quads[0] = *quad;
+  SHVector2 v, a, b, d1, d2;
+  SHfloat h, hh;
+  SHint n, i;
   
-  while (qindex >= 0) {
-    
-    q = &quads[qindex];
-    
-    /* Calculate distance of control point from its
-     counterpart on the line between end points */
-    SET2V(mid, q->p1); ADD2V(mid, q->p3); DIV2(mid, 2);
-    SET2V(dif, q->p2); SUB2V(dif, mid); ABS2(dif);
-    
-    /* Cancel if the curve is flat enough */
-    if (dif.x + dif.y <= 1.0f || qindex == SH_MAX_RECURSE_DEPTH-1) {
+  /* Wang's formula for degree 2: n = sqrt(|p1-2p2+p3| / (4*tol)) */
+  SET2(a, q->p1.x - 2*q->p2.x + q->p3.x,
+          q->p1.y - 2*q->p2.y + q->p3.y);
+  n = shCurveSegments(SH_SQRT(NORM2(a) / (4*tol)));
+  
+  /* B(t) = p1 + b*t + a*t^2 */
+  SET2(b, 2*(q->p2.x - q->p1.x), 2*(q->p2.y - q->p1.y));
+  h = 1.0f / n; hh = h*h;
+  SET2(d1, b.x*h + a.x*hh, b.y*h + a.y*hh);
+  SET2(d2, 2*a.x*hh, 2*a.y*hh);
+  
+  v = q->p1;
+  for (i=1; i<n; ++i) {
+    ADD2V(v, d1);
+    ADD2V(d1, d2);
+    if (!shPushCurvePoint(out, &v)) return;
+  }
+}
 
-      /* Add subdivision point */
-      v.point = q->p3; v.flags = 0;
-      if (qindex == 0) return; /* Skip last point */
-      if (!shAddVertex(p, &v, contourStart)) return;
-      --qindex;
-      
-    }else{
-      
-      /* Left recursion goes on top of stack! */
-      qright = q; qleft = &quads[++qindex];
-      
-      /* Subdivide into 2 sub-curves */
-      SET2V(c1, q->p1); ADD2V(c1, q->p2); DIV2(c1, 2);
-      SET2V(c3, q->p2); ADD2V(c3, q->p3); DIV2(c3, 2);
-      SET2V(c2, c1); ADD2V(c2, c3); DIV2(c2, 2);
-  
-      /* Add left recursion onto stack */
-      qleft->p1 = q->p1;
-      qleft->p2 = c1;
-      qleft->p3 = c2;
-      
-      /* Add right recursion onto stack */
-      qright->p1 = c2;
-      qright->p2 = c3;
-      qright->p3 = q->p3;
-    }
+static void shFlattenCubic(SHVector2Array *out, SHCubic *c, SHfloat tol)
+{
+  SHVector2 v, a, b, k, d1, d2, d3;
+  SHfloat h, hh, hhh, m1, m2;
+  SHint n, i;
+  
+  /* Wang's formula for degree 3: n = sqrt(3/4 * max|second difference| / tol) */
+  SET2(a, c->p1.x - 2*c->p2.x + c->p3.x, c->p1.y - 2*c->p2.y + c->p3.y);
+  SET2(b, c->p2.x - 2*c->p3.x + c->p4.x, c->p2.y - 2*c->p3.y + c->p4.y);
+  m1 = NORM2(a); m2 = NORM2(b);
+  n = shCurveSegments(SH_SQRT(0.75f * SH_MAX(m1, m2) / tol));
+  
+  /* B(t) = p1 + k*t + 3a*t^2 + (b-a)*t^3 */
+  SET2(k, 3*(c->p2.x - c->p1.x), 3*(c->p2.y - c->p1.y));
+  MUL2(a, 3.0f);
+  SET2(b, c->p4.x - c->p1.x + 3*(c->p2.x - c->p3.x),
+          c->p4.y - c->p1.y + 3*(c->p2.y - c->p3.y));
+  
+  h = 1.0f / n; hh = h*h; hhh = hh*h;
+  SET2(d1, k.x*h + a.x*hh + b.x*hhh, k.y*h + a.y*hh + b.y*hhh);
+  SET2(d2, 2*a.x*hh + 6*b.x*hhh, 2*a.y*hh + 6*b.y*hhh);
+  SET2(d3, 6*b.x*hhh, 6*b.y*hhh);
+  
+  v = c->p1;
+  for (i=1; i<n; ++i) {
+    ADD2V(v, d1);
+    ADD2V(d1, d2);
+    ADD2V(d2, d3);
+    if (!shPushCurvePoint(out, &v)) return;
   }
 }
 
-static void shSubrecurseCubic(SHPath *p, SHCubic *cubic, SHint *contourStart)
+static void shFlattenArc(SHVector2Array *out, SHArc *arc,
+                         SHVector2 *c, SHVector2 *ux, SHVector2 *uy,
+                         SHfloat tol)
 {
-  SHVertex v;
-  SHfloat dx1, dy1, dx2, dy2;
-  SHVector2 mm, c1, c2, c3, c4, c5;
-  SHCubic cubics[SH_MAX_RECURSE_DEPTH];
-  SHCubic *c, *cleft, *cright;
-  SHint cindex = 0;
-  cubics[0] = *cubic;
+  SHVector2 v;
+  SHfloat r, step, cosa, sina, cosh, sinh, t;
+  SHint n, i;
   
-  while (cindex >= 0) {
-    
-    c = &cubics[cindex];
-    
-    /* Calculate distance of control points from their
-     counterparts on the line between end points */
-    dx1 = 3.0f*c->p2.x - 2.0f*c->p1.x - c->p4.x; dx1 *= dx1;
-    dy1 = 3.0f*c->p2.y - 2.0f*c->p1.y - c->p4.y; dy1 *= dy1;
-    dx2 = 3.0f*c->p3.x - 2.0f*c->p4.x - c->p1.x; dx2 *= dx2;
-    dy2 = 3.0f*c->p3.y - 2.0f*c->p4.y - c->p1.y; dy2 *= dy2;
-    if (dx1 < dx2) dx1 = dx2;
-    if (dy1 < dy2) dy1 = dy2;
-    
-    /* Cancel if the curve is flat enough */
-    if (dx1+dy1 <= 1.0 || cindex == SH_MAX_RECURSE_DEPTH-1) {
-      
-      /* Add subdivision point */
-      v.point = c->p4; v.flags = 0;
-      if (cindex == 0) return; /* Skip last point */
-      if (!shAddVertex(p, &v, contourStart)) return;
-      --cindex;
-      
-    }else{
-      
-      /* Left recursion goes on top of stack! */
-      cright = c; cleft = &cubics[++cindex];
-      
-      /* Subdivide into 2 sub-curves */
-      SET2V(c1, c->p1); ADD2V(c1, c->p2); DIV2(c1, 2);
-      SET2V(mm, c->p2); ADD2V(mm, c->p3); DIV2(mm, 2);
-      SET2V(c5, c->p3); ADD2V(c5, c->p4); DIV2(c5, 2);
-      
-      SET2V(c2, c1); ADD2V(c2, mm); DIV2(c2, 2);
-      SET2V(c4, mm); ADD2V(c4, c5); DIV2(c4, 2);
-      
-      SET2V(c3, c2); ADD2V(c3, c4); DIV2(c3, 2);
-      
-      /* Add left recursion to stack */
-      cleft->p1 = c->p1;
-      cleft->p2 = c1;
-      cleft->p3 = c2;
-      cleft->p4 = c3;
-      
-      /* Add right recursion to stack */
-      cright->p1 = c3;
-      cright->p2 = c4;
-      cright->p3 = c5;
-      cright->p4 = c->p4;
-    }
+  /* Chord error of a step is r * (1 - cos(step/2)) */
+  r = SH_SQRT(NORMSQ2((*ux)) + NORMSQ2((*uy)));
+  if (tol < r) {
+    t = arc->a2 - arc->a1; if (t < 0.0f) t = -t;
+    step = 2.0f * SH_ACOS(1.0f - tol / r);
+    n = shCurveSegments(t / step);
+  }else n = 1;
+  
+  /* Rotate (cos a, sin a) by a constant angle each step */
+  step = (arc->a2 - arc->a1) / n;
+  cosh = SH_COS(step); sinh = SH_SIN(step);
+  cosa = SH_COS(arc->a1); sina = SH_SIN(arc->a1);
+  
+  for (i=1; i<n; ++i) {
+    t = cosa*cosh - sina*sinh;
+    sina = sina*cosh + cosa*sinh;
+    cosa = t;
+    v.x = c->x + ux->x*cosa + uy->x*sina;
+    v.y = c->y + ux->y*cosa + uy->y*sina;
+    if (!shPushCurvePoint(out, &v)) return;
   }
 }
 
-static void shSubrecurseArc(SHPath *p, SHArc *arc,
-                            SHVector2 *c,SHVector2 *ux, SHVector2 *uy,
-                            SHint *contourStart)
+/*--------------------------------------------------
+ * Maximum distance between a curve and its
+ * flattening, chosen by rendering quality. Paths
+ * flattened in user space scale it by the path
+ * transform.
+ *--------------------------------------------------*/
+
+SHfloat shFlattenTolerance(VGContext *c, SHint surfaceSpace)
 {
-  SHVertex v;
-  SHfloat am, cosa, sina, dx, dy;
-  SHVector2 uux, uuy, c1, m;
-  SHArc arcs[SH_MAX_RECURSE_DEPTH];
-  SHArc *a, *aleft, *aright;
-  SHint aindex=0;
-  arcs[0] = *arc;
+  SHfloat tol, sx, sy;
   
-  while (aindex >= 0) {
-    
-    a = &arcs[aindex];
-    
-    /* Middle angle and its cos/sin */
-    am = (a->a1 + a->a2)/2;
-    cosa = SH_COS(am);
-    sina = SH_SIN(am);
+  if (c->renderingQuality == VG_RENDERING_QUALITY_FASTER)
+    tol = SH_FLATTEN_TOLERANCE_FASTER;
+  else tol = SH_FLATTEN_TOLERANCE;
   
-    /* New point */
-    SET2V(uux, (*ux)); MUL2(uux, cosa);
-    SET2V(uuy, (*uy)); MUL2(uuy, sina);
-    SET2V(c1, (*c)); ADD2V(c1, uux); ADD2V(c1, uuy);
-    
-    /* Check distance from linear midpoint */
-    SET2V(m, a->p1); ADD2V(m, a->p2); DIV2(m, 2);
-    dx = c1.x - m.x; dy = c1.y - m.y;
-    if (dx < 0.0f) dx = -dx;
-    if (dy < 0.0f) dy = -dy;
-    
-    /* Stop if flat enough */
-    if (dx+dy <= 1.0f || aindex == SH_MAX_RECURSE_DEPTH-1) {
-      
-      /* Add middle subdivision point */
-      v.point = c1; v.flags = 0;
-      if (!shAddVertex(p, &v, contourStart)) return;
-      if (aindex == 0) return; /* Skip very last point */
-      
-      /* Add end subdivision point */
-      v.point = a->p2; v.flags = 0;
-      if (!shAddVertex(p, &v, contourStart)) return;
-      --aindex;
-      
-    }else{
-      
-      /* Left subdivision goes on top of stack! */
-      aright = a; aleft = &arcs[++aindex];
-      
-      /* Add left recursion to stack */
-      aleft->p1 = a->p1;
-      aleft->a1 = a->a1;
-      aleft->p2 = c1;
-      aleft->a2 = am;
-      
-      /* Add right recursion to stack */
-      aright->p1 = c1;
-      aright->a1 = am;
-      aright->p2 = a->p2;
-      aright->a2 = a->a2;
-    }
+  if (!surfaceSpace) {
+    sx = SH_SQRT(c->pathTransform.m[0][0] * c->pathTransform.m[0][0] +
+                 c->pathTransform.m[1][0] * c->pathTransform.m[1][0]);
+    sy = SH_SQRT(c->pathTransform.m[0][1] * c->pathTransform.m[0][1] +
+                 c->pathTransform.m[1][1] * c->pathTransform.m[1][1]);
+    sx = SH_MAX(sx, sy);
+    if (sx > 0.0f) tol /= sx;
   }
+  
+  return tol;
 }
 
-static void shSubdivideSegment(SHPath *p, VGPathSegment segment,
-                               VGPathCommand originalCommand,
-                               SHfloat *data, void *userData)
+/*--------------------------------------------------
+ * Appends the flattening of a normalized segment to
+ * [out]: the inner curve points and the end point
+ *--------------------------------------------------*/
+
+static void shFlattenSegment(SHVector2Array *out, VGPathSegment segment,
+                             SHfloat *data, SHfloat tol)
 {
-  SHVertex v;
-  SHint *contourStart = ((SHint**)userData)[0];
-  SHint *surfaceSpace = ((SHint**)userData)[1];
+  SHVector2 v;
   SHQuad quad; SHCubic cubic; SHArc arc;
   SHVector2 c, ux, uy;
-  VG_GETCONTEXT(VG_NO_RETVAL);
   
   switch (segment)
   {
   case VG_MOVE_TO:
-    
-    /* Set contour start here */
-    (*contourStart) = p->vertices.size;
-    
-    /* First contour vertex */
-    v.point.x = data[2];
-    v.point.y = data[3];
-    v.flags = 0;
-    if (*surfaceSpace)
-      TRANSFORM2(v.point, context->pathTransform);
-    break;
-    
   case VG_CLOSE_PATH:
-    
-    /* Last contour vertex */
-    v.point.x = data[2];
-    v.point.y = data[3];
-    v.flags = SH_VERTEX_FLAG_SEGEND | SH_VERTEX_FLAG_CLOSE;
-    if (*surfaceSpace)
-      TRANSFORM2(v.point, context->pathTransform);
-    break;
-    
   case VG_LINE_TO:
     
-    /* Last segment vertex */
-    v.point.x = data[2];
-    v.point.y = data[3];
-    v.flags = SH_VERTEX_FLAG_SEGEND;
-    if (*surfaceSpace)
-      TRANSFORM2(v.point, context->pathTransform);
+    SET2(v, data[2], data[3]);
     break;
     
   case VG_QUAD_TO:
@@ -271,18 +214,8 @@ static void shSubdivideSegment(SHPath *p, VGPathSegment segment,
     SET2(quad.p1, data[0], data[1]);
     SET2(quad.p2, data[2], data[3]);
     SET2(quad.p3, data[4], data[5]);
-    if (*surfaceSpace) {
-      TRANSFORM2(quad.p1, context->pathTransform);
-      TRANSFORM2(quad.p2, context->pathTransform);
-      TRANSFORM2(quad.p3, context->pathTransform); }
-    shSubrecurseQuad(p, &quad, contourStart);
-    
-    /* Last segment vertex */
-    v.point.x = data[4];
-    v.point.y = data[5];
-    v.flags = SH_VERTEX_FLAG_SEGEND;
-    if (*surfaceSpace)
-      TRANSFORM2(v.point, context->pathTransform);
+    shFlattenQuad(out, &quad, tol);
+    SET2(v, data[4], data[5]);
     break;
     
   case VG_CUBIC_TO:
@@ -292,19 +225,8 @@ static void shSubdivideSegment(SHPath *p, VGPathSegment segment,
     SET2(cubic.p2, data[2], data[3]);
     SET2(cubic.p3, data[4], data[5]);
     SET2(cubic.p4, data[6], data[7]);
-    if (*surfaceSpace) {
-      TRANSFORM2(cubic.p1, context->pathTransform);
-      TRANSFORM2(cubic.p2, context->pathTransform);
-      TRANSFORM2(cubic.p3, context->pathTransform);
-      TRANSFORM2(cubic.p4, context->pathTransform); }
-    shSubrecurseCubic(p, &cubic, contourStart);
-    
-    /* Last segment vertex */
-    v.point.x = data[6];
-    v.point.y = data[7];
-    v.flags = SH_VERTEX_FLAG_SEGEND;
-    if (*surfaceSpace)
-      TRANSFORM2(v.point, context->pathTransform);
+    shFlattenCubic(out, &cubic, tol);
+    SET2(v, data[6], data[7]);
     break;
     
   default:
@@ -319,75 +241,347 @@ static void shSubdivideSegment(SHPath *p, VGPathSegment segment,
     SET2(c,  data[2], data[3]);
     SET2(ux, data[4], data[5]);
     SET2(uy, data[6], data[7]);
-    if (*surfaceSpace) {
-      TRANSFORM2(arc.p1, context->pathTransform);
-      TRANSFORM2(arc.p2, context->pathTransform);
-      TRANSFORM2(c, context->pathTransform);
-      TRANSFORM2DIR(ux, context->pathTransform);
-      TRANSFORM2DIR(uy, context->pathTransform); }
-    shSubrecurseArc(p, &arc, &c, &ux, &uy, contourStart);
-    
-    /* Last segment vertex */
-    v.point.x = data[10];
-    v.point.y = data[11];
-    v.flags = SH_VERTEX_FLAG_SEGEND;
-    if (*surfaceSpace) {
-      TRANSFORM2(v.point, context->pathTransform); }
+    shFlattenArc(out, &arc, &c, &ux, &uy, tol);
+    SET2(v, data[10], data[11]);
     break;
   }
   
-  /* Add subdivision vertex */
-  shAddVertex(p, &v, contourStart);
+  /* Last segment point */
+  shPushCurvePoint(out, &v);
+}
+
+static void shSubdivideSegment(SHPath *p, VGPathSegment segment,
+                               VGPathCommand originalCommand,
+                               SHfloat *data, void *userData)
+{
+  SHuint8 flags;
+  SHint *contour = (SHint*)((void**)userData)[0];
+  SHfloat tol = *(SHfloat*)((void**)userData)[1];
+  SHPathCursor *cursor = (SHPathCursor*)((void**)userData)[2];
+  SHint from = p->vertices.size;
+  SHTessContour tc;
+  
+  if (segment == VG_MOVE_TO) {
+    
+    /* Open a new contour, remembering where from */
+    if (!shIntArrayPushBack(&p->contours, 0)) return;
+    tc.cursor = *cursor;
+    tc.vertex = p->vertices.size;
+    if (!shTessContourArrayPushBackP(&p->tessContours, &tc)) {
+      p->contours.size--;
+      return;
+    }
+    (*contour) = p->contours.size - 1;
+    flags = 0;
+    
+  }else if (segment == VG_CLOSE_PATH) {
+    flags = SH_VERTEX_FLAG_SEGEND | SH_VERTEX_FLAG_CLOSE;
+  }else flags = SH_VERTEX_FLAG_SEGEND;
+  
+  /* Add subdivision vertices */
+  shFlattenSegment(&p->vertices, segment, data, tol);
+  shAddVertices(p, from, flags, contour);
+}
+
+/*--------------------------------------------------
+ * Returns true if the subdivision consists of a
+ * single contour that is a convex, non self-
+ * intersecting polygon (taken as closed). Its fan
+ * then covers every inner pixel exactly once.
+ *--------------------------------------------------*/
+
+static VGboolean shIsConvexContour(SHPath *p)
+{
+  SHint n = p->vertices.size;
+  SHint i, sign = 0, xflips = 0, yflips = 0;
+  SHfloat cross, xdir = 0.0f, ydir = 0.0f;
+  SHVector2 *a, *b, *c;
+  SHVector2 e1, e2;
+  
+  if (n < 3 || p->contours.size != 1)
+    return VG_FALSE;
+  
+  for (i=0; i<n; ++i) {
+    a = &p->vertices.items[i];
+    b = &p->vertices.items[(i+1) % n];
+    c = &p->vertices.items[(i+2) % n];
+    SET2(e1, b->x - a->x, b->y - a->y);
+    SET2(e2, c->x - b->x, c->y - b->y);
+    
+    /* All turns must go the same way */
+    cross = e1.x * e2.y - e1.y * e2.x;
+    if (cross > 0.0f) {
+      if (sign < 0) return VG_FALSE;
+      sign = 1;
+    }else if (cross < 0.0f) {
+      if (sign > 0) return VG_FALSE;
+      sign = -1;
+    }
+    
+    /* Winding more than once around changes the
+       direction of each axis more than twice */
+    if (e1.x != 0.0f) {
+      if (e1.x * xdir < 0.0f) xflips++;
+      xdir = e1.x;
+    }
+    if (e1.y != 0.0f) {
+      if (e1.y * ydir < 0.0f) yflips++;
+      ydir = e1.y;
+    }
+  }
+  
+  /* Direction changes counted cyclically: the first
+     edge against the last one */
+  for (i=0; i<n; ++i) {
+    a = &p->vertices.items[i];
+    b = &p->vertices.items[(i+1) % n];
+    if (b->x - a->x != 0.0f) {
+      if ((b->x - a->x) * xdir < 0.0f) xflips++;
+      break;
+    }
+  }
+  for (i=0; i<n; ++i) {
+    a = &p->vertices.items[i];
+    b = &p->vertices.items[(i+1) % n];
+    if (b->y - a->y != 0.0f) {
+      if ((b->y - a->y) * ydir < 0.0f) yflips++;
+      break;
+    }
+  }
+  
+  return (sign != 0 && xflips <= 2 && yflips <= 2);
+}
+
+/*--------------------------------------------------
+ * Grows [min, max], the bounds of the vertices before
+ * [from], by the vertices up to [to]
+ *--------------------------------------------------*/
+
+static void shGrowVertexBounds(SHPath *p, SHint from, SHint to,
+                               SHVector2 *min, SHVector2 *max)
+{
+  SHVector2 lo, hi;
+  
+  if (to <= from) return;
+  shPointsBounds(&p->vertices.items[from], to - from, &lo, &hi);
+  
+  if (from == 0) {
+    *min = lo; *max = hi;
+  }else{
+    min->x = SH_MIN(min->x, lo.x); min->y = SH_MIN(min->y, lo.y);
+    max->x = SH_MAX(max->x, hi.x); max->y = SH_MAX(max->y, hi.y);
+  }
 }
 
 /*--------------------------------------------------
- * Processes path data by simplfying it and sending
- * each segment to subdivision callback function
+ * Processes path data from the tessellation cursor on
+ * by simplfying it and sending each segment to the
+ * subdivision callback function, which appends to the
+ * subdivision. Then finds the bounds before each new
+ * contour and of the whole subdivision, growing the
+ * ones of the vertices kept.
  *--------------------------------------------------*/
 
-void shFlattenPath(SHPath *p, SHint surfaceSpace)
+static void shFlattenFrom(SHPath *p, SHfloat tol)
 {
-  SHint contourStart = -1;
-  SHint surfSpace = surfaceSpace;
-  SHint *userData[2];
+  SHint contour = p->contours.size - 1;
+  SHint first = p->tessContours.size;
+  SHint from = p->vertices.size;
+  SHVector2 min = p->min, max = p->max;
+  SHTessContour *tc;
+  void *userData[3];
+  SHint i;
   SHint processFlags =
     SH_PROCESS_SIMPLIFY_LINES |
     SH_PROCESS_SIMPLIFY_CURVES |
     SH_PROCESS_CENTRALIZE_ARCS |
     SH_PROCESS_REPAIR_ENDS;
   
-  userData[0] = &contourStart;
-  userData[1] = &surfaceSpace;
+  userData[0] = &contour;
+  userData[1] = &tol;
+  userData[2] = &p->tessCursor;
+  
+  shProcessPathDataFrom(p, processFlags, &p->tessCursor,
+                        shSubdivideSegment, userData);
+  
+  for (i=first; i<p->tessContours.size; ++i) {
+    tc = &p->tessContours.items[i];
+    shGrowVertexBounds(p, from, tc->vertex, &min, &max);
+    from = SH_MAX(from, tc->vertex);
+    tc->min = min; tc->max = max;
+  }
+  
+  shGrowVertexBounds(p, from, p->vertices.size, &min, &max);
+  if (p->vertices.size == 0) {
+    SET2(min, 0,0); SET2(max, 0,0);
+  }
+  
+  p->min = min;
+  p->max = max;
+}
+
+/*--------------------------------------------------
+ * Flattens the whole path. Finds the bounds too.
+ *--------------------------------------------------*/
+
+void shFlattenPath(SHPath *p, SHfloat tol)
+{
+  shVector2ArrayClear(&p->vertices);
+  shUint8ArrayClear(&p->vertexFlags);
+  shIntArrayClear(&p->contours);
+  shTessContourArrayClear(&p->tessContours);
+  shResetPathCursor(&p->tessCursor);
+  shFlattenFrom(p, tol);
+  
+  /* Convex fills need no stencil pass */
+  p->convex = shIsConvexContour(p);
+}
+
+/*--------------------------------------------------
+ * Brings the subdivision up to date with path data
+ * changed from segment [seg] on, keeping the contours
+ * opened before it. Data appended past the end gets
+ * flattened onto the last contour. Outputs the first
+ * vertex that may have changed and its contour.
+ *--------------------------------------------------*/
+
+void shReflattenPath(SHPath *p, SHint seg, SHfloat tol,
+                     SHint *vertex, SHint *contour)
+{
+  SHTessContour tc;
+  SHint lo, hi, mid, count;
+  
+  if (seg < p->tessCursor.seg) {
+    
+    /* Find the last contour opened up to the segment */
+    lo = 0; hi = p->tessContours.size;
+    while (lo < hi) {
+      mid = (lo + hi) / 2;
+      if (p->tessContours.items[mid].cursor.seg <= seg) lo = mid + 1;
+      else hi = mid;
+    }
+    
+    if (lo == 0) {
+      shFlattenPath(p, tol);
+      *vertex = 0; *contour = 0;
+      return;
+    }
+    
+    /* Drop it and the contours after it */
+    tc = p->tessContours.items[lo-1];
+    p->vertices.size = tc.vertex;
+    p->vertexFlags.size = tc.vertex;
+    p->contours.size = lo-1;
+    p->tessContours.size = lo-1;
+    p->tessCursor = tc.cursor;
+    p->min = tc.min;
+    p->max = tc.max;
+  }
+  
+  count = p->contours.size;
+  *vertex = p->vertices.size;
+  shFlattenFrom(p, tol);
+  
+  /* The last contour kept got the new vertices unless
+     a new one starts with them */
+  if (count > 0 && (count == p->contours.size ||
+                    p->tessContours.items[count].vertex > *vertex))
+    --count;
+  *contour = count;
+  
+  /* Convexity is checked again only on small paths */
+  if (p->vertices.size <= SH_COVER_MAX_HULL_POINTS)
+    p->convex = shIsConvexContour(p);
+  else p->convex = VG_FALSE;
+}
+
+/*-----------------------------------------------------------
+ * Adds a vertex to the path's stroke unless [index] refers
+ * to one already, and returns its index. Indices get widened
+ * to 32 bits once they no longer fit in 16. Running out of
+ * memory marks the stroke failed and nothing gets added.
+ *-----------------------------------------------------------*/
+
+static SHint shStrokeVertex(SHPath *p, SHVector2 *v, SHint *index)
+{
+  SHUint8Array *a = &p->strokeIndices;
+  SHint i;
+  
+  if (p->strokeFailed)
+    return 0;
+  
+  if (*index >= 0)
+    return *index;
+  
+  if (p->stroke.size == 0x10000 && p->strokeIndexSize == 2) {
+    if (!shUint8ArrayReserveAndCopy(a, a->size * 2)) {
+      p->strokeFailed = 1;
+      return 0;
+    }
+    for (i=a->size/2-1; i>=0; --i)
+      ((SHuint32*)a->items)[i] = ((SHuint16*)a->items)[i];
+    a->size *= 2;
+    p->strokeIndexSize = 4;
+  }
+  
+  /* Keep track of the stroke bounds */
+  if (p->stroke.size == 0) {
+    p->strokeMin = *v; p->strokeMax = *v;
+  }else{
+    if (v->x < p->strokeMin.x) p->strokeMin.x = v->x;
+    if (v->x > p->strokeMax.x) p->strokeMax.x = v->x;
+    if (v->y < p->strokeMin.y) p->strokeMin.y = v->y;
+    if (v->y > p->strokeMax.y) p->strokeMax.y = v->y;
+  }
+  
+  if (!shVector2ArrayPushBackP(&p->stroke, v)) {
+    p->strokeFailed = 1;
+    return 0;
+  }
   
-  shVertexArrayClear(&p->vertices);
-  shProcessPathData(p, processFlags, shSubdivideSegment, userData);
+  *index = p->stroke.size - 1;
+  return *index;
 }
 
 /*-------------------------------------------
- * Adds a rectangle to the path's stroke.
+ * Adds a triangle to the path's stroke.
  *-------------------------------------------*/
 
-static void shPushStrokeQuad(SHPath *p, SHVector2 *p1, SHVector2 *p2,
-                             SHVector2 *p3, SHVector2 *p4)
+static void shPushStrokeTri(SHPath *p, SHint i1, SHint i2, SHint i3)
 {
-  shVector2ArrayPushBackP(&p->stroke, p1);
-  shVector2ArrayPushBackP(&p->stroke, p2);
-  shVector2ArrayPushBackP(&p->stroke, p3);
-  shVector2ArrayPushBackP(&p->stroke, p3);
-  shVector2ArrayPushBackP(&p->stroke, p4);
-  shVector2ArrayPushBackP(&p->stroke, p1);
+  SHUint8Array *a = &p->strokeIndices;
+  SHint bytes = 3 * p->strokeIndexSize;
+  
+  if (p->strokeFailed)
+    return;
+  
+  if (a->size + bytes > a->capacity) {
+    if (!shUint8ArrayReserveAndCopy(a, SH_MAX(a->capacity * 2, a->size + bytes))) {
+      p->strokeFailed = 1;
+      return;
+    }
+  }
+  
+  if (p->strokeIndexSize == 2) {
+    SHuint16 *d = (SHuint16*)(a->items + a->size);
+    d[0] = (SHuint16)i1; d[1] = (SHuint16)i2; d[2] = (SHuint16)i3;
+  }else{
+    SHuint32 *d = (SHuint32*)(a->items + a->size);
+    d[0] = (SHuint32)i1; d[1] = (SHuint32)i2; d[2] = (SHuint32)i3;
+  }
+  
+  a->size += bytes;
 }
 
 /*-------------------------------------------
- * Adds a triangle to the path's stroke.
+ * Adds a rectangle to the path's stroke.
  *-------------------------------------------*/
 
-static void shPushStrokeTri(SHPath *p, SHVector2 *p1,
-                            SHVector2 *p2, SHVector2 *p3)
+static void shPushStrokeQuad(SHPath *p, SHint i1, SHint i2,
+                             SHint i3, SHint i4)
 {
-  shVector2ArrayPushBackP(&p->stroke, p1);
-  shVector2ArrayPushBackP(&p->stroke, p2);
-  shVector2ArrayPushBackP(&p->stroke, p3);
+  shPushStrokeTri(p, i1, i2, i3);
+  shPushStrokeTri(p, i3, i4, i1);
 }
 
 /*-----------------------------------------------------------
@@ -395,12 +589,15 @@ static void shPushStrokeTri(SHPath *p, SHVector2 *p1,
  * turn point [c], with the end of the previous segment
  * outset [o1] and the beginning of the next segment
  * outset [o2], transiting from tangent [d1] to [d2].
+ * Each point comes with the index it was added at, or -1.
  *-----------------------------------------------------------*/
 
-static void shStrokeJoinMiter(SHPath *p, SHVector2 *c,
-                              SHVector2 *o1, SHVector2 *d1,
-                              SHVector2 *o2, SHVector2 *d2)
+static void shStrokeJoinMiter(SHPath *p, SHVector2 *c, SHint *ic,
+                              SHVector2 *o1, SHint *io1, SHVector2 *d1,
+                              SHVector2 *o2, SHint *io2, SHVector2 *d2)
 {
+  SHint ix = -1;
+  
   /* Init miter top to first point in case lines are colinear */
   SHVector2 x; SET2V(x,(*o1));
   
@@ -410,119 +607,166 @@ static void shStrokeJoinMiter(SHPath *p, SHVector2 *c,
   
   /* Add a "diamond" quad with top on intersected point
      and bottom on center of turn (on the line) */
-  shPushStrokeQuad(p, &x, o1, c, o2);
+  shPushStrokeQuad(p, shStrokeVertex(p, &x, &ix),
+                   shStrokeVertex(p, o1, io1),
+                   shStrokeVertex(p, c, ic),
+                   shStrokeVertex(p, o2, io2));
 }
 
 /*-----------------------------------------------------------
- * Adds a round join to the path's stroke at the given
- * turn point [c], with the end of the previous segment
- * outset [pstart] and the beginning of the next segment
- * outset [pend], transiting from perpendicular vector
- * [tstart] to [tend].
+ * Picks the number of steps per half turn of round joins
+ * and caps, so that the chords stay within [tol] of an arc
+ * of the given [radius], and the rotation by one step.
  *-----------------------------------------------------------*/
 
-static void shStrokeJoinRound(SHPath *p, SHVector2 *c,
-                              SHVector2 *pstart, SHVector2 *tstart, 
-                              SHVector2 *pend, SHVector2 *tend)
+static SHint shRoundSteps(SHfloat radius, SHfloat tol, SHVector2 *rot)
 {
-  SHVector2 p1, p2;
-  SHfloat a, ang, cosa, sina;
+  SHfloat step = PI;
+  SHint steps;
   
-  /* Find angle between lines */
-  ang = ANGLE2((*tstart),(*tend));
+  /* Chord of angle a deviates by r*(1 - cos(a/2)) */
+  if (radius > tol)
+    step = 2 * SH_ACOS(1 - tol / radius);
+  
+  steps = (SHint)SH_CEIL(PI / step);
+  steps = SH_MAX(steps, 1);
+  steps = SH_MIN(steps, SH_MAX_ROUND_STEPS);
+  
+  SET2((*rot), SH_COS(PI / steps), SH_SIN(PI / steps));
+  return steps;
+}
+
+/*-----------------------------------------------------------
+ * Adds a fan around [c] to the path's stroke, from the
+ * outset [pstart] at perpendicular vector [tstart] with
+ * [steps] rotations by [rot] (clockwise) to [pend].
+ *-----------------------------------------------------------*/
+
+static void shStrokeFan(SHPath *p, SHVector2 *c, SHint *ic,
+                        SHVector2 *pstart, SHint *istart,
+                        SHVector2 *tstart, SHVector2 *rot, SHint steps,
+                        SHVector2 *pend, SHint *iend)
+{
+  SHVector2 t, p2;
+  SHint i1, i2, icenter, k;
   
   /* Begin with start point */
-  SET2V(p1,(*pstart));
-  for (a=0.0f; a<ang; a+=PI/12) {
+  i1 = shStrokeVertex(p, pstart, istart);
+  icenter = shStrokeVertex(p, c, ic);
+  SET2V(t, (*tstart));
+  
+  for (k=1; k<steps; ++k) {
     
     /* Rotate perpendicular vector around and
        find next offset point from center */
-    cosa = SH_COS(-a);
-    sina = SH_SIN(-a);
-    SET2(p2, tstart->x*cosa - tstart->y*sina,
-         tstart->x*sina + tstart->y*cosa);
-    ADD2V(p2, (*c));
+    SET2(t, t.x*rot->x + t.y*rot->y,
+         t.y*rot->x - t.x*rot->y);
+    SET2V(p2, (*c)); ADD2V(p2, t);
     
     /* Add triangle, save previous */
-    shPushStrokeTri(p, &p1, &p2, c);
-    SET2V(p1, p2);
+    i2 = -1;
+    shPushStrokeTri(p, i1, shStrokeVertex(p, &p2, &i2), icenter);
+    i1 = i2;
   }
   
   /* Add last triangle */
-  shPushStrokeTri(p, &p1, pend, c);
+  shPushStrokeTri(p, i1, shStrokeVertex(p, pend, iend), icenter);
+}
+
+/*-----------------------------------------------------------
+ * Adds a round join to the path's stroke at the given
+ * turn point [c], with the end of the previous segment
+ * outset [pstart] and the beginning of the next segment
+ * outset [pend], transiting from perpendicular vector
+ * [tstart] to [tend] in steps of [halfSteps] per half turn.
+ *-----------------------------------------------------------*/
+
+static void shStrokeJoinRound(SHPath *p, SHVector2 *c, SHint *ic,
+                              SHVector2 *pstart, SHint *istart,
+                              SHVector2 *tstart, 
+                              SHVector2 *pend, SHint *iend,
+                              SHVector2 *tend,
+                              SHVector2 *rot, SHint halfSteps)
+{
+  /* Find angle between lines */
+  SHfloat ang = ANGLE2((*tstart),(*tend));
+  SHint steps = (SHint)SH_CEIL(ang * halfSteps / PI);
+  
+  shStrokeFan(p, c, ic, pstart, istart, tstart, rot,
+              SH_MAX(steps, 1), pend, iend);
 }
 
-static void shStrokeCapRound(SHPath *p, SHVector2 *c, SHVector2 *t, SHint start)
+/*-----------------------------------------------------------
+ * Adds a cap around [c] from the outset [pfirst] (at [t],
+ * reverted for a start cap) to the opposite one [plast].
+ *-----------------------------------------------------------*/
+
+static void shStrokeCapRound(SHPath *p, SHVector2 *c, SHVector2 *t, SHint start,
+                             SHVector2 *pfirst, SHint *ifirst,
+                             SHVector2 *plast, SHint *ilast,
+                             SHVector2 *rot, SHint halfSteps)
 {
-  SHint a;
-  SHfloat ang, cosa, sina;
-  SHVector2 p1, p2;
-  SHint steps = 12;
+  SHint icenter = -1;
   SHVector2 tt;
   
   /* Revert perpendicular vector if start cap */
   SET2V(tt, (*t));
   if (start) MUL2(tt, -1);
   
-  /* Find start point */
-  SET2V(p1, (*c));
-  ADD2V(p1, tt);
-  
-  for (a = 1; a<=steps; ++a) {
-    
-    /* Rotate perpendicular vector around and
-       find next offset point from center */
-    ang = (SHfloat)a * PI / steps;
-    cosa = SH_COS(-ang);
-    sina = SH_SIN(-ang);
-    SET2(p2, tt.x*cosa - tt.y*sina,
-         tt.x*sina + tt.y*cosa);
-    ADD2V(p2, (*c));
-    
-    /* Add triangle, save previous */
-    shPushStrokeTri(p, &p1, &p2, c);
-    SET2V(p1, p2);
-  }
+  shStrokeFan(p, c, &icenter, pfirst, ifirst, &tt, rot,
+              halfSteps, plast, ilast);
 }
 
-static void shStrokeCapSquare(SHPath *p, SHVector2 *c, SHVector2 *t, SHint start)
+static void shStrokeCapSquare(SHPath *p, SHVector2 *c, SHVector2 *t, SHint start,
+                              SHVector2 *pfirst, SHint *ifirst,
+                              SHVector2 *plast, SHint *ilast)
 {
-  SHVector2 tt, p1, p2, p3, p4;
+  SHVector2 tt, p2, p3;
+  SHint i2 = -1, i3 = -1;
   
   /* Revert perpendicular vector if start cap */
   SET2V(tt, (*t));
   if (start) MUL2(tt, -1);
   
-  /* Find four corners of the quad */
-  SET2V(p1, (*c));
-  ADD2V(p1, tt);
-  
-  SET2V(p2, p1);
+  /* Find the two outer corners of the quad */
+  SET2V(p2, (*c));
+  ADD2V(p2, tt);
   ADD2(p2, tt.y, -tt.x);
   
   SET2V(p3, p2);
   ADD2(p3, -2*tt.x, -2*tt.y);
   
-  SET2V(p4, p3);
-  ADD2(p4, -tt.y, tt.x);
-  
-  shPushStrokeQuad(p, &p1, &p2, &p3, &p4);
+  shPushStrokeQuad(p, shStrokeVertex(p, pfirst, ifirst),
+                   shStrokeVertex(p, &p2, &i2),
+                   shStrokeVertex(p, &p3, &i3),
+                   shStrokeVertex(p, plast, ilast));
 }
 
 /*-----------------------------------------------------------
- * Generates stroke of a path according to VGContext state.
+ * Generates stroke of a path with the given stroke style.
  * Produces quads for every linear subdivision segment or
- * dash "on" segment, handles line caps and joins.
+ * dash "on" segment, handles line caps and joins. Round
+ * joins and caps are flattened to tolerance [tol], the one
+ * the path was flattened with. Walks the subdivision from
+ * the state in [from] on, or from the start if NULL, and
+ * appends to the stroke. Dashed strokes always start over.
+ * Returns 0 and leaves the stroke empty if memory ran out.
  *-----------------------------------------------------------*/
 
-void shStrokePath(VGContext* c, SHPath *p)
+static int shStrokeFrom(const SHStrokeStyle *s, SHfloat tol, SHPath *p,
+                         const SHStrokeCursor *from)
 {
   /* Line width and vertex count */
-  SHfloat w = c->strokeLineWidth / 2;
-  SHfloat mlimit = c->strokeMiterLimit;
+  SHfloat w = s->lineWidth / 2;
+  SHfloat mlimit = s->miterLimit;
   SHint vertsize = p->vertices.size;
   
+  /* Rotation step of round joins and caps */
+  SHVector2 rot;
+  SHint halfSteps = shRoundSteps(w, tol, &rot);
+  
   /* Contour state */
+  SHint contourIndex = 0;
   SHint contourStart = 0;
   SHint contourLength = 0;
   SHint start = 0;
@@ -533,25 +777,34 @@ void shStrokePath(VGContext* c, SHPath *p)
   
   /* Current vertices */
   SHint i1=0, i2=0;
-  SHVertex *v1, *v2;
+  SHuint8 *flags = p->vertexFlags.items;
   SHVector2 *p1, *p2;
   SHVector2 d, t, dprev, tprev;
   SHfloat norm, cross, mlength;
   
-  /* Stroke edge points */
+  /* Stroke edge points, with their vertex indices
+     once added to the stroke */
   SHVector2 l1, r1, l2, r2, lprev, rprev;
+  SHint il1, ir1, il2, ir2, ilprev = -1, irprev = -1;
+  SHint ic1;
+  
+  /* Walk state to re-stroke from */
+  SHStrokeCursor here;
+  SHint cursorIndex;
+  SHint first = 0;
   
   /* Dash state */
   SHint dashIndex = 0;
   SHfloat dashLength = 0.0f, strokeLength = 0.0f;
-  SHint dashSize = c->strokeDashPattern.size;
-  SHfloat *dashPattern = c->strokeDashPattern.items;
+  SHint dashSize = s->dashCount;
+  const SHfloat *dashPattern = s->dashPattern;
   SHint dashOn = 1;
   
   /* Dash edge points */
   SHVector2 dash1, dash2;
   SHVector2 dashL1, dashR1;
   SHVector2 dashL2, dashR2;
+  SHint idL1, idR1, idL2, idR2;
   SHfloat nextDashLength, dashOffset;
   
   /* Discard odd dash segment */
@@ -561,10 +814,21 @@ void shStrokePath(VGContext* c, SHPath *p)
      for uninitialized usage */
   SET2(tprev, 0,0); SET2(dprev, 0,0);
   SET2(lprev, 0,0); SET2(rprev, 0,0);
-
+  
+  /* Pick up state */
+  if (from != NULL && dashSize == 0) {
+    first = from->vertex;
+    contourIndex = from->contourIndex;
+    contourStart = from->contourStart;
+    if (first != contourStart)
+      contourLength = p->contours.items[contourIndex-1];
+    dprev = from->dprev; tprev = from->tprev;
+    lprev = from->lprev; rprev = from->rprev;
+    ilprev = from->ilprev; irprev = from->irprev;
+  }
   
   /* Walk over subdivision vertices */
-  for (i1=0; i1<vertsize; ++i1) {
+  for (i1=first; i1<vertsize && !p->strokeFailed; ++i1) {
     
     if (loop) {
       /* Start new contour if exists */
@@ -575,13 +839,33 @@ void shStrokePath(VGContext* c, SHPath *p)
     
     start = end = loop = close = segend = 0;
     i2 = i1 + 1;
+    cursorIndex = contourIndex;
     
     if (i1 == contourStart) {
       /* Contour has started. Get length */
-      contourLength = p->vertices.items[i1].flags;
+      contourLength = p->contours.items[contourIndex++];
       start = 1;
     }
     
+    if (start || i2 == contourStart + contourLength-1) {
+      
+      /* Save state at contour start and before the
+         last edge */
+      here.vertex = i1;
+      here.contourIndex = cursorIndex;
+      here.contourStart = contourStart;
+      here.dprev = dprev; here.tprev = tprev;
+      here.lprev = lprev; here.rprev = rprev;
+      here.ilprev = ilprev; here.irprev = irprev;
+      here.strokeSize = p->stroke.size;
+      here.indexCount = p->strokeIndices.size / p->strokeIndexSize;
+      here.strokeMin = p->strokeMin;
+      here.strokeMax = p->strokeMax;
+      
+      if (start && !shStrokeCursorArrayPushBackP(&p->strokeContours, &here))
+        p->strokeFailed = 1;
+    }
+    
     if (contourLength <= 1) {
       /* Discard empty contours. */
       contourStart = i1 + 1;
@@ -589,18 +873,16 @@ void shStrokePath(VGContext* c, SHPath *p)
       continue;
     }
     
-    v1 = &p->vertices.items[i1];
-    v2 = &p->vertices.items[i2];
-    
     if (i2 == contourStart + contourLength-1) {
       /* Contour has ended. Check close */
-      close = v2->flags & SH_VERTEX_FLAG_CLOSE;
+      close = flags[i2] & SH_VERTEX_FLAG_CLOSE;
       end = 1;
+      p->strokeTail = here;
     }
     
     if (i1 == contourStart + contourLength-1) {
       /* Loop back to first edge. Check close */
-      close = v1->flags & SH_VERTEX_FLAG_CLOSE;
+      close = flags[i1] & SH_VERTEX_FLAG_CLOSE;
       i2 = contourStart+1;
       contourStart = i1 + 1;
       i1 = i2 - 1;
@@ -609,14 +891,14 @@ void shStrokePath(VGContext* c, SHPath *p)
     
     if (!start && !loop) {
       /* We are inside a contour. Check segment end. */
-      segend = (v1->flags & SH_VERTEX_FLAG_SEGEND);
+      segend = (flags[i1] & SH_VERTEX_FLAG_SEGEND);
     }
     
     if (dashSize > 0 && start &&
-        (contourStart == 0 || c->strokeDashPhaseReset)) {
+        (contourStart == 0 || s->dashPhaseReset)) {
       
       /* Reset pattern phase at contour start */
-      dashLength = -c->strokeDashPhase;
+      dashLength = -s->dashPhase;
       strokeLength = 0.0f;
       dashIndex = 0;
       dashOn = 1;
@@ -639,10 +921,8 @@ void shStrokePath(VGContext* c, SHPath *p)
     }
     
     /* Subdiv segment vertices and points */
-    v1 = &p->vertices.items[i1];
-    v2 = &p->vertices.items[i2];
-    p1 = &v1->point;
-    p2 = &v2->point;
+    p1 = &p->vertices.items[i1];
+    p2 = &p->vertices.items[i2];
     
     /* Direction vector */
     SET2(d, p2->x-p1->x, p2->y-p1->y);
@@ -660,21 +940,24 @@ void shStrokePath(VGContext* c, SHPath *p)
     SET2V(r1, (*p1)); SUB2V(r1, t);
     SET2V(l2, (*p2)); ADD2V(l2, t);
     SET2V(r2, (*p2)); SUB2V(r2, t);
+    il1 = ir1 = il2 = ir2 = ic1 = -1;
     
     /* Check if join needed */
     if ((segend || (loop && close)) && dashOn) {
       
-      switch (c->strokeJoinStyle) {
+      switch (s->joinStyle) {
       case VG_JOIN_ROUND:
         
         /* Add a round join to stroke */
         if (cross >= 0.0f)
-          shStrokeJoinRound(p, p1, &lprev, &tprev, &l1, &t);
+          shStrokeJoinRound(p, p1, &ic1, &lprev, &ilprev, &tprev,
+                            &l1, &il1, &t, &rot, halfSteps);
         else{
           SHVector2 _t, _tprev;
           SET2(_t, -t.x, -t.y);
           SET2(_tprev, -tprev.x, -tprev.y);
-          shStrokeJoinRound(p, p1,  &r1, &_t, &rprev, &_tprev);
+          shStrokeJoinRound(p, p1, &ic1, &r1, &ir1, &_t,
+                            &rprev, &irprev, &_tprev, &rot, halfSteps);
         }
         
         break;
@@ -684,9 +967,11 @@ void shStrokePath(VGContext* c, SHPath *p)
         mlength = 1/SH_COS((ANGLE2(t, tprev))/2);
         if (mlength <= mlimit) {
           if (cross > 0.0f)
-            shStrokeJoinMiter(p, p1, &lprev, &dprev, &l1, &d);
+            shStrokeJoinMiter(p, p1, &ic1, &lprev, &ilprev, &dprev,
+                              &l1, &il1, &d);
           else if (cross < 0.0f)
-            shStrokeJoinMiter(p, p1, &rprev, &dprev, &r1, &d);
+            shStrokeJoinMiter(p, p1, &ic1, &rprev, &irprev, &dprev,
+                              &r1, &ir1, &d);
           break;
         }/* Else fall down to bevel */
         
@@ -694,9 +979,13 @@ void shStrokePath(VGContext* c, SHPath *p)
         
         /* Add a bevel join to stroke */
         if (cross > 0.0f)
-          shPushStrokeTri(p, &l1, &lprev, p1);
+          shPushStrokeTri(p, shStrokeVertex(p, &l1, &il1),
+                          shStrokeVertex(p, &lprev, &ilprev),
+                          shStrokeVertex(p, p1, &ic1));
         else if (cross < 0.0f)
-          shPushStrokeTri(p, &r1, &rprev, p1);
+          shPushStrokeTri(p, shStrokeVertex(p, &r1, &ir1),
+                          shStrokeVertex(p, &rprev, &irprev),
+                          shStrokeVertex(p, p1, &ic1));
         
         break;
       }
@@ -704,9 +993,13 @@ void shStrokePath(VGContext* c, SHPath *p)
       
       /* Fill gap with previous (= bevel join) */
       if (cross > 0.0f)
-        shPushStrokeTri(p, &l1, &lprev, p1);
+        shPushStrokeTri(p, shStrokeVertex(p, &l1, &il1),
+                        shStrokeVertex(p, &lprev, &ilprev),
+                        shStrokeVertex(p, p1, &ic1));
       else if (cross < 0.0f)
-        shPushStrokeTri(p, &r1, &rprev, p1);
+        shPushStrokeTri(p, shStrokeVertex(p, &r1, &ir1),
+                        shStrokeVertex(p, &rprev, &irprev),
+                        shStrokeVertex(p, p1, &ic1));
     }
     
     
@@ -714,11 +1007,12 @@ void shStrokePath(VGContext* c, SHPath *p)
        if we are dashing and dash segment is on */
     if ((dashSize == 0 && loop && !close) ||
         (dashSize > 0 && start && dashOn)) {
-      switch (c->strokeCapStyle) {
+      switch (s->capStyle) {
       case VG_CAP_ROUND:
-        shStrokeCapRound(p, p1, &t, 1); break;
+        shStrokeCapRound(p, p1, &t, 1, &r1, &ir1, &l1, &il1,
+                         &rot, halfSteps); break;
       case VG_CAP_SQUARE:
-        shStrokeCapSquare(p, p1, &t, 1); break;
+        shStrokeCapSquare(p, p1, &t, 1, &r1, &ir1, &l1, &il1); break;
       default: break;
       }
     }
@@ -731,6 +1025,7 @@ void shStrokePath(VGContext* c, SHPath *p)
       
       /* Start with beginning of subdiv segment */
       SET2V(dash1, (*p1)); SET2V(dashL1, l1); SET2V(dashR1, r1);
+      idL1 = il1; idR1 = ir1;
       
       do {
         /* Interpolate point on the current subdiv segment */
@@ -743,9 +1038,14 @@ void shStrokePath(VGContext* c, SHPath *p)
         /* Left and right edge points */
         SET2V(dashL2, dash2); ADD2V(dashL2, t);
         SET2V(dashR2, dash2); SUB2V(dashR2, t);
+        idL2 = idR2 = -1;
         
         /* Add quad for this dash segment */
-        if (dashOn) shPushStrokeQuad(p, &dashL2, &dashL1, &dashR1, &dashR2);
+        if (dashOn)
+          shPushStrokeQuad(p, shStrokeVertex(p, &dashL2, &idL2),
+                           shStrokeVertex(p, &dashL1, &idL1),
+                           shStrokeVertex(p, &dashR1, &idR1),
+                           shStrokeVertex(p, &dashR2, &idR2));
 
         /* Move to next dash segment if inside this subdiv segment */
         if (nextDashLength <= strokeLength + norm) {
@@ -755,13 +1055,25 @@ void shStrokePath(VGContext* c, SHPath *p)
           SET2V(dash1, dash2);
           SET2V(dashL1, dashL2);
           SET2V(dashR1, dashR2);
+          idL1 = idL2; idR1 = idR2;
           
-          /* Apply cap to dash segment */
-          switch (c->strokeCapStyle) {
+          /* Apply cap to dash segment, starting on the
+             right edge of a new dash */
+          switch (s->capStyle) {
           case VG_CAP_ROUND:
-            shStrokeCapRound(p, &dash1, &t, dashOn); break;
+            if (dashOn)
+              shStrokeCapRound(p, &dash1, &t, 1, &dashR1, &idR1, &dashL1, &idL1,
+                               &rot, halfSteps);
+            else
+              shStrokeCapRound(p, &dash1, &t, 0, &dashL1, &idL1, &dashR1, &idR1,
+                               &rot, halfSteps);
+            break;
           case VG_CAP_SQUARE:
-            shStrokeCapSquare(p, &dash1, &t, dashOn); break;
+            if (dashOn)
+              shStrokeCapSquare(p, &dash1, &t, 1, &dashR1, &idR1, &dashL1, &idL1);
+            else
+              shStrokeCapSquare(p, &dash1, &t, 0, &dashL1, &idL1, &dashR1, &idR1);
+            break;
           default: break;
           }
         }
@@ -772,7 +1084,10 @@ void shStrokePath(VGContext* c, SHPath *p)
     }else{
       
       /* Add quad for this line segment */
-      shPushStrokeQuad(p, &l2, &l1, &r1, &r2);
+      shPushStrokeQuad(p, shStrokeVertex(p, &l2, &il2),
+                       shStrokeVertex(p, &l1, &il1),
+                       shStrokeVertex(p, &r1, &ir1),
+                       shStrokeVertex(p, &r2, &ir2));
     }
     
     
@@ -780,11 +1095,12 @@ void shStrokePath(VGContext* c, SHPath *p)
        if we are dashing and dash segment is on */
     if ((dashSize == 0 && end && !close) ||
         (dashSize > 0 && end && dashOn)) {
-      switch (c->strokeCapStyle) {
+      switch (s->capStyle) {
       case VG_CAP_ROUND:
-        shStrokeCapRound(p, p2, &t, 0); break;
+        shStrokeCapRound(p, p2, &t, 0, &l2, &il2, &r2, &ir2,
+                         &rot, halfSteps); break;
       case VG_CAP_SQUARE:
-        shStrokeCapSquare(p, p2, &t, 0); break;
+        shStrokeCapSquare(p, p2, &t, 0, &l2, &il2, &r2, &ir2); break;
       default: break;
       }
     }
@@ -793,58 +1109,760 @@ void shStrokePath(VGContext* c, SHPath *p)
     strokeLength += norm;
     SET2V(lprev, l2);
     SET2V(rprev, r2);
+    ilprev = il2;
+    irprev = ir2;
     dprev = d;
     tprev = t;
   }
+  
+  /* Save state past the last contour */
+  here.vertex = vertsize;
+  here.contourIndex = contourIndex;
+  here.contourStart = vertsize;
+  here.dprev = dprev; here.tprev = tprev;
+  here.lprev = lprev; here.rprev = rprev;
+  here.ilprev = ilprev; here.irprev = irprev;
+  here.strokeSize = p->stroke.size;
+  here.indexCount = p->strokeIndices.size / p->strokeIndexSize;
+  here.strokeMin = p->strokeMin;
+  here.strokeMax = p->strokeMax;
+  if (!shStrokeCursorArrayPushBackP(&p->strokeContours, &here))
+    p->strokeFailed = 1;
+  
+  if (p->strokeFailed) {
+    shVector2ArrayClear(&p->stroke);
+    shUint8ArrayClear(&p->strokeIndices);
+    shStrokeCursorArrayClear(&p->strokeContours);
+    p->strokeIndexSize = 2;
+    p->strokeTail.contourStart = -1;
+    SET2(p->strokeMin, 0,0);
+    SET2(p->strokeMax, 0,0);
+    return 0;
+  }
+  
+  return 1;
 }
 
+/*-----------------------------------------------------------
+ * Strokes the whole path. Finds the stroke bounds too.
+ * Returns 0 if memory ran out.
+ *-----------------------------------------------------------*/
 
-/*-------------------------------------------------------------
- * Transforms the tessellation vertices using the given matrix
- *-------------------------------------------------------------*/
-
-void shTransformVertices(SHMatrix3x3 *m, SHPath *p)
+int shStrokePath(const SHStrokeStyle *s, SHfloat tol, SHPath *p)
 {
-  SHVector2 *v;
-  int i = 0;
-  
-  for (i = p->vertices.size-1; i>=0; --i) {
-    v = (&p->vertices.items[i].point);
-    TRANSFORM2((*v), (*m)); }
+  shVector2ArrayClear(&p->stroke);
+  shUint8ArrayClear(&p->strokeIndices);
+  shStrokeCursorArrayClear(&p->strokeContours);
+  p->strokeIndexSize = 2;
+  p->strokeTail.contourStart = -1;
+  p->strokeFailed = 0;
+  SET2(p->strokeMin, 0,0);
+  SET2(p->strokeMax, 0,0);
+  return shStrokeFrom(s, tol, p, NULL);
 }
 
-/*--------------------------------------------------------
- * Finds the tight bounding box of path's tesselation
- * vertices. Depends on whether the path had been
- * tesselated in user or surface space.
- *--------------------------------------------------------*/
+/*-----------------------------------------------------------
+ * Brings the stroke up to date with a subdivision changed
+ * from [vertex] in [contour] on (see shReflattenPath). The
+ * contours before are kept, and so is the one changed if
+ * only vertices past it got added, but for its last edge.
+ * Returns 0 if memory ran out.
+ *-----------------------------------------------------------*/
 
-void shFindBoundbox(SHPath *p)
+int shRestrokePath(const SHStrokeStyle *s, SHfloat tol, SHPath *p,
+                    SHint vertex, SHint contour)
 {
-  int i;
+  SHStrokeCursor from;
+  SHint start;
   
-  if (p->vertices.size == 0) {
-    SET2(p->min, 0,0);
-    SET2(p->max, 0,0);
-    return;
-  }
+  if (s->dashCount > 0 || contour >= p->strokeContours.size ||
+      contour >= p->tessContours.size)
+    return shStrokePath(s, tol, p);
   
-  p->min.x = p->max.x = p->vertices.items[0].point.x;
-  p->min.y = p->max.y = p->vertices.items[0].point.y;
+  start = p->tessContours.items[contour].vertex;
+  if (p->strokeTail.contourStart == start &&
+      p->strokeTail.vertex + 1 < vertex) {
+    from = p->strokeTail;
+    p->strokeContours.size = contour + 1;
+  }else{
+    from = p->strokeContours.items[contour];
+    p->strokeContours.size = contour;
+  }
   
-  for (i=0; i<p->vertices.size; ++i) {
-    
-    SHVector2 *v = &p->vertices.items[i].point;
-    if (v->x < p->min.x) p->min.x = v->x;
-    if (v->x > p->max.x) p->max.x = v->x;
-    if (v->y < p->min.y) p->min.y = v->y;
-    if (v->y > p->max.y) p->max.y = v->y;
+  /* Drop what was generated after it */
+  p->stroke.size = from.strokeSize;
+  p->strokeIndices.size = from.indexCount * p->strokeIndexSize;
+  p->strokeMin = from.strokeMin;
+  p->strokeMax = from.strokeMax;
+  if (from.strokeSize == 0) {
+    SET2(p->strokeMin, 0,0);
+    SET2(p->strokeMax, 0,0);
   }
+  
+  p->strokeFailed = 0;
+  return shStrokeFrom(s, tol, p, &from);
 }
 
+
 /*--------------------------------------------------------
- * Outputs a tight bounding box of a path in path's own
- * coordinate system.
+ * Cover geometry for the paint pass. It only has to
+ * contain the stencil geometry, so instead of always
+ * using the bounding box the cheapest of the bounding
+ * box, one box per contour (fills only) and the convex
+ * hull is picked by area. Triangles are in the space of
+ * the tessellation, padded by SH_COVER_PADDING.
+ *--------------------------------------------------------*/
+
+static void shPushCoverBox(SHVector2Array *a, SHVector2 *min, SHVector2 *max)
+{
+  SHfloat pad = SH_COVER_PADDING;
+  SHVector2 q[4];
+  
+  SET2(q[0], min->x - pad, min->y - pad);
+  SET2(q[1], max->x + pad, min->y - pad);
+  SET2(q[2], min->x - pad, max->y + pad);
+  SET2(q[3], max->x + pad, max->y + pad);
+  
+  shVector2ArrayPushBackP(a, &q[0]);
+  shVector2ArrayPushBackP(a, &q[1]);
+  shVector2ArrayPushBackP(a, &q[2]);
+  shVector2ArrayPushBackP(a, &q[2]);
+  shVector2ArrayPushBackP(a, &q[1]);
+  shVector2ArrayPushBackP(a, &q[3]);
+}
+
+static SHfloat shCoverBoxArea(SHVector2 *min, SHVector2 *max)
+{
+  return (max->x - min->x + 2*SH_COVER_PADDING) *
+         (max->y - min->y + 2*SH_COVER_PADDING);
+}
+
+static int shCompareHullPoints(const void *a, const void *b)
+{
+  const SHVector2 *u = (const SHVector2*)a;
+  const SHVector2 *v = (const SHVector2*)b;
+  if (u->x != v->x) return (u->x < v->x ? -1 : 1);
+  if (u->y != v->y) return (u->y < v->y ? -1 : 1);
+  return 0;
+}
+
+#define SH_HULL_CROSS(o, a, b) \
+  (((a).x - (o).x) * ((b).y - (o).y) - ((a).y - (o).y) * ((b).x - (o).x))
+
+/*--------------------------------------------------------
+ * Builds the counter-clockwise convex hull of [count]
+ * points read with the given stride (monotone chain) and
+ * pushes it outwards by the padding. Returns the number
+ * of hull points written to [hull] (room for count+1).
+ *--------------------------------------------------------*/
+
+static SHint shPaddedHull(const void *points, SHint stride, SHint count,
+                          SHVector2 *pts, SHVector2 *hull)
+{
+  SHVector2 e1, e2, n1, n2;
+  SHVector2 first, prev, next;
+  SHfloat d, norm;
+  SHint i, k = 0, t;
+  
+  for (i=0; i<count; ++i)
+    pts[i] = *(const SHVector2*)((const SHuint8*)points + i*stride);
+  
+  qsort(pts, count, sizeof(SHVector2), shCompareHullPoints);
+  
+  /* Lower hull, then upper hull */
+  for (i=0; i<count; ++i) {
+    while (k >= 2 && SH_HULL_CROSS(hull[k-2], hull[k-1], pts[i]) <= 0.0f) k--;
+    hull[k++] = pts[i];
+  }
+  for (i=count-2, t=k+1; i>=0; --i) {
+    while (k >= t && SH_HULL_CROSS(hull[k-2], hull[k-1], pts[i]) <= 0.0f) k--;
+    hull[k++] = pts[i];
+  }
+  
+  /* Last point repeats the first one */
+  k--;
+  if (k < 3) return 0;
+  
+  /* Move each corner along its bisector so that both
+     adjacent edges move out by the padding. Sharp corners
+     are limited, which keeps the edges outside anyway. */
+  first = hull[0];
+  prev = hull[k-1];
+  for (i=0; i<k; ++i) {
+    next = (i+1 < k ? hull[i+1] : first);
+    SET2(e1, hull[i].x - prev.x, hull[i].y - prev.y);
+    SET2(e2, next.x - hull[i].x, next.y - hull[i].y);
+    norm = NORM2(e1); if (norm == 0.0f) return 0;
+    SET2(n1, e1.y / norm, -e1.x / norm);
+    norm = NORM2(e2); if (norm == 0.0f) return 0;
+    SET2(n2, e2.y / norm, -e2.x / norm);
+    
+    d = 1.0f + DOT2(n1, n2);
+    d = SH_COVER_PADDING / SH_MAX(d, 0.5f);
+    
+    /* Keep the unpadded corner for the next edge */
+    prev = hull[i];
+    hull[i].x += (n1.x + n2.x) * d;
+    hull[i].y += (n1.y + n2.y) * d;
+  }
+  
+  return k;
+}
+
+static SHfloat shHullArea(SHVector2 *hull, SHint count)
+{
+  SHfloat area = 0.0f;
+  SHint i;
+  
+  for (i=0; i<count; ++i) {
+    SHVector2 *a = &hull[i];
+    SHVector2 *b = &hull[(i+1) % count];
+    area += a->x * b->y - b->x * a->y;
+  }
+  
+  return area * 0.5f;
+}
+
+static void shPushCoverHull(SHVector2Array *a, SHVector2 *hull, SHint count)
+{
+  SHint i;
+  
+  for (i=1; i+1<count; ++i) {
+    shVector2ArrayPushBackP(a, &hull[0]);
+    shVector2ArrayPushBackP(a, &hull[i]);
+    shVector2ArrayPushBackP(a, &hull[i+1]);
+  }
+}
+
+/*--------------------------------------------------------
+ * Tries the convex hull as cover. Pushes it and returns
+ * true if its area is below [maxArea]. The sorted points
+ * and the hull are built in [scratch], kept by the path
+ * so that rebuilds reuse its storage.
+ *--------------------------------------------------------*/
+
+static int shTryCoverHull(SHVector2Array *a, SHVector2Array *scratch,
+                          const void *points, SHint stride, SHint count,
+                          SHfloat maxArea)
+{
+  SHVector2 *pts, *hull;
+  SHint size;
+  
+  if (count < 3 || count > SH_COVER_MAX_HULL_POINTS)
+    return 0;
+  
+  if (!shVector2ArrayReserve(scratch, 2 * count + 1))
+    return 0;
+  
+  pts = scratch->items;
+  hull = scratch->items + count;
+  
+  size = shPaddedHull(points, stride, count, pts, hull);
+  if (size < 3 || shHullArea(hull, size) >= maxArea)
+    return 0;
+  
+  shPushCoverHull(a, hull, size);
+  return 1;
+}
+
+/*--------------------------------------------------------
+ * Rebuilds the cover triangles of the path fill. Must be
+ * called after shFindBoundbox. Convex paths are painted
+ * without a cover and get none.
+ *--------------------------------------------------------*/
+
+void shBuildFillCover(SHPath *p)
+{
+  SHVector2 min, max;
+  SHfloat boxArea, boxesArea = 0.0f;
+  SHint start, i, contours = p->contours.size;
+  
+  shVector2ArrayClear(&p->fillCover);
+  if (p->vertices.size == 0 || p->convex) return;
+  
+  boxArea = shCoverBoxArea(&p->min, &p->max);
+  
+  if (contours > 1 && contours <= SH_COVER_MAX_BOXES) {
+    
+    /* Sum the areas of per-contour boxes */
+    for (i=0, start=0; i<contours; start += p->contours.items[i++]) {
+      shPointsBounds(&p->vertices.items[start], p->contours.items[i], &min, &max);
+      boxesArea += shCoverBoxArea(&min, &max);
+    }
+  }
+  
+  if (contours > 1 && contours <= SH_COVER_MAX_BOXES &&
+      boxesArea < boxArea * SH_COVER_MIN_GAIN) {
+    
+    /* Prefer the hull only if it beats the boxes too */
+    if (shTryCoverHull(&p->fillCover, &p->coverScratch,
+                       p->vertices.items, sizeof(SHVector2),
+                       p->vertices.size, boxesArea * SH_COVER_MIN_GAIN))
+      return;
+    
+    for (i=0, start=0; i<contours; start += p->contours.items[i++]) {
+      shPointsBounds(&p->vertices.items[start], p->contours.items[i], &min, &max);
+      shPushCoverBox(&p->fillCover, &min, &max);
+    }
+    return;
+  }
+  
+  if (shTryCoverHull(&p->fillCover, &p->coverScratch,
+                     p->vertices.items, sizeof(SHVector2),
+                     p->vertices.size, boxArea * SH_COVER_MIN_GAIN))
+    return;
+  
+  shPushCoverBox(&p->fillCover, &p->min, &p->max);
+}
+
+/*--------------------------------------------------------
+ * Rebuilds the cover triangles of the stroke from the
+ * stroke bounds found while stroking.
+ *--------------------------------------------------------*/
+
+void shBuildStrokeCover(SHPath *p)
+{
+  shVector2ArrayClear(&p->strokeCover);
+  if (p->stroke.size == 0)
+    return;
+  
+  if (shTryCoverHull(&p->strokeCover, &p->coverScratch,
+                     p->stroke.items, sizeof(SHVector2), p->stroke.size,
+                     shCoverBoxArea(&p->strokeMin, &p->strokeMax) *
+                     SH_COVER_MIN_GAIN))
+    return;
+  
+  shPushCoverBox(&p->strokeCover, &p->strokeMin, &p->strokeMax);
+}
+
+/*--------------------------------------------------------
+ * Appends a curve segment and grows the curve bounds by
+ * the given extent around each of its points.
+ *--------------------------------------------------------*/
+
+static void shPushCurveSegment(SHPath *p, SHCurveSegment *s,
+                               SHVector2 *pts, SHint count,
+                               SHfloat ex, SHfloat ey)
+{
+  SHint i;
+  
+  if (p->curves.size == 0 && p->curveLines == 0) {
+    SET2(p->curveMin, pts[0].x - ex, pts[0].y - ey);
+    SET2(p->curveMax, pts[0].x + ex, pts[0].y + ey);
+  }
+  
+  for (i=0; i<count; ++i) {
+    p->curveMin.x = SH_MIN(p->curveMin.x, pts[i].x - ex);
+    p->curveMin.y = SH_MIN(p->curveMin.y, pts[i].y - ey);
+    p->curveMax.x = SH_MAX(p->curveMax.x, pts[i].x + ex);
+    p->curveMax.y = SH_MAX(p->curveMax.y, pts[i].y + ey);
+  }
+  
+  shCurveSegmentArrayPushBackP(&p->curves, s);
+}
+
+/*--------------------------------------------------------
+ * Converts a normalized path segment into a curve segment.
+ * Lines are emitted in the first pass and curves in the
+ * second one, so that lines come first in the array.
+ * Every contour gets closed for the stencil fan.
+ *--------------------------------------------------------*/
+
+typedef struct
+{
+  SHint curvePass;
+  SHVector2 start;
+  SHVector2 pen;
+  
+} SHCurveBuildState;
+
+static void shPushCurveLine(SHPath *p, SHCurveBuildState *st,
+                            SHVector2 *a, SHVector2 *b)
+{
+  SHCurveSegment s;
+  SHVector2 pts[2];
+  
+  if (st->curvePass || (a->x == b->x && a->y == b->y)) return;
+  
+  /* Evenly spaced controls keep the second differences
+     at zero, so the vertex stage picks one triangle */
+  memset(&s, 0, sizeof(SHCurveSegment));
+  s.p0 = *a; s.p3 = *b;
+  SET2(s.p1, (2*a->x + b->x) / 3, (2*a->y + b->y) / 3);
+  SET2(s.p2, (a->x + 2*b->x) / 3, (a->y + 2*b->y) / 3);
+  s.type = SH_CURVE_CUBIC;
+  
+  pts[0] = *a; pts[1] = *b;
+  shPushCurveSegment(p, &s, pts, 2, 0.0f, 0.0f);
+  p->curveLines++;
+}
+
+static void shCurveSegmentFunc(SHPath *p, VGPathSegment segment,
+                               VGPathCommand originalCommand,
+                               SHfloat *data, void *userData)
+{
+  SHCurveBuildState *st = (SHCurveBuildState*)userData;
+  SHCurveSegment s;
+  SHVector2 pts[4];
+  SHfloat ex, ey;
+  
+  memset(&s, 0, sizeof(SHCurveSegment));
+  
+  switch (segment)
+  {
+  case VG_MOVE_TO:
+    
+    /* Close previous contour */
+    shPushCurveLine(p, st, &st->pen, &st->start);
+    SET2(st->start, data[2], data[3]);
+    st->pen = st->start;
+    return;
+    
+  case VG_CLOSE_PATH:
+  case VG_LINE_TO:
+    
+    SET2(pts[1], data[2], data[3]);
+    shPushCurveLine(p, st, &st->pen, &pts[1]);
+    st->pen = pts[1];
+    return;
+    
+  case VG_QUAD_TO:
+    
+    /* Degree elevation is exact */
+    SET2(pts[0], data[0], data[1]);
+    SET2(pts[3], data[4], data[5]);
+    SET2(pts[1], (data[0] + 2*data[2]) / 3, (data[1] + 2*data[3]) / 3);
+    SET2(pts[2], (data[4] + 2*data[2]) / 3, (data[5] + 2*data[3]) / 3);
+    st->pen = pts[3];
+    if (!st->curvePass) return;
+    
+    s.p0 = pts[0]; s.p1 = pts[1];
+    s.p2 = pts[2]; s.p3 = pts[3];
+    s.type = SH_CURVE_CUBIC;
+    shPushCurveSegment(p, &s, pts, 4, 0.0f, 0.0f);
+    return;
+    
+  case VG_CUBIC_TO:
+    
+    SET2(pts[0], data[0], data[1]);
+    SET2(pts[1], data[2], data[3]);
+    SET2(pts[2], data[4], data[5]);
+    SET2(pts[3], data[6], data[7]);
+    st->pen = pts[3];
+    if (!st->curvePass) return;
+    
+    s.p0 = pts[0]; s.p1 = pts[1];
+    s.p2 = pts[2]; s.p3 = pts[3];
+    s.type = SH_CURVE_CUBIC;
+    shPushCurveSegment(p, &s, pts, 4, 0.0f, 0.0f);
+    return;
+    
+  default:
+    
+    SH_ASSERT(segment==VG_SCWARC_TO || segment==VG_SCCWARC_TO ||
+              segment==VG_LCWARC_TO || segment==VG_LCCWARC_TO);
+    
+    SET2(pts[0], data[0], data[1]);
+    SET2(pts[1], data[10], data[11]);
+    st->pen = pts[1];
+    if (!st->curvePass) return;
+    
+    /* Whole ellipse bounds the arc */
+    s.p0 = pts[0]; s.p3 = pts[1];
+    SET2(s.p1, data[2], data[3]);
+    SET2(s.p2, data[4], data[5]);
+    SET2(s.axis, data[6], data[7]);
+    s.a1 = data[8]; s.a2 = data[9];
+    s.type = SH_CURVE_ARC;
+    ex = SH_ABS(data[4]) + SH_ABS(data[6]);
+    ey = SH_ABS(data[5]) + SH_ABS(data[7]);
+    shPushCurveSegment(p, &s, &s.p1, 1, ex, ey);
+    return;
+  }
+}
+
+/*--------------------------------------------------------
+ * Rebuilds the curve segments, their bounds and cover
+ * from the path data.
+ *--------------------------------------------------------*/
+
+void shBuildCurves(SHPath *p)
+{
+  SHCurveBuildState st;
+  SHint processFlags =
+    SH_PROCESS_SIMPLIFY_LINES |
+    SH_PROCESS_SIMPLIFY_CURVES |
+    SH_PROCESS_CENTRALIZE_ARCS |
+    SH_PROCESS_REPAIR_ENDS;
+  
+  shCurveSegmentArrayClear(&p->curves);
+  shVector2ArrayClear(&p->curveCover);
+  p->curveLines = 0;
+  SET2(p->curveMin, 0,0);
+  SET2(p->curveMax, 0,0);
+  
+  for (st.curvePass = 0; st.curvePass < 2; ++st.curvePass) {
+    SET2(st.start, 0,0);
+    SET2(st.pen, 0,0);
+    shProcessPathData(p, processFlags, shCurveSegmentFunc, &st);
+    shPushCurveLine(p, &st, &st.pen, &st.start);
+  }
+  
+  if (p->curves.size > 0)
+    shPushCoverBox(&p->curveCover, &p->curveMin, &p->curveMax);
+}
+
+/*--------------------------------------------------------
+ * Pushes the stencil triangles of one conic piece from
+ * [a] to [b] with control [ctrl]: a fan triangle from the
+ * pivot to the chord, which never gets discarded, and the
+ * hull triangle the fragment stage trims to the curve.
+ *--------------------------------------------------------*/
+
+static void shPushImplicitVertex(SHPath *p, SHVector2 *point,
+                                 SHfloat u, SHfloat v, SHfloat w)
+{
+  SHImplicitVertex iv;
+  iv.point = *point;
+  SET2(iv.coord, u, v);
+  iv.weight = w;
+  shImplicitVertexArrayPushBackP(&p->implicit, &iv);
+}
+
+static void shPushImplicitConic(SHPath *p, SHVector2 *pivot, SHVector2 *a,
+                                SHVector2 *ctrl, SHVector2 *b, SHfloat w)
+{
+  shPushImplicitVertex(p, pivot, 0.0f, 0.5f, 1.0f);
+  shPushImplicitVertex(p, a,     0.0f, 0.5f, 1.0f);
+  shPushImplicitVertex(p, b,     0.0f, 0.5f, 1.0f);
+  
+  if (ctrl == NULL) return;
+  shPushImplicitVertex(p, a,    0.0f, 0.0f, w);
+  shPushImplicitVertex(p, ctrl, 1.0f, 0.0f, w);
+  shPushImplicitVertex(p, b,    0.0f, 1.0f, w);
+}
+
+static void shCubicPoint(SHCurveSegment *s, SHfloat t, SHVector2 *out)
+{
+  SHfloat u = 1.0f - t;
+  SHfloat b0 = u*u*u, b1 = 3*u*u*t, b2 = 3*u*t*t, b3 = t*t*t;
+  SET2((*out), b0*s->p0.x + b1*s->p1.x + b2*s->p2.x + b3*s->p3.x,
+               b0*s->p0.y + b1*s->p1.y + b2*s->p2.y + b3*s->p3.y);
+}
+
+static void shCubicDerivative(SHCurveSegment *s, SHfloat t, SHVector2 *out)
+{
+  SHfloat u = 1.0f - t;
+  SHfloat b0 = 3*u*u, b1 = 6*u*t, b2 = 3*t*t;
+  SET2((*out), b0*(s->p1.x - s->p0.x) + b1*(s->p2.x - s->p1.x) + b2*(s->p3.x - s->p2.x),
+               b0*(s->p1.y - s->p0.y) + b1*(s->p2.y - s->p1.y) + b2*(s->p3.y - s->p2.y));
+}
+
+/*--------------------------------------------------------
+ * Splits a cubic into quadratics. The approximation error
+ * of a piece falls with the cube of its parameter span, so
+ * the count follows from the third difference and a
+ * tolerance relative to the size of the control polygon,
+ * which makes it independent of the scale it is drawn at.
+ *--------------------------------------------------------*/
+
+static void shPushImplicitCubic(SHPath *p, SHVector2 *pivot,
+                                SHCurveSegment *s)
+{
+  SHVector2 d3, a, b, da, db, ctrl, tmp;
+  SHfloat tol, t, h, n;
+  SHint i, count;
+  
+  SET2V(d3, s->p3); SUB2V(d3, s->p2); SUB2V(d3, s->p2); SUB2V(d3, s->p2);
+  ADD2V(d3, s->p1); ADD2V(d3, s->p1); ADD2V(d3, s->p1); SUB2V(d3, s->p0);
+  
+  SET2V(tmp, s->p1); SUB2V(tmp, s->p0); tol = NORM2(tmp);
+  SET2V(tmp, s->p2); SUB2V(tmp, s->p1); tol += NORM2(tmp);
+  SET2V(tmp, s->p3); SUB2V(tmp, s->p2); tol += NORM2(tmp);
+  tol *= SH_IMPLICIT_CUBIC_PRECISION;
+  
+  count = 1;
+  if (tol > 0.0f) {
+    n = (SHfloat)cbrt(0.0481125f * NORM2(d3) / tol); /* sqrt(3)/36 */
+    count = (n > 1.0f ? (SHint)SH_CEIL(n) : 1);
+    count = SH_MIN(count, SH_MAX_IMPLICIT_QUADS);
+  }
+  
+  /* Each piece keeps its end points and tangents, the
+     quadratic control is then (q0+q3)/2 + h(B'(t0)-B'(t1))/4 */
+  h = 1.0f / count;
+  a = s->p0;
+  shCubicDerivative(s, 0.0f, &da);
+  
+  for (i=1; i<=count; ++i) {
+    t = i * h;
+    if (i == count) b = s->p3;
+    else shCubicPoint(s, t, &b);
+    shCubicDerivative(s, t, &db);
+    
+    SET2(ctrl, (a.x + b.x) / 2 + h * (da.x - db.x) / 4,
+               (a.y + b.y) / 2 + h * (da.y - db.y) / 4);
+    shPushImplicitConic(p, pivot, &a, &ctrl, &b, 1.0f);
+    
+    a = b; da = db;
+  }
+}
+
+/*--------------------------------------------------------
+ * Splits an elliptical arc into rational quadratics of at
+ * most a quarter turn each. Those are exact, their weight
+ * is the cosine of half the angle they span.
+ *--------------------------------------------------------*/
+
+static void shPushImplicitArc(SHPath *p, SHVector2 *pivot,
+                              SHCurveSegment *s)
+{
+  SHVector2 a, b, ctrl;
+  SHfloat span, step, w, am;
+  SHint i, count;
+  
+  span = s->a2 - s->a1;
+  count = (SHint)SH_CEIL((span < 0.0f ? -span : span) / (PI/2));
+  count = SH_MAX(count, 1);
+  step = span / count;
+  w = SH_COS(step / 2);
+  a = s->p0;
+  
+  for (i=1; i<=count; ++i) {
+    if (i == count) b = s->p3;
+    else SET2(b, s->p1.x + s->p2.x * SH_COS(s->a1 + i*step)
+                         + s->axis.x * SH_SIN(s->a1 + i*step),
+                 s->p1.y + s->p2.y * SH_COS(s->a1 + i*step)
+                         + s->axis.y * SH_SIN(s->a1 + i*step));
+    
+    am = s->a1 + (i - 0.5f) * step;
+    SET2(ctrl, s->p1.x + (s->p2.x * SH_COS(am) + s->axis.x * SH_SIN(am)) / w,
+               s->p1.y + (s->p2.y * SH_COS(am) + s->axis.y * SH_SIN(am)) / w);
+    shPushImplicitConic(p, pivot, &a, &ctrl, &b, w);
+    
+    a = b;
+  }
+}
+
+/*--------------------------------------------------------
+ * Rebuilds the stencil triangles of the implicit curve
+ * fill from the curve segments.
+ *--------------------------------------------------------*/
+
+void shBuildImplicit(SHPath *p)
+{
+  SHVector2 pivot;
+  SHCurveSegment *s;
+  SHint i;
+  
+  shImplicitVertexArrayClear(&p->implicit);
+  if (p->curves.size == 0) return;
+  
+  pivot = p->curves.items[0].p0;
+  
+  for (i=0; i<p->curves.size; ++i) {
+    s = &p->curves.items[i];
+    
+    if (i < p->curveLines)
+      shPushImplicitConic(p, &pivot, &s->p0, NULL, &s->p3, 1.0f);
+    else if (s->type == SH_CURVE_ARC)
+      shPushImplicitArc(p, &pivot, s);
+    else
+      shPushImplicitCubic(p, &pivot, s);
+  }
+}
+
+/*--------------------------------------------------------
+ * Rebuilds the polyline segments stroked on the GPU from
+ * the tessellation vertices. Repeated points are skipped,
+ * a contour without any length becomes a single capped
+ * segment of zero length, and the last segment of a closed
+ * contour joins the first one.
+ *--------------------------------------------------------*/
+
+void shBuildStrokeSegments(SHPath *p)
+{
+  SHVector2 *v = p->vertices.items;
+  SHuint8 *flags = p->vertexFlags.items;
+  SHVector2 *first, *second, *last;
+  SHStrokeSegment seg;
+  SHint c, i, start, end, count, closed;
+  
+  shStrokeSegmentArrayClear(&p->strokeSegments);
+  
+  for (c=0, start=0; c<p->contours.size; start=end, ++c) {
+    end = start + p->contours.items[c];
+    if (end - start <= 1) continue;
+    
+    closed = (flags[end-1] & SH_VERTEX_FLAG_CLOSE) &&
+      EQ2V(v[end-1], v[start]);
+    
+    first = last = &v[start];
+    second = NULL;
+    count = 0;
+    
+    for (i=start+1; i<end; ++i) {
+      if (EQ2V(v[i], (*last))) continue;
+      
+      /* Previous segment is joined to this one */
+      if (count > 0) {
+        seg.next = v[i];
+        shStrokeSegmentArrayPushBackP(&p->strokeSegments, &seg);
+      }else second = &v[i];
+      
+      seg.p0 = *last;
+      seg.p1 = v[i];
+      seg.startCap = (count == 0 && !closed) ? 1.0f : 0.0f;
+      seg.endCap = 0.0f;
+      last = &v[i];
+      ++count;
+    }
+    
+    if (count == 0) {
+      /* Zero length: caps around the single point */
+      seg.p0 = seg.p1 = seg.next = *first;
+      seg.startCap = seg.endCap = 1.0f;
+    }else if (closed) {
+      seg.next = *second;
+    }else{
+      seg.next = seg.p1;
+      seg.endCap = 1.0f;
+    }
+    
+    shStrokeSegmentArrayPushBackP(&p->strokeSegments, &seg);
+  }
+}
+
+/*-------------------------------------------------------------
+ * Transforms the tessellation vertices using the given matrix
+ *-------------------------------------------------------------*/
+
+void shTransformVertices(SHMatrix3x3 *m, SHPath *p)
+{
+  shTransformPoints(m, p->vertices.items, p->vertices.items,
+                    p->vertices.size);
+}
+
+/*--------------------------------------------------------
+ * Finds the tight bounding box of path's tesselation
+ * vertices. Depends on whether the path had been
+ * tesselated in user or surface space.
+ *--------------------------------------------------------*/
+
+void shFindBoundbox(SHPath *p)
+{
+  if (p->vertices.size == 0) {
+    SET2(p->min, 0,0);
+    SET2(p->max, 0,0);
+    return;
+  }
+  
+  shPointsBounds(p->vertices.items, p->vertices.size, &p->min, &p->max);
+}
+
+/*--------------------------------------------------------
+ * Outputs a tight bounding box of a path in path's own
+ * coordinate system.
  *--------------------------------------------------------*/
 
 VG_API_CALL void vgPathBounds(VGPath path,
@@ -868,8 +1886,11 @@ VG_API_CALL void vgPathBounds(VGPath path,
                    VG_PATH_CAPABILITY_ERROR, VG_NO_RETVAL);
 
   /* Update path geometry */
-  shFlattenPath(p, 0);
-  shFindBoundbox(p);
+  shFlushPendingPath(context, p);
+  shFlattenPath(p, shFlattenTolerance(context, 0));
+  
+  /* Geometry in use is no longer a cached level */
+  p->cacheLevelInit = VG_FALSE;
 
   /* Output bounds */
   *minX = p->min.x;
@@ -906,8 +1927,12 @@ VG_API_CALL void vgPathTransformedBounds(VGPath path,
   VG_RETURN_ERR_IF(!(p->caps & VG_PATH_CAPABILITY_PATH_BOUNDS),
                    VG_PATH_CAPABILITY_ERROR, VG_NO_RETVAL);
 
-  /* Update path geometry */
-  shFlattenPath(p, 1);
+  /* Update path geometry. Flattening in user space with
+     the tolerance scaled down by the transform is as fine
+     as flattening in surface space. */
+  shFlushPendingPath(context, p);
+  shFlattenPath(p, shFlattenTolerance(context, 0));
+  shTransformVertices(&context->pathTransform, p);
   shFindBoundbox(p);
 
   /* Output bounds */
@@ -917,21 +1942,288 @@ VG_API_CALL void vgPathTransformedBounds(VGPath path,
   *height = p->max.y - p->min.y;
 
   /* Invalidate subdivision for rendering */
-  p->cacheDataValid = VG_FALSE;
+  p->cacheLevelInit = VG_FALSE;
   
   VG_RETURN(VG_NO_RETVAL);
 }
 
+/*--------------------------------------------------------
+ * Builds the arc-length table of a path by flattening it
+ * in its own space into a separate point list, with the
+ * distance along the path up to each point. Each curve is
+ * flattened within a fraction of its own size, so the
+ * table depends on nothing but the path data. MOVE_TO jumps
+ * add no distance. Each segment records the point it
+ * starts from (its own for a MOVE_TO, else the pen) and
+ * the last point it reaches, so that a segment range maps
+ * to a point range and a distance into it to an edge.
+ *--------------------------------------------------------*/
+
+typedef struct
+{
+  SHPathCursor cursor;
+  double length;
+  
+} SHLengthBuildState;
+
+static SHfloat shLengthTolerance(VGPathSegment segment, SHfloat *data)
+{
+  SHVector2 pts[4], min, max;
+  SHfloat size;
+  SHint i, n;
+  
+  switch (segment) {
+  case VG_QUAD_TO: n = 3; break;
+  case VG_CUBIC_TO: n = 4; break;
+  case VG_SCWARC_TO: case VG_SCCWARC_TO:
+  case VG_LCWARC_TO: case VG_LCCWARC_TO: n = 0; break;
+  default: return 1.0f;
+  }
+  
+  if (n > 0) {
+    /* Extent of the control points */
+    for (i=0; i<n; ++i)
+      SET2(pts[i], data[2*i], data[2*i+1]);
+    shPointsBounds(pts, n, &min, &max);
+    size = SH_MAX(max.x - min.x, max.y - min.y);
+  }else{
+    /* Radius, as in shFlattenArc */
+    size = SH_SQRT(data[4]*data[4] + data[5]*data[5] +
+                   data[6]*data[6] + data[7]*data[7]);
+  }
+  
+  /* Degenerate curves need no inner points anyway */
+  return (size > 0.0f ? size * SH_LENGTH_TOLERANCE : 1.0f);
+}
+
+static void shLengthSegmentFunc(SHPath *p, VGPathSegment segment,
+                                VGPathCommand originalCommand,
+                                SHfloat *data, void *userData)
+{
+  SHLengthBuildState *st = (SHLengthBuildState*)userData;
+  SHVector2Array *pts = &p->lengthPoints;
+  SHint *seg = &p->lengthSegs.items[2 * st->cursor.seg];
+  SHint from = pts->size;
+  SHVector2 *a, *b;
+  SHint i;
+  
+  /* First point the segment starts from, and for now
+     the first one it adds */
+  if (seg[1] < 0) {
+    seg[0] = (segment == VG_MOVE_TO ? from : from - 1);
+    seg[1] = from;
+  }
+  
+  shFlattenSegment(pts, segment, data,
+                   shLengthTolerance(segment, data));
+  
+  for (i=from; i<pts->size; ++i) {
+    if (segment != VG_MOVE_TO) {
+      a = &pts->items[i-1]; b = &pts->items[i];
+      st->length += SH_SQRT((b->x - a->x) * (b->x - a->x) +
+                            (b->y - a->y) * (b->y - a->y));
+    }
+    if (!shFloatArrayPushBack(&p->lengths, (SHfloat)st->length)) {
+      pts->size = i;
+      return;
+    }
+  }
+}
+
+static void shBuildLengthTable(SHPath *p)
+{
+  SHLengthBuildState st;
+  SHint *seg, s, next, first;
+  SHint processFlags =
+    SH_PROCESS_SIMPLIFY_LINES |
+    SH_PROCESS_SIMPLIFY_CURVES |
+    SH_PROCESS_CENTRALIZE_ARCS |
+    SH_PROCESS_REPAIR_ENDS;
+  
+  shVector2ArrayClear(&p->lengthPoints);
+  shFloatArrayClear(&p->lengths);
+  shIntArrayClear(&p->lengthSegs);
+  
+  if (!shIntArrayReserve(&p->lengthSegs, 2 * p->segCount)) return;
+  for (s=0; s<2*p->segCount; ++s)
+    p->lengthSegs.items[s] = -1;
+  p->lengthSegs.size = 2 * p->segCount;
+  
+  shResetPathCursor(&st.cursor);
+  st.length = 0.0;
+  shProcessPathDataFrom(p, processFlags, &st.cursor,
+                        shLengthSegmentFunc, &st);
+  
+  /* Each segment ends where the next one starts adding
+     points. Ones that added none hold just the pen. */
+  next = p->lengthPoints.size;
+  for (s=p->segCount-1; s>=0; --s) {
+    seg = &p->lengthSegs.items[2*s];
+    if (seg[1] < 0) {
+      seg[0] = seg[1] = SH_MAX(next - 1, 0);
+    }else{
+      first = seg[1];
+      seg[1] = next - 1;
+      next = first;
+    }
+  }
+  
+  p->cacheLengthValid = VG_TRUE;
+}
+
+static int shIsFloatAligned(const VGfloat *f)
+{
+  return ((size_t)f % sizeof(VGfloat)) == 0;
+}
+
+static int shIsValidSegmentRange(SHPath *p, VGint startSegment,
+                                 VGint numSegments)
+{
+  return (startSegment >= 0 && numSegments > 0 &&
+          startSegment < p->segCount &&
+          numSegments <= p->segCount - startSegment);
+}
+
+/*--------------------------------------------------------
+ * Finds the first point in (first, last] whose distance
+ * along the path is at least (or, if [above], more than)
+ * [d], or last+1 if there is none
+ *--------------------------------------------------------*/
+
+static SHint shFindLengthPoint(SHPath *p, SHint first, SHint last,
+                               SHfloat d, SHint above)
+{
+  SHfloat *l = p->lengths.items;
+  SHint lo = first + 1, hi = last + 1, mid;
+  
+  while (lo < hi) {
+    mid = (lo + hi) / 2;
+    if (above ? l[mid] <= d : l[mid] < d) lo = mid + 1;
+    else hi = mid;
+  }
+  
+  return lo;
+}
+
 VG_API_CALL VGfloat vgPathLength(VGPath path,
                                  VGint startSegment, VGint numSegments)
 {
-  return 0.0f;
+  SHPath *p = NULL;
+  SHint first, last;
+  VG_GETCONTEXT(-1.0f);
+  
+  VG_RETURN_ERR_IF(!shIsValidPath(context, path),
+                   VG_BAD_HANDLE_ERROR, -1.0f);
+  
+  p = (SHPath*)path;
+  VG_RETURN_ERR_IF(!(p->caps & VG_PATH_CAPABILITY_PATH_LENGTH),
+                   VG_PATH_CAPABILITY_ERROR, -1.0f);
+  
+  VG_RETURN_ERR_IF(!shIsValidSegmentRange(p, startSegment, numSegments),
+                   VG_ILLEGAL_ARGUMENT_ERROR, -1.0f);
+  
+  if (!p->cacheLengthValid)
+    shBuildLengthTable(p);
+  if (p->lengthPoints.size == 0)
+    VG_RETURN(0.0f);
+  
+  first = p->lengthSegs.items[2 * startSegment];
+  last = p->lengthSegs.items[2 * (startSegment + numSegments - 1) + 1];
+  if (last <= first)
+    VG_RETURN(0.0f);
+  
+  VG_RETURN(p->lengths.items[last] - p->lengths.items[first]);
 }
 
+/*--------------------------------------------------------
+ * Outputs the point at the given distance along a range
+ * of path segments and the unit tangent there, found by
+ * binary search of the arc-length table. Distances are
+ * clamped to the range, the start of its first and the
+ * end of its last drawn edge. A distance that falls onto
+ * a MOVE_TO jump gets the point the jump comes from.
+ *--------------------------------------------------------*/
+
 VG_API_CALL void vgPointAlongPath(VGPath path,
                                   VGint startSegment, VGint numSegments,
                                   VGfloat distance,
                                   VGfloat * x, VGfloat * y,
                                   VGfloat * tangentX, VGfloat * tangentY)
 {
+  SHPath *p = NULL;
+  SHint first, last, i;
+  SHVector2 *a, *b, dir, point, tangent;
+  SHfloat d, t, len;
+  VGboolean getPoint, getTangent;
+  VG_GETCONTEXT(VG_NO_RETVAL);
+  
+  VG_RETURN_ERR_IF(!shIsValidPath(context, path),
+                   VG_BAD_HANDLE_ERROR, VG_NO_RETVAL);
+  
+  VG_RETURN_ERR_IF(!shIsFloatAligned(x) || !shIsFloatAligned(y) ||
+                   !shIsFloatAligned(tangentX) ||
+                   !shIsFloatAligned(tangentY),
+                   VG_ILLEGAL_ARGUMENT_ERROR, VG_NO_RETVAL);
+  
+  p = (SHPath*)path;
+  getPoint = (x != NULL && y != NULL);
+  getTangent = (tangentX != NULL && tangentY != NULL);
+  
+  VG_RETURN_ERR_IF(getPoint &&
+                   !(p->caps & VG_PATH_CAPABILITY_POINT_ALONG_PATH),
+                   VG_PATH_CAPABILITY_ERROR, VG_NO_RETVAL);
+  
+  VG_RETURN_ERR_IF(getTangent &&
+                   !(p->caps & VG_PATH_CAPABILITY_TANGENT_ALONG_PATH),
+                   VG_PATH_CAPABILITY_ERROR, VG_NO_RETVAL);
+  
+  VG_RETURN_ERR_IF(!shIsValidSegmentRange(p, startSegment, numSegments),
+                   VG_ILLEGAL_ARGUMENT_ERROR, VG_NO_RETVAL);
+  
+  if (!p->cacheLengthValid)
+    shBuildLengthTable(p);
+  SET2(point, 0,0);
+  SET2(tangent, 1,0);
+  
+  if (p->lengthPoints.size > 0) {
+    
+    first = p->lengthSegs.items[2 * startSegment];
+    last = p->lengthSegs.items[2 * (startSegment + numSegments - 1) + 1];
+    d = p->lengths.items[first] + SH_MAX(distance, 0.0f);
+    
+    if (distance <= 0.0f) {
+      /* Start of the first edge with any length */
+      i = shFindLengthPoint(p, first, last, p->lengths.items[first], 1);
+    }else i = shFindLengthPoint(p, first, last, d, 0);
+    
+    /* Past the end take the end of the last such edge */
+    if (i > last)
+      i = shFindLengthPoint(p, first, last, p->lengths.items[last], 0);
+    
+    /* No edge with any length keeps the default tangent */
+    len = 0.0f;
+    if (i <= last)
+      len = p->lengths.items[i] - p->lengths.items[i-1];
+    
+    if (len > 0.0f) {
+      a = &p->lengthPoints.items[i-1];
+      b = &p->lengthPoints.items[i];
+      t = (d - p->lengths.items[i-1]) / len;
+      SH_CLAMP(t, 0.0f, 1.0f);
+      SET2(point, a->x + (b->x - a->x) * t, a->y + (b->y - a->y) * t);
+      SET2(dir, b->x - a->x, b->y - a->y);
+      len = NORM2(dir);
+      if (len > 0.0f) SET2(tangent, dir.x / len, dir.y / len);
+    }else point = p->lengthPoints.items[first];
+  }
+  
+  if (getPoint) {
+    *x = point.x; *y = point.y;
+  }
+  
+  if (getTangent) {
+    *tangentX = tangent.x; *tangentY = tangent.y;
+  }
+  
+  VG_RETURN(VG_NO_RETVAL);
 }
@@ -25,9 +25,19 @@
 #include "shVectors.h"
 #include "shPath.h"
 
-void shFlattenPath(SHPath *p, SHint surfaceSpace);
-void shStrokePath(VGContext* c, SHPath *p);
+SHfloat shFlattenTolerance(VGContext *c, SHint surfaceSpace);
+void shFlattenPath(SHPath *p, SHfloat tol);
+void shReflattenPath(SHPath *p, SHint seg, SHfloat tol,
+                     SHint *vertex, SHint *contour);
+int shStrokePath(const SHStrokeStyle *s, SHfloat tol, SHPath *p);
+int shRestrokePath(const SHStrokeStyle *s, SHfloat tol, SHPath *p,
+                   SHint vertex, SHint contour);
 void shTransformVertices(SHMatrix3x3 *m, SHPath *p);
 void shFindBoundbox(SHPath *p);
+void shBuildFillCover(SHPath *p);
+void shBuildStrokeCover(SHPath *p);
+void shBuildCurves(SHPath *p);
+void shBuildImplicit(SHPath *p);
+void shBuildStrokeSegments(SHPath *p);
 
 #endif /* __SH_GEOMETRY_H */
@@ -467,15 +467,22 @@ void SHImage_ctor(SHImage *i)
   i->width = 0;
   i->height = 0;
   glGenTextures(1, &i->texture);
+  SH_INITOBJ(SHTextureState, i->texState);
 }
 
 void SHImage_dtor(SHImage *i)
 {
+  VGContext *c = shGetContext();
+  
   if (i->data != NULL)
     free(i->data);
   
-  if (glIsTexture(i->texture))
+  if (glIsTexture(i->texture)) {
+    if (c) shGLForgetTexture(&c->gl, i->texture);
     glDeleteTextures(1, &i->texture);
+  }
+  
+  SH_DEINITOBJ(SHTextureState, i->texState);
 }
 
 /*--------------------------------------------------------
@@ -514,7 +521,7 @@ void shUpdateImageTexture(SHImage *i, VGContext *c)
 {
   /* Store pixels to texture */
   glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-  glBindTexture(GL_TEXTURE_2D, i->texture);
+  shGLBindTexture(&c->gl, i->texture);
   glTexImage2D(GL_TEXTURE_2D, 0, i->fd.glintformat,
                i->texwidth, i->texheight, 0,
                i->fd.glformat, i->fd.gltype, i->data);
@@ -917,6 +924,8 @@ VG_API_CALL void vgSetPixels(VGint dx, VGint dy,
   SHImageFormatDesc winfd;
 
   VG_GETCONTEXT(VG_NO_RETVAL);
+  shFlushDrawCommands(context);
+  shGLStateRestoreDefaults(&context->gl);
   
   VG_RETURN_ERR_IF(!shIsValidImage(context, src),
                    VG_BAD_HANDLE_ERROR, VG_NO_RETVAL);
@@ -973,6 +982,8 @@ VG_API_CALL void vgWritePixels(const void * data, VGint dataStride,
   SHImageFormatDesc winfd;
 
   VG_GETCONTEXT(VG_NO_RETVAL);
+  shFlushDrawCommands(context);
+  shGLStateRestoreDefaults(&context->gl);
 
   /* Reject invalid formats */
   VG_RETURN_ERR_IF(!shIsValidImageFormat(dataFormat),
@@ -1034,6 +1045,7 @@ VG_API_CALL void vgGetPixels(VGImage dst, VGint dx, VGint dy,
   SHuint8 *pixels;
   SHImageFormatDesc winfd;
   VG_GETCONTEXT(VG_NO_RETVAL);
+  shFlushDrawCommands(context);
   
   VG_RETURN_ERR_IF(!shIsValidImage(context, dst),
                    VG_BAD_HANDLE_ERROR, VG_NO_RETVAL);
@@ -1084,6 +1096,7 @@ VG_API_CALL void vgReadPixels(void * data, VGint dataStride,
   SHuint8 *pixels;
   SHImageFormatDesc winfd;
   VG_GETCONTEXT(VG_NO_RETVAL);
+  shFlushDrawCommands(context);
 
   /* Reject invalid formats */
   VG_RETURN_ERR_IF(!shIsValidImageFormat(dataFormat),
@@ -1135,6 +1148,8 @@ VG_API_CALL void vgCopyPixels(VGint dx, VGint dy,
                               VGint width, VGint height)
 {
   VG_GETCONTEXT(VG_NO_RETVAL);
+  shFlushDrawCommands(context);
+  shGLStateRestoreDefaults(&context->gl);
   
   VG_RETURN_ERR_IF(width <= 0 || height <= 0,
                    VG_ILLEGAL_ARGUMENT_ERROR, VG_NO_RETVAL);
@@ -1218,19 +1233,20 @@ VG_API_CALL void vgLookupSingle(VGImage dst, VGImage src,
 VG_API_CALL void vgBindImageSH(VGImage image, VGImageUnitSH unit){
 
   VG_GETCONTEXT(VG_NO_RETVAL);
+  shFlushDrawCommands(context);
   SH_RETURN_ERR_IF(unit < VG_IMAGE_UNIT_OFFSET_SH, VG_ILLEGAL_ARGUMENT_ERROR, SH_NO_RETVAL);
   SH_RETURN_ERR_IF(image == VG_INVALID_HANDLE,     VG_ILLEGAL_ARGUMENT_ERROR, SH_NO_RETVAL);
   SHImage *i = (SHImage*)image;
   
-  glActiveTexture(GL_TEXTURE0 + unit);
+  shGLActiveTexture(&context->gl, GL_TEXTURE0 + unit);
 
-  glBindTexture(GL_TEXTURE_2D, i->texture);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  shGLBindTexture(&context->gl, i->texture);
+  shGLTexParameteri(&context->gl, &i->texState, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  shGLTexParameteri(&context->gl, &i->texState, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  shGLTexParameteri(&context->gl, &i->texState, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  shGLTexParameteri(&context->gl, &i->texState, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
 
-  glEnable(GL_TEXTURE_2D);
+  shGLEnable(&context->gl, GL_TEXTURE_2D);
   GL_CEHCK_ERROR;
 }
 
@@ -22,6 +22,7 @@
 #define __SHIMAGE_H
 
 #include "shDefs.h"
+#include "shGLState.h"
 
 /*-----------------------------------------------------------
  * ColorFormat holds the data necessary to pack/unpack color
@@ -82,6 +83,7 @@ typedef struct
   SHfloat texwidthK;
   SHfloat texheightK;
   GLuint texture;
+  SHTextureState texState;
   
 } SHImage;
 
@@ -0,0 +1,394 @@
+/*
+ * Copyright (c) 2007 Ivan Leben
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * 
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library in the file COPYING;
+ * if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include "openvg.h"
+#include "shKernels.h"
+
+#if defined(__AVX__)
+#  include <immintrin.h>
+#elif defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#  include <xmmintrin.h>
+#  define SH_KERNELS_SSE
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#  include <arm_neon.h>
+#  define SH_KERNELS_NEON
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#  include <emmintrin.h>
+#  define SH_KERNELS_SSE2
+#endif
+
+/*--------------------------------------------------------
+ * Applies the affine part of [m] to [count] points from
+ * [src] into [dst], which may be the same stream. Every
+ * kernel computes x*m00 + y*m01 + m02 in the same order
+ * as TRANSFORM2, so the results match the scalar code.
+ *--------------------------------------------------------*/
+
+void shTransformPoints(const SHMatrix3x3 *m, const SHVector2 *src,
+                       SHVector2 *dst, SHint count)
+{
+  SHint i = 0;
+  
+#if defined(__AVX__)
+  
+  /* Four interleaved points per register */
+  __m256 cx = _mm256_setr_ps(m->m[0][0], m->m[1][0], m->m[0][0], m->m[1][0],
+                             m->m[0][0], m->m[1][0], m->m[0][0], m->m[1][0]);
+  __m256 cy = _mm256_setr_ps(m->m[0][1], m->m[1][1], m->m[0][1], m->m[1][1],
+                             m->m[0][1], m->m[1][1], m->m[0][1], m->m[1][1]);
+  __m256 ct = _mm256_setr_ps(m->m[0][2], m->m[1][2], m->m[0][2], m->m[1][2],
+                             m->m[0][2], m->m[1][2], m->m[0][2], m->m[1][2]);
+  
+  for (; i+4 <= count; i+=4) {
+    __m256 v = _mm256_loadu_ps(&src[i].x);
+    __m256 x = _mm256_shuffle_ps(v, v, _MM_SHUFFLE(2,2,0,0));
+    __m256 y = _mm256_shuffle_ps(v, v, _MM_SHUFFLE(3,3,1,1));
+    v = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(x, cx),
+                                    _mm256_mul_ps(y, cy)), ct);
+    _mm256_storeu_ps(&dst[i].x, v);
+  }
+  
+#elif defined(SH_KERNELS_SSE)
+  
+  /* Two interleaved points per register */
+  __m128 cx = _mm_setr_ps(m->m[0][0], m->m[1][0], m->m[0][0], m->m[1][0]);
+  __m128 cy = _mm_setr_ps(m->m[0][1], m->m[1][1], m->m[0][1], m->m[1][1]);
+  __m128 ct = _mm_setr_ps(m->m[0][2], m->m[1][2], m->m[0][2], m->m[1][2]);
+  
+  for (; i+2 <= count; i+=2) {
+    __m128 v = _mm_loadu_ps(&src[i].x);
+    __m128 x = _mm_shuffle_ps(v, v, _MM_SHUFFLE(2,2,0,0));
+    __m128 y = _mm_shuffle_ps(v, v, _MM_SHUFFLE(3,3,1,1));
+    v = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, cx), _mm_mul_ps(y, cy)), ct);
+    _mm_storeu_ps(&dst[i].x, v);
+  }
+  
+#elif defined(SH_KERNELS_NEON)
+  
+  /* Four points per register pair, loaded deinterleaved */
+  for (; i+4 <= count; i+=4) {
+    float32x4x2_t v = vld2q_f32(&src[i].x);
+    float32x4x2_t o;
+    o.val[0] = vaddq_f32(vaddq_f32(vmulq_n_f32(v.val[0], m->m[0][0]),
+                                   vmulq_n_f32(v.val[1], m->m[0][1])),
+                         vdupq_n_f32(m->m[0][2]));
+    o.val[1] = vaddq_f32(vaddq_f32(vmulq_n_f32(v.val[0], m->m[1][0]),
+                                   vmulq_n_f32(v.val[1], m->m[1][1])),
+                         vdupq_n_f32(m->m[1][2]));
+    vst2q_f32(&dst[i].x, o);
+  }
+  
+#endif
+  
+  for (; i<count; ++i) {
+    SHVector2 v = src[i];
+    TRANSFORM2TO(v, (*m), dst[i]);
+  }
+}
+
+/*--------------------------------------------------------
+ * Finds the bounds of [count] points, which must be at
+ * least one.
+ *--------------------------------------------------------*/
+
+void shPointsBounds(const SHVector2 *pts, SHint count,
+                    SHVector2 *min, SHVector2 *max)
+{
+  SHint i = 0;
+  SHfloat b[4];
+  
+  SH_ASSERT(count > 0);
+  b[0] = b[2] = pts[0].x;
+  b[1] = b[3] = pts[0].y;
+  
+#if defined(__AVX__)
+  
+  if (count >= 4) {
+    __m256 lo = _mm256_loadu_ps(&pts[0].x), hi = lo;
+    __m128 l, h;
+    
+    for (i=4; i+4 <= count; i+=4) {
+      __m256 v = _mm256_loadu_ps(&pts[i].x);
+      lo = _mm256_min_ps(lo, v);
+      hi = _mm256_max_ps(hi, v);
+    }
+    
+    /* Fold lanes down to one (x,y) pair */
+    l = _mm_min_ps(_mm256_castps256_ps128(lo), _mm256_extractf128_ps(lo, 1));
+    h = _mm_max_ps(_mm256_castps256_ps128(hi), _mm256_extractf128_ps(hi, 1));
+    l = _mm_min_ps(l, _mm_movehl_ps(l, l));
+    h = _mm_max_ps(h, _mm_movehl_ps(h, h));
+    _mm_storel_pi((__m64*)&b[0], l);
+    _mm_storel_pi((__m64*)&b[2], h);
+  }
+  
+#elif defined(SH_KERNELS_SSE)
+  
+  if (count >= 2) {
+    __m128 lo = _mm_loadu_ps(&pts[0].x), hi = lo;
+    
+    for (i=2; i+2 <= count; i+=2) {
+      __m128 v = _mm_loadu_ps(&pts[i].x);
+      lo = _mm_min_ps(lo, v);
+      hi = _mm_max_ps(hi, v);
+    }
+    
+    lo = _mm_min_ps(lo, _mm_movehl_ps(lo, lo));
+    hi = _mm_max_ps(hi, _mm_movehl_ps(hi, hi));
+    _mm_storel_pi((__m64*)&b[0], lo);
+    _mm_storel_pi((__m64*)&b[2], hi);
+  }
+  
+#elif defined(SH_KERNELS_NEON)
+  
+  if (count >= 4) {
+    float32x4x2_t v = vld2q_f32(&pts[0].x);
+    float32x4_t lx = v.val[0], ly = v.val[1];
+    float32x4_t hx = v.val[0], hy = v.val[1];
+    float32x2_t r;
+    
+    for (i=4; i+4 <= count; i+=4) {
+      v = vld2q_f32(&pts[i].x);
+      lx = vminq_f32(lx, v.val[0]); ly = vminq_f32(ly, v.val[1]);
+      hx = vmaxq_f32(hx, v.val[0]); hy = vmaxq_f32(hy, v.val[1]);
+    }
+    
+    r = vpmin_f32(vget_low_f32(lx), vget_high_f32(lx));
+    b[0] = vget_lane_f32(vpmin_f32(r, r), 0);
+    r = vpmin_f32(vget_low_f32(ly), vget_high_f32(ly));
+    b[1] = vget_lane_f32(vpmin_f32(r, r), 0);
+    r = vpmax_f32(vget_low_f32(hx), vget_high_f32(hx));
+    b[2] = vget_lane_f32(vpmax_f32(r, r), 0);
+    r = vpmax_f32(vget_low_f32(hy), vget_high_f32(hy));
+    b[3] = vget_lane_f32(vpmax_f32(r, r), 0);
+  }
+  
+#endif
+  
+  for (; i<count; ++i) {
+    b[0] = SH_MIN(b[0], pts[i].x); b[1] = SH_MIN(b[1], pts[i].y);
+    b[2] = SH_MAX(b[2], pts[i].x); b[3] = SH_MAX(b[3], pts[i].y);
+  }
+  
+  SET2((*min), b[0], b[1]);
+  SET2((*max), b[2], b[3]);
+}
+
+/*--------------------------------------------------------
+ * Path coordinate decoding, one loop per datatype. The
+ * integer types are widened to 32 bits and converted in
+ * registers, then all of them compute v*scale + bias in
+ * the same order as the scalar tail, so the results do
+ * not depend on the kernel.
+ *--------------------------------------------------------*/
+
+#if defined(SH_KERNELS_SSE2)
+
+static void shStoreScaledSSE2(SHfloat *dst, __m128i v, __m128 s, __m128 b)
+{
+  _mm_storeu_ps(dst, _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(v), s), b));
+}
+
+#elif defined(SH_KERNELS_NEON)
+
+static void shStoreScaledNEON(SHfloat *dst, int32x4_t v, float32x4_t s, float32x4_t b)
+{
+  vst1q_f32(dst, vaddq_f32(vmulq_f32(vcvtq_f32_s32(v), s), b));
+}
+
+#endif
+
+static void shDecodeS8(const SHint8 *src, SHfloat *dst, SHint count,
+                       SHfloat scale, SHfloat bias)
+{
+  SHint i = 0;
+  
+#if defined(SH_KERNELS_SSE2)
+  
+  /* Sign-extend by unpacking into the high byte and
+     shifting back down */
+  __m128 s = _mm_set1_ps(scale), b = _mm_set1_ps(bias);
+  
+  for (; i+16 <= count; i+=16) {
+    __m128i v = _mm_loadu_si128((const __m128i*)&src[i]);
+    __m128i lo = _mm_unpacklo_epi8(v, v);
+    __m128i hi = _mm_unpackhi_epi8(v, v);
+    shStoreScaledSSE2(dst+i,    _mm_srai_epi32(_mm_unpacklo_epi16(lo, lo), 24), s, b);
+    shStoreScaledSSE2(dst+i+4,  _mm_srai_epi32(_mm_unpackhi_epi16(lo, lo), 24), s, b);
+    shStoreScaledSSE2(dst+i+8,  _mm_srai_epi32(_mm_unpacklo_epi16(hi, hi), 24), s, b);
+    shStoreScaledSSE2(dst+i+12, _mm_srai_epi32(_mm_unpackhi_epi16(hi, hi), 24), s, b);
+  }
+  
+#elif defined(SH_KERNELS_NEON)
+  
+  float32x4_t s = vdupq_n_f32(scale), b = vdupq_n_f32(bias);
+  
+  for (; i+8 <= count; i+=8) {
+    int16x8_t v = vmovl_s8(vld1_s8(&src[i]));
+    shStoreScaledNEON(dst+i,   vmovl_s16(vget_low_s16(v)), s, b);
+    shStoreScaledNEON(dst+i+4, vmovl_s16(vget_high_s16(v)), s, b);
+  }
+  
+#endif
+  
+  for (; i<count; ++i)
+    dst[i] = (SHfloat)src[i] * scale + bias;
+}
+
+static void shDecodeS16(const SHint16 *src, SHfloat *dst, SHint count,
+                        SHfloat scale, SHfloat bias)
+{
+  SHint i = 0;
+  
+#if defined(SH_KERNELS_SSE2)
+  
+  __m128 s = _mm_set1_ps(scale), b = _mm_set1_ps(bias);
+  
+  for (; i+8 <= count; i+=8) {
+    __m128i v = _mm_loadu_si128((const __m128i*)&src[i]);
+    shStoreScaledSSE2(dst+i,   _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16), s, b);
+    shStoreScaledSSE2(dst+i+4, _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16), s, b);
+  }
+  
+#elif defined(SH_KERNELS_NEON)
+  
+  float32x4_t s = vdupq_n_f32(scale), b = vdupq_n_f32(bias);
+  
+  for (; i+8 <= count; i+=8) {
+    int16x8_t v = vld1q_s16(&src[i]);
+    shStoreScaledNEON(dst+i,   vmovl_s16(vget_low_s16(v)), s, b);
+    shStoreScaledNEON(dst+i+4, vmovl_s16(vget_high_s16(v)), s, b);
+  }
+  
+#endif
+  
+  for (; i<count; ++i)
+    dst[i] = (SHfloat)src[i] * scale + bias;
+}
+
+static void shDecodeS32(const SHint32 *src, SHfloat *dst, SHint count,
+                        SHfloat scale, SHfloat bias)
+{
+  SHint i = 0;
+  
+#if defined(SH_KERNELS_SSE2)
+  
+  __m128 s = _mm_set1_ps(scale), b = _mm_set1_ps(bias);
+  
+  for (; i+4 <= count; i+=4)
+    shStoreScaledSSE2(dst+i, _mm_loadu_si128((const __m128i*)&src[i]), s, b);
+  
+#elif defined(SH_KERNELS_NEON)
+  
+  float32x4_t s = vdupq_n_f32(scale), b = vdupq_n_f32(bias);
+  
+  for (; i+4 <= count; i+=4)
+    shStoreScaledNEON(dst+i, vld1q_s32(&src[i]), s, b);
+  
+#endif
+  
+  for (; i<count; ++i)
+    dst[i] = (SHfloat)src[i] * scale + bias;
+}
+
+static void shDecodeF(const SHfloat32 *src, SHfloat *dst, SHint count,
+                      SHfloat scale, SHfloat bias)
+{
+  SHint i = 0;
+  
+#if defined(SH_KERNELS_SSE2)
+  
+  __m128 s = _mm_set1_ps(scale), b = _mm_set1_ps(bias);
+  
+  for (; i+4 <= count; i+=4)
+    _mm_storeu_ps(dst+i, _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(&src[i]), s), b));
+  
+#elif defined(SH_KERNELS_NEON)
+  
+  float32x4_t s = vdupq_n_f32(scale), b = vdupq_n_f32(bias);
+  
+  for (; i+4 <= count; i+=4)
+    vst1q_f32(dst+i, vaddq_f32(vmulq_f32(vld1q_f32(&src[i]), s), b));
+  
+#endif
+  
+  for (; i<count; ++i)
+    dst[i] = (SHfloat)src[i] * scale + bias;
+}
+
+/*--------------------------------------------------------
+ * Decodes [count] coordinates of the given datatype from
+ * index [first] of [data] into [dst], with scale and bias
+ * applied.
+ *--------------------------------------------------------*/
+
+void shDecodeCoords(VGPathDatatype type, SHfloat scale, SHfloat bias,
+                    const void *data, SHint first, SHfloat *dst, SHint count)
+{
+  switch (type) {
+  case VG_PATH_DATATYPE_S_8:
+    shDecodeS8((const SHint8*)data + first, dst, count, scale, bias); break;
+  case VG_PATH_DATATYPE_S_16:
+    shDecodeS16((const SHint16*)data + first, dst, count, scale, bias); break;
+  case VG_PATH_DATATYPE_S_32:
+    shDecodeS32((const SHint32*)data + first, dst, count, scale, bias); break;
+  default:
+    shDecodeF((const SHfloat32*)data + first, dst, count, scale, bias); break;
+  }
+}
+
+/*--------------------------------------------------------
+ * Interpolates [count] coordinates between [a] and [b]
+ * into [dst] as a + t*(b - a), in the same order as the
+ * scalar tail. [dst] may be [a] or [b].
+ *--------------------------------------------------------*/
+
+void shLerpCoords(const SHfloat *a, const SHfloat *b, SHfloat t,
+                  SHfloat *dst, SHint count)
+{
+  SHint i = 0;
+  
+#if defined(SH_KERNELS_SSE2)
+  
+  __m128 vt = _mm_set1_ps(t), va;
+  
+  for (; i+4 <= count; i+=4) {
+    va = _mm_loadu_ps(&a[i]);
+    _mm_storeu_ps(dst+i, _mm_add_ps(va, _mm_mul_ps(vt,
+                  _mm_sub_ps(_mm_loadu_ps(&b[i]), va))));
+  }
+  
+#elif defined(SH_KERNELS_NEON)
+  
+  float32x4_t vt = vdupq_n_f32(t), va;
+  
+  for (; i+4 <= count; i+=4) {
+    va = vld1q_f32(&a[i]);
+    vst1q_f32(dst+i, vaddq_f32(va, vmulq_f32(vt,
+              vsubq_f32(vld1q_f32(&b[i]), va))));
+  }
+  
+#endif
+  
+  for (; i<count; ++i)
+    dst[i] = a[i] + t * (b[i] - a[i]);
+}
@@ -0,0 +1,45 @@
+/*
+ * Copyright (c) 2007 Ivan Leben
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * 
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library in the file COPYING;
+ * if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef __SHKERNELS_H
+#define __SHKERNELS_H
+
+#include "shDefs.h"
+#include "shVectors.h"
+
+/* Kernels over packed point streams. Built with SSE, AVX or
+   NEON when the compiler targets them, plain C otherwise. */
+
+void shTransformPoints(const SHMatrix3x3 *m, const SHVector2 *src,
+                       SHVector2 *dst, SHint count);
+void shPointsBounds(const SHVector2 *pts, SHint count,
+                    SHVector2 *min, SHVector2 *max);
+
+/* Bulk decoding of raw path coordinates */
+
+void shDecodeCoords(VGPathDatatype type, SHfloat scale, SHfloat bias,
+                    const void *data, SHint first, SHfloat *dst, SHint count);
+
+/* Bulk interpolation of path coordinates */
+
+void shLerpCoords(const SHfloat *a, const SHfloat *b, SHfloat t,
+                  SHfloat *dst, SHint count);
+
+#endif /* __SHKERNELS_H */
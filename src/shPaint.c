@@ -38,6 +38,19 @@
 #include "shArrayBase.h"
 
 
+/*----------------------------------------------------
+ * Binds a ramp texture through the state tracker of
+ * the current context. The default paint is created
+ * by the context constructor once the tracker is set
+ * up, so a context is always current here.
+ *----------------------------------------------------*/
+
+static void shBindPaintTexture(GLuint texture)
+{
+  VGContext *c = shGetContext();
+  shGLBindTexture(&c->gl, texture);
+}
+
 void SHPaint_ctor(SHPaint *p)
 {
   int i;
@@ -54,8 +67,9 @@ void SHPaint_ctor(SHPaint *p)
   p->pattern = VG_INVALID_HANDLE;
   
   glGenTextures(1, &p->texture);
+  SH_INITOBJ(SHTextureState, p->texState);
   glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-  glBindTexture(GL_TEXTURE_2D, p->texture);
+  shBindPaintTexture(p->texture);
   glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, SH_GRADIENT_TEX_WIDTH, SH_GRADIENT_TEX_HEIGHT, 0,
                GL_RGBA, GL_FLOAT, NULL);
   GL_CEHCK_ERROR;
@@ -66,8 +80,13 @@ void SHPaint_dtor(SHPaint *p)
   SH_DEINITOBJ(SHStopArray, p->instops);
   SH_DEINITOBJ(SHStopArray, p->stops);
   
-  if (glIsTexture(p->texture))
+  if (glIsTexture(p->texture)) {
+    VGContext *c = shGetContext();
+    shGLForgetTexture(&c->gl, p->texture);
     glDeleteTextures(1, &p->texture);
+  }
+  
+  SH_DEINITOBJ(SHTextureState, p->texState);
 }
 
 VG_API_CALL VGPaint vgCreatePaint(void)
@@ -182,7 +201,7 @@ void shUpdateColorRampTexture(SHPaint *p)
   }
   
   /* Update texture image */
-  glBindTexture(GL_TEXTURE_2D, p->texture);
+  shBindPaintTexture(p->texture);
   glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
   
   for(int i = 0; i < SH_GRADIENT_TEX_HEIGHT ; i++)
@@ -350,152 +369,163 @@ void shGenerateStops(SHPaint *p, SHfloat minOffset, SHfloat maxOffset,
 
 void shSetGradientTexGLState(SHPaint *p)
 {
-  glBindTexture(GL_TEXTURE_2D, p->texture);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  SH_GETCONTEXT(SH_NO_RETVAL);
+  SHGLState *s = &context->gl;
+  
+  shGLBindTexture(s, p->texture);
+  shGLTexParameteri(s, &p->texState, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  shGLTexParameteri(s, &p->texState, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
   
   switch (p->spreadMode) {
   case VG_COLOR_RAMP_SPREAD_PAD:
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE); break;
+    shGLTexParameteri(s, &p->texState, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE); break;
   case VG_COLOR_RAMP_SPREAD_REPEAT:
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT); break;
+    shGLTexParameteri(s, &p->texState, GL_TEXTURE_WRAP_S, GL_REPEAT); break;
   case VG_COLOR_RAMP_SPREAD_REFLECT:
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_MIRRORED_REPEAT); break;
+    shGLTexParameteri(s, &p->texState, GL_TEXTURE_WRAP_S, GL_MIRRORED_REPEAT); break;
   }
 }
 
 void shSetPatternTexGLState(SHPaint *p, VGContext *c)
 {
-  glBindTexture(GL_TEXTURE_2D, ((SHImage*)p->pattern)->texture);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  SHImage *i = (SHImage*)p->pattern;
+  
+  shGLBindTexture(&c->gl, i->texture);
+  shGLTexParameteri(&c->gl, &i->texState, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  shGLTexParameteri(&c->gl, &i->texState, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
   
   switch(p->tilingMode) {
   case VG_TILE_FILL:
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+    shGLTexParameteri(&c->gl, &i->texState, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+    shGLTexParameteri(&c->gl, &i->texState, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
     glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR,
                      (GLfloat*)&c->tileFillColor);
     break;
   case VG_TILE_PAD:
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    shGLTexParameteri(&c->gl, &i->texState, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    shGLTexParameteri(&c->gl, &i->texState, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
     break;
   case VG_TILE_REPEAT:
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    shGLTexParameteri(&c->gl, &i->texState, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    shGLTexParameteri(&c->gl, &i->texState, GL_TEXTURE_WRAP_T, GL_REPEAT);
     break;
   case VG_TILE_REFLECT:
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_MIRRORED_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_MIRRORED_REPEAT);
+    shGLTexParameteri(&c->gl, &i->texState, GL_TEXTURE_WRAP_S, GL_MIRRORED_REPEAT);
+    shGLTexParameteri(&c->gl, &i->texState, GL_TEXTURE_WRAP_T, GL_MIRRORED_REPEAT);
     break;
   }
 }
 
-int shLoadLinearGradientMesh(SHPaint *p, VGPaintMode mode, VGMatrixMode matrixMode)
+/*----------------------------------------------------
+ * Stores the inverse of the paint-to-user matrix for
+ * the given paint mode into the draw record
+ *----------------------------------------------------*/
+
+static void shPaintInverseToRecord(VGContext *c, VGPaintMode mode, SHDrawRecord *r)
 {
   SHMatrix3x3 *m;
   SHMatrix3x3 mu2p;
-  GLfloat u2p[9];
-
+  SHfloat u2p[9];
+  int i;
+  
   /* Pick paint transform matrix */
-  SH_GETCONTEXT(0);
   if (mode == VG_FILL_PATH)
-    m = &context->fillTransform;
-  else if (mode == VG_STROKE_PATH)
-    m = &context->strokeTransform;
-
+    m = &c->fillTransform;
+  else m = &c->strokeTransform;
+  
   /* Back to paint space */
   shInvertMatrix(m, &mu2p);
-  shMatrixToVG(&mu2p, (SHfloat*)u2p);
+  shMatrixToVG(&mu2p, u2p);
+  
+  /* std140 pads mat3 columns to vec4 */
+  for (i=0; i<3; ++i) {
+    r->paintInverted[i*4+0] = u2p[i*3+0];
+    r->paintInverted[i*4+1] = u2p[i*3+1];
+    r->paintInverted[i*4+2] = u2p[i*3+2];
+    r->paintInverted[i*4+3] = 0.0f;
+  }
+}
 
-  /* Setup shader */
-  glUniform1i(context->locationDraw.paintType, VG_PAINT_TYPE_LINEAR_GRADIENT);
-  glUniform2fv(context->locationDraw.paintParams, 2, p->linearGradient);
-  glUniformMatrix3fv(context->locationDraw.paintInverted, 1, GL_FALSE, u2p);
-  glActiveTexture(GL_TEXTURE1);
+int shLoadLinearGradientMesh(SHPaint *p, VGPaintMode mode, VGMatrixMode matrixMode,
+                             SHDrawRecord *r)
+{
+  SH_GETCONTEXT(0);
+  
+  /* Setup draw record */
+  r->paintType = VG_PAINT_TYPE_LINEAR_GRADIENT;
+  r->paintParams[0] = p->linearGradient[0];
+  r->paintParams[1] = p->linearGradient[1];
+  r->paintParams[4] = p->linearGradient[2];
+  r->paintParams[5] = p->linearGradient[3];
+  shPaintInverseToRecord(context, mode, r);
+  
+  /* Setup ramp texture */
+  shGLActiveTexture(&context->gl, GL_TEXTURE1);
   shSetGradientTexGLState(p);
-  glEnable(GL_TEXTURE_2D);
-  glUniform1i(context->locationDraw.rampSampler, 1);
+  shGLEnable(&context->gl, GL_TEXTURE_2D);
+  shGLUniform1i(&context->gl, context->locationDraw.rampSampler,
+                &context->gl.uniforms.rampSampler, 1);
   GL_CEHCK_ERROR;
 
   return 1; 
 }
 
-int shLoadRadialGradientMesh(SHPaint *p, VGPaintMode mode, VGMatrixMode matrixMode)
+int shLoadRadialGradientMesh(SHPaint *p, VGPaintMode mode, VGMatrixMode matrixMode,
+                             SHDrawRecord *r)
 {
-  SHMatrix3x3 *m;
-  SHMatrix3x3 mu2p;
-  GLfloat u2p[9];
-
-  /* Pick paint transform matrix */
   SH_GETCONTEXT(0);
-  if (mode == VG_FILL_PATH)
-    m = &context->fillTransform;
-  else if (mode == VG_STROKE_PATH)
-    m = &context->strokeTransform;
-
-  /* Back to paint space */
-  shInvertMatrix(m, &mu2p);
-  shMatrixToVG(&mu2p, (SHfloat*)u2p);
-
-  /* Setup shader */
-  glUniform1i(context->locationDraw.paintType, VG_PAINT_TYPE_RADIAL_GRADIENT);
-  glUniform2fv(context->locationDraw.paintParams, 3, p->radialGradient);
-  glUniformMatrix3fv(context->locationDraw.paintInverted, 1, GL_FALSE, u2p);
-  glActiveTexture(GL_TEXTURE1);
+  
+  /* Setup draw record */
+  r->paintType = VG_PAINT_TYPE_RADIAL_GRADIENT;
+  r->paintParams[0] = p->radialGradient[0];
+  r->paintParams[1] = p->radialGradient[1];
+  r->paintParams[4] = p->radialGradient[2];
+  r->paintParams[5] = p->radialGradient[3];
+  r->paintParams[8] = p->radialGradient[4];
+  shPaintInverseToRecord(context, mode, r);
+  
+  /* Setup ramp texture */
+  shGLActiveTexture(&context->gl, GL_TEXTURE1);
   shSetGradientTexGLState(p);
-  glEnable(GL_TEXTURE_2D);
-  glUniform1i(context->locationDraw.rampSampler, 1);
+  shGLEnable(&context->gl, GL_TEXTURE_2D);
+  shGLUniform1i(&context->gl, context->locationDraw.rampSampler,
+                &context->gl.uniforms.rampSampler, 1);
   GL_CEHCK_ERROR;
 
   return 1; 
 }
 
-int shLoadPatternMesh(SHPaint *p, VGPaintMode mode, VGMatrixMode matrixMode)
+int shLoadPatternMesh(SHPaint *p, VGPaintMode mode, VGMatrixMode matrixMode,
+                      SHDrawRecord *r)
 {
   SHImage *i = (SHImage*)p->pattern;
-  SHMatrix3x3 *m;
-  SHMatrix3x3 mu2p;
-  GLfloat u2p[9];
-
-  /* Pick paint transform matrix */
   SH_GETCONTEXT(0);
-  if (mode == VG_FILL_PATH)
-    m = &context->fillTransform;
-  else if (mode == VG_STROKE_PATH)
-    m = &context->strokeTransform;
-
-  /* Back to paint space */
-  shInvertMatrix(m, &mu2p);
-  shMatrixToVG(&mu2p, (SHfloat*)u2p);
-
-  /* Setup shader */
-  glUniform1i(context->locationDraw.paintType, VG_PAINT_TYPE_PATTERN);
-  glUniform2f(context->locationDraw.paintParams, (GLfloat)i->width, (GLfloat)i->height);
-  glUniformMatrix3fv(context->locationDraw.paintInverted, 1, GL_FALSE, u2p);
-  glActiveTexture(GL_TEXTURE1);
+  
+  /* Setup draw record */
+  r->paintType = VG_PAINT_TYPE_PATTERN;
+  r->paintParams[0] = (GLfloat)i->width;
+  r->paintParams[1] = (GLfloat)i->height;
+  shPaintInverseToRecord(context, mode, r);
+  
+  /* Setup pattern texture */
+  shGLActiveTexture(&context->gl, GL_TEXTURE1);
   shSetPatternTexGLState(p, context);
-  glEnable(GL_TEXTURE_2D);
-  glUniform1i(context->locationDraw.patternSampler, 1);
+  shGLEnable(&context->gl, GL_TEXTURE_2D);
+  shGLUniform1i(&context->gl, context->locationDraw.patternSampler,
+                &context->gl.uniforms.patternSampler, 1);
   GL_CEHCK_ERROR;
 
   return 1; 
 }
 
-int shLoadOneColorMesh(SHPaint *p)
+int shLoadOneColorMesh(SHPaint *p, SHDrawRecord *r)
 {
-  static GLfloat id[9] = { 
-      1.0f, 0.0f, 0.0f,
-      0.0f, 1.0f, 0.0f,
-      0.0f, 0.0f, 1.0f };
-  SH_GETCONTEXT(0);
-
-  /* Setup shader */
-  glUniform1i(context->locationDraw.paintType, VG_PAINT_TYPE_COLOR);
-  glUniform4fv(context->locationDraw.paintColor, 1, (GLfloat*)&p->color);
-  glUniformMatrix3fv(context->locationDraw.paintInverted, 1, GL_FALSE, id);
+  /* Setup draw record */
+  r->paintType = VG_PAINT_TYPE_COLOR;
+  r->paintColor[0] = p->color.r;
+  r->paintColor[1] = p->color.g;
+  r->paintColor[2] = p->color.b;
+  r->paintColor[3] = p->color.a;
 
   return 1; 
 }
-
@@ -51,6 +51,7 @@ typedef struct
   SHfloat linearGradient[4];
   SHfloat radialGradient[5];
   GLuint texture;
+  SHTextureState texState;
   VGImage pattern;
   
 } SHPaint;
@@ -67,10 +68,13 @@ void SHPaint_dtor(SHPaint *p);
 void shValidateInputStops(SHPaint *p);
 void shSetGradientTexGLState(SHPaint *p);
 
-int shLoadLinearGradientMesh(SHPaint *p, VGPaintMode mode, VGMatrixMode matrixMode);
-int shLoadRadialGradientMesh(SHPaint *p, VGPaintMode mode, VGMatrixMode matrixMode);
-int shLoadPatternMesh(SHPaint *p, VGPaintMode mode, VGMatrixMode matrixMode);
-int shLoadOneColorMesh(SHPaint *p);
+int shLoadLinearGradientMesh(SHPaint *p, VGPaintMode mode, VGMatrixMode matrixMode,
+                             SHDrawRecord *r);
+int shLoadRadialGradientMesh(SHPaint *p, VGPaintMode mode, VGMatrixMode matrixMode,
+                             SHDrawRecord *r);
+int shLoadPatternMesh(SHPaint *p, VGPaintMode mode, VGMatrixMode matrixMode,
+                      SHDrawRecord *r);
+int shLoadOneColorMesh(SHPaint *p, SHDrawRecord *r);
   
 
 #endif /* __SHPAINT_H */
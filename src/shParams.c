@@ -106,6 +106,10 @@ int shIsEnumValid(SHint type, VGint val)
   case VG_STROKE_DASH_PHASE_RESET:
   case VG_SCISSORING:
   case VG_MASKING:
+  case VG_DEFERRED_DRAW_SH:
+  case VG_GPU_CURVES_SH:
+  case VG_IMPLICIT_CURVES_SH:
+  case VG_GPU_STROKES_SH:
     return (val == VG_TRUE ||
             val == VG_FALSE);
     
@@ -121,6 +125,11 @@ int shIsEnumValid(SHint type, VGint val)
     return (val == VG_TRUE ||
             val == VG_FALSE);
     
+  case VG_GL_ERROR_MODE_SH:
+    return (val == VG_GL_ERROR_OFF_SH ||
+            val == VG_GL_ERROR_DEFERRED_SH ||
+            val == VG_GL_ERROR_STRICT_SH);
+    
   case VG_PAINT_TYPE:
     return (val == VG_PAINT_TYPE_COLOR ||
             val == VG_PAINT_TYPE_LINEAR_GRADIENT ||
@@ -230,6 +239,25 @@ static void shFloatToParam(SHfloat f, SHint count, void *output, SHint floats, S
     ((VGint*)output)[index] = (VGint)shValidInputFloat2Int(f);
 }
 
+/*---------------------------------------------------------
+ * Hashes the bits of the dash pattern so the stroke cache
+ * can reject other patterns without comparing them.
+ *---------------------------------------------------------*/
+
+static SHuint shHashDashPattern(SHFloatArray *a)
+{
+  union { SHfloat f; SHuint u; } bits;
+  SHuint h = 2166136261u;
+  SHint i;
+  
+  for (i=0; i<a->size; ++i) {
+    bits.f = a->items[i];
+    h = (h ^ bits.u) * 16777619u;
+  }
+  
+  return h;
+}
+
 /*---------------------------------------------------------
  * Sets a parameter by interpreting the input value vector
  * according to the parameter type and input type.
@@ -342,6 +370,41 @@ static void shSet(VGContext *context, VGParamType type, SHint count,
     context->scissoring = bvalue;
     break;
     
+  case VG_DEFERRED_DRAW_SH:
+    SH_RETURN_ERR_IF(count!=1, VG_ILLEGAL_ARGUMENT_ERROR, SH_NO_RETVAL);
+    if (bvalue == VG_FALSE) shFlushDrawCommands(context);
+    context->deferredDraw = bvalue;
+    break;
+    
+  case VG_GPU_CURVES_SH:
+    SH_RETURN_ERR_IF(count!=1, VG_ILLEGAL_ARGUMENT_ERROR, SH_NO_RETVAL);
+    context->gpuCurves = bvalue;
+    break;
+    
+  case VG_IMPLICIT_CURVES_SH:
+    SH_RETURN_ERR_IF(count!=1, VG_ILLEGAL_ARGUMENT_ERROR, SH_NO_RETVAL);
+    context->implicitCurves = bvalue;
+    break;
+    
+  case VG_GPU_STROKES_SH:
+    SH_RETURN_ERR_IF(count!=1, VG_ILLEGAL_ARGUMENT_ERROR, SH_NO_RETVAL);
+    context->gpuStrokes = bvalue;
+    break;
+    
+  case VG_WORKER_THREADS_SH:
+    SH_RETURN_ERR_IF(count!=1, VG_ILLEGAL_ARGUMENT_ERROR, SH_NO_RETVAL);
+    SH_RETURN_ERR_IF(ivalue < 0, VG_ILLEGAL_ARGUMENT_ERROR, SH_NO_RETVAL);
+    shFlushDrawCommands(context);
+    context->workerThreads = SH_MIN(ivalue, SH_MAX_WORKER_THREADS);
+    shResizeWorkerPool(&context->workers, context->workerThreads);
+    break;
+    
+  case VG_GL_ERROR_MODE_SH:
+    SH_RETURN_ERR_IF(count!=1, VG_ILLEGAL_ARGUMENT_ERROR, SH_NO_RETVAL);
+    SH_RETURN_ERR_IF(!shIsEnumValid(type,ivalue), VG_ILLEGAL_ARGUMENT_ERROR, SH_NO_RETVAL);
+    shSetGLErrorMode(context, (VGGLErrorModeSH)ivalue);
+    break;
+    
   case VG_STROKE_LINE_WIDTH:
     SH_RETURN_ERR_IF(count!=1, VG_ILLEGAL_ARGUMENT_ERROR, SH_NO_RETVAL);
     context->strokeLineWidth = fvalue;
@@ -364,6 +427,7 @@ static void shSet(VGContext *context, VGParamType type, SHint count,
     for (i=0; i<count; ++i)
       shFloatArrayPushBack(&context->strokeDashPattern,
                            shParamToFloat(values, floats, i));
+    context->strokeDashHash = shHashDashPattern(&context->strokeDashPattern);
     break;
   case VG_TILE_FILL_COLOR:
     
@@ -411,6 +475,12 @@ static void shSet(VGContext *context, VGParamType type, SHint count,
   case VG_MAX_IMAGE_BYTES:
   case VG_MAX_FLOAT:
   case VG_MAX_GAUSSIAN_STD_DEVIATION:
+  case VG_GL_ERROR_COUNT_SH:
+  case VG_GL_LAST_ERROR_SH:
+  case VG_GL_STATE_CHANGES_SH:
+  case VG_GL_STATE_ELIDED_SH:
+  case VG_STROKES_DIRECT_SH:
+  case VG_STROKES_STENCILED_SH:
     /* Read-only */ break;
     
   default:
@@ -578,6 +648,66 @@ static void shGet(VGContext *context, VGParamType type, SHint count, void *value
     shIntToParam((SHint)context->scissoring, count, values, floats, 0);
     break;
     
+  case VG_DEFERRED_DRAW_SH:
+    SH_RETURN_ERR_IF(count != 1, VG_ILLEGAL_ARGUMENT_ERROR, SH_NO_RETVAL);
+    shIntToParam((SHint)context->deferredDraw, count, values, floats, 0);
+    break;
+    
+  case VG_GPU_CURVES_SH:
+    SH_RETURN_ERR_IF(count != 1, VG_ILLEGAL_ARGUMENT_ERROR, SH_NO_RETVAL);
+    shIntToParam((SHint)context->gpuCurves, count, values, floats, 0);
+    break;
+    
+  case VG_IMPLICIT_CURVES_SH:
+    SH_RETURN_ERR_IF(count != 1, VG_ILLEGAL_ARGUMENT_ERROR, SH_NO_RETVAL);
+    shIntToParam((SHint)context->implicitCurves, count, values, floats, 0);
+    break;
+    
+  case VG_GPU_STROKES_SH:
+    SH_RETURN_ERR_IF(count != 1, VG_ILLEGAL_ARGUMENT_ERROR, SH_NO_RETVAL);
+    shIntToParam((SHint)context->gpuStrokes, count, values, floats, 0);
+    break;
+    
+  case VG_WORKER_THREADS_SH:
+    SH_RETURN_ERR_IF(count != 1, VG_ILLEGAL_ARGUMENT_ERROR, SH_NO_RETVAL);
+    shIntToParam(context->workerThreads, count, values, floats, 0);
+    break;
+    
+  case VG_GL_ERROR_MODE_SH:
+    SH_RETURN_ERR_IF(count != 1, VG_ILLEGAL_ARGUMENT_ERROR, SH_NO_RETVAL);
+    shIntToParam((SHint)context->glErrorMode, count, values, floats, 0);
+    break;
+    
+  case VG_GL_ERROR_COUNT_SH:
+    SH_RETURN_ERR_IF(count != 1, VG_ILLEGAL_ARGUMENT_ERROR, SH_NO_RETVAL);
+    shIntToParam(context->glErrorCount, count, values, floats, 0);
+    break;
+    
+  case VG_GL_LAST_ERROR_SH:
+    SH_RETURN_ERR_IF(count != 1, VG_ILLEGAL_ARGUMENT_ERROR, SH_NO_RETVAL);
+    shIntToParam((SHint)context->glLastError, count, values, floats, 0);
+    break;
+    
+  case VG_GL_STATE_CHANGES_SH:
+    SH_RETURN_ERR_IF(count != 1, VG_ILLEGAL_ARGUMENT_ERROR, SH_NO_RETVAL);
+    shIntToParam(context->gl.changes, count, values, floats, 0);
+    break;
+    
+  case VG_GL_STATE_ELIDED_SH:
+    SH_RETURN_ERR_IF(count != 1, VG_ILLEGAL_ARGUMENT_ERROR, SH_NO_RETVAL);
+    shIntToParam(context->gl.elided, count, values, floats, 0);
+    break;
+    
+  case VG_STROKES_DIRECT_SH:
+    SH_RETURN_ERR_IF(count != 1, VG_ILLEGAL_ARGUMENT_ERROR, SH_NO_RETVAL);
+    shIntToParam(context->strokesDirect, count, values, floats, 0);
+    break;
+    
+  case VG_STROKES_STENCILED_SH:
+    SH_RETURN_ERR_IF(count != 1, VG_ILLEGAL_ARGUMENT_ERROR, SH_NO_RETVAL);
+    shIntToParam(context->strokesStenciled, count, values, floats, 0);
+    break;
+    
   case VG_STROKE_LINE_WIDTH:
     SH_RETURN_ERR_IF(count != 1, VG_ILLEGAL_ARGUMENT_ERROR, SH_NO_RETVAL);
     shFloatToParam(context->strokeLineWidth, count, values, floats, 0);
@@ -793,6 +923,18 @@ VG_API_CALL VGint vgGetVectorSize(VGParamType type)
   case VG_STROKE_DASH_PHASE_RESET:
   case VG_MASKING:
   case VG_SCISSORING:
+  case VG_DEFERRED_DRAW_SH:
+  case VG_GPU_CURVES_SH:
+  case VG_IMPLICIT_CURVES_SH:
+  case VG_GPU_STROKES_SH:
+  case VG_WORKER_THREADS_SH:
+  case VG_GL_ERROR_MODE_SH:
+  case VG_GL_ERROR_COUNT_SH:
+  case VG_GL_LAST_ERROR_SH:
+  case VG_GL_STATE_CHANGES_SH:
+  case VG_GL_STATE_ELIDED_SH:
+  case VG_STROKES_DIRECT_SH:
+  case VG_STROKES_STENCILED_SH:
   case VG_STROKE_LINE_WIDTH:
   case VG_STROKE_MITER_LIMIT:
   case VG_STROKE_DASH_PHASE:
@@ -22,16 +22,45 @@
 #include "openvg.h"
 #include "shContext.h"
 #include "shPath.h"
+#include "shKernels.h"
 #include <string.h>
 #include <stdio.h>
 
-#define _ITEM_T SHVertex
-#define _ARRAY_T SHVertexArray
-#define _FUNC_T shVertexArray
+#define _ITEM_T SHCurveSegment
+#define _ARRAY_T SHCurveSegmentArray
+#define _FUNC_T shCurveSegmentArray
+#define _COMPARE_T(s1,s2) 0
+#define _ARRAY_DEFINE
+#include "shArrayBase.h"
+
+#define _ITEM_T SHImplicitVertex
+#define _ARRAY_T SHImplicitVertexArray
+#define _FUNC_T shImplicitVertexArray
 #define _COMPARE_T(v1,v2) 0
 #define _ARRAY_DEFINE
 #include "shArrayBase.h"
 
+#define _ITEM_T SHStrokeSegment
+#define _ARRAY_T SHStrokeSegmentArray
+#define _FUNC_T shStrokeSegmentArray
+#define _COMPARE_T(v1,v2) 0
+#define _ARRAY_DEFINE
+#include "shArrayBase.h"
+
+#define _ITEM_T SHTessContour
+#define _ARRAY_T SHTessContourArray
+#define _FUNC_T shTessContourArray
+#define _COMPARE_T(c1,c2) 0
+#define _ARRAY_DEFINE
+#include "shArrayBase.h"
+
+#define _ITEM_T SHStrokeCursor
+#define _ARRAY_T SHStrokeCursorArray
+#define _FUNC_T shStrokeCursorArray
+#define _COMPARE_T(c1,c2) 0
+#define _ARRAY_DEFINE
+#include "shArrayBase.h"
+
 #define _ITEM_T SHPath*
 #define _ARRAY_T SHPathArray
 #define _FUNC_T shPathArray
@@ -57,6 +86,7 @@ static const SHint shCoordsPerCommand[] = {
 
 #define SH_PATH_MAX_COORDS 6
 #define SH_PATH_MAX_COORDS_PROCESSED 12
+#define SH_PATH_DECODE_CHUNK 256
 
 static const SHint shBytesPerDatatype[] = {
   1, /* VG_PATH_DATATYPE_S_8 */
@@ -74,6 +104,8 @@ static const SHint shBytesPerDatatype[] = {
 void shClearSegCallbacks(SHPath *p);
 void SHPath_ctor(SHPath *p)
 {
+  SHint i;
+  
   p->format = 0;
   p->scale = 0.0f;
   p->bias = 0.0f;
@@ -84,9 +116,101 @@ void SHPath_ctor(SHPath *p)
   p->data = NULL;
   p->segCount = 0;
   p->dataCount = 0;
+  p->segCapacity = 0;
+  p->dataCapacity = 0;
+  p->cacheDirtySeg = VG_MAXINT;
   
-  SH_INITOBJ(SHVertexArray, p->vertices);
+  SH_INITOBJ(SHVector2Array, p->vertices);
+  SH_INITOBJ(SHUint8Array, p->vertexFlags);
+  SH_INITOBJ(SHIntArray, p->contours);
   SH_INITOBJ(SHVector2Array, p->stroke);
+  SH_INITOBJ(SHUint8Array, p->strokeIndices);
+  p->strokeIndexSize = 2;
+  p->strokeFailed = 0;
+  SH_INITOBJ(SHVector2Array, p->fillCover);
+  SH_INITOBJ(SHVector2Array, p->coverScratch);
+  SH_INITOBJ(SHVector2Array, p->strokeCover);
+  SH_INITOBJ(SHTessContourArray, p->tessContours);
+  SH_INITOBJ(SHStrokeCursorArray, p->strokeContours);
+  shResetPathCursor(&p->tessCursor);
+  p->convex = VG_FALSE;
+  SET2(p->strokeMin, 0,0);
+  SET2(p->strokeMax, 0,0);
+  
+  SH_INITOBJ(SHCurveSegmentArray, p->curves);
+  SH_INITOBJ(SHVector2Array, p->curveCover);
+  p->curveLines = 0;
+  SET2(p->curveMin, 0,0);
+  SET2(p->curveMax, 0,0);
+  p->cacheCurvesValid = VG_FALSE;
+  
+  SH_INITOBJ(SHImplicitVertexArray, p->implicit);
+  p->cacheImplicitValid = VG_FALSE;
+  
+  SH_INITOBJ(SHStrokeSegmentArray, p->strokeSegments);
+  p->strokeSegmentsGeneration = 0;
+  
+  SH_INITOBJ(SHVector2Array, p->lengthPoints);
+  SH_INITOBJ(SHFloatArray, p->lengths);
+  SH_INITOBJ(SHIntArray, p->lengthSegs);
+  p->cacheLengthValid = VG_FALSE;
+  
+  SH_INITOBJ(SHUint8Array, p->interpSegs);
+  SH_INITOBJ(SHFloatArray, p->interpData);
+  p->cacheInterpValid = VG_FALSE;
+  
+  for (i=0; i<SH_MAX_TESS_LEVELS; ++i) {
+    SH_INITOBJ(SHVector2Array, p->tessLevels[i].vertices);
+    SH_INITOBJ(SHUint8Array, p->tessLevels[i].vertexFlags);
+    SH_INITOBJ(SHIntArray, p->tessLevels[i].contours);
+    SH_INITOBJ(SHVector2Array, p->tessLevels[i].fillCover);
+    SH_INITOBJ(SHTessContourArray, p->tessLevels[i].tessContours);
+  }
+  p->tessLevelCount = 0;
+  p->tessStamp = 0;
+  p->cacheTessGeneration = 0;
+  p->cacheTolerance = 1.0f;
+  p->tessGenerationCount = 0;
+  
+  SH_INITOBJ(SHFloatArray, p->cacheStrokeDash);
+  for (i=0; i<SH_MAX_STROKE_ENTRIES; ++i) {
+    SH_INITOBJ(SHFloatArray, p->strokeEntries[i].dash);
+    SH_INITOBJ(SHVector2Array, p->strokeEntries[i].stroke);
+    SH_INITOBJ(SHUint8Array, p->strokeEntries[i].strokeIndices);
+    SH_INITOBJ(SHVector2Array, p->strokeEntries[i].strokeCover);
+    SH_INITOBJ(SHStrokeCursorArray, p->strokeEntries[i].strokeContours);
+  }
+  p->strokeEntryCount = 0;
+  p->strokeStamp = 0;
+  
+  p->pending = VG_FALSE;
+  p->pendingStroke = VG_FALSE;
+  SH_INITOBJ(SHFloatArray, p->pendingDash);
+  
+  /* GL buffers are created lazily on first draw */
+  p->vaoVertices = 0;
+  p->vboVertices = 0;
+  p->vboVerticesDirty = VG_TRUE;
+  p->vboVerticesRebuilds = 0;
+  
+  p->vaoStroke = 0;
+  p->vboStroke = 0;
+  p->eboStroke = 0;
+  p->vboStrokeDirty = VG_TRUE;
+  p->vboStrokeRebuilds = 0;
+  
+  p->vaoCurveLines = 0;
+  p->vaoCurves = 0;
+  p->vboCurves = 0;
+  p->vboCurvesDirty = VG_TRUE;
+  
+  p->vaoImplicit = 0;
+  p->vboImplicit = 0;
+  p->vboImplicitDirty = VG_TRUE;
+  
+  p->vaoStrokeSegments = 0;
+  p->vboStrokeSegments = 0;
+  p->vboStrokeSegmentsDirty = VG_TRUE;
 }
 
 /*-----------------------------------------------------
@@ -95,11 +219,62 @@ void SHPath_ctor(SHPath *p)
 
 void SHPath_dtor(SHPath *p)
 {
+  SHint i;
+  
   if (p->segs) free(p->segs);
   if (p->data) free(p->data);
   
-  SH_DEINITOBJ(SHVertexArray, p->vertices);
+  SH_DEINITOBJ(SHVector2Array, p->vertices);
+  SH_DEINITOBJ(SHUint8Array, p->vertexFlags);
+  SH_DEINITOBJ(SHIntArray, p->contours);
   SH_DEINITOBJ(SHVector2Array, p->stroke);
+  SH_DEINITOBJ(SHUint8Array, p->strokeIndices);
+  SH_DEINITOBJ(SHVector2Array, p->fillCover);
+  SH_DEINITOBJ(SHVector2Array, p->coverScratch);
+  SH_DEINITOBJ(SHVector2Array, p->strokeCover);
+  SH_DEINITOBJ(SHTessContourArray, p->tessContours);
+  SH_DEINITOBJ(SHStrokeCursorArray, p->strokeContours);
+  SH_DEINITOBJ(SHCurveSegmentArray, p->curves);
+  SH_DEINITOBJ(SHVector2Array, p->curveCover);
+  SH_DEINITOBJ(SHImplicitVertexArray, p->implicit);
+  SH_DEINITOBJ(SHStrokeSegmentArray, p->strokeSegments);
+  SH_DEINITOBJ(SHVector2Array, p->lengthPoints);
+  SH_DEINITOBJ(SHFloatArray, p->lengths);
+  SH_DEINITOBJ(SHIntArray, p->lengthSegs);
+  SH_DEINITOBJ(SHUint8Array, p->interpSegs);
+  SH_DEINITOBJ(SHFloatArray, p->interpData);
+  
+  for (i=0; i<SH_MAX_TESS_LEVELS; ++i) {
+    SH_DEINITOBJ(SHVector2Array, p->tessLevels[i].vertices);
+    SH_DEINITOBJ(SHUint8Array, p->tessLevels[i].vertexFlags);
+    SH_DEINITOBJ(SHIntArray, p->tessLevels[i].contours);
+    SH_DEINITOBJ(SHVector2Array, p->tessLevels[i].fillCover);
+    SH_DEINITOBJ(SHTessContourArray, p->tessLevels[i].tessContours);
+  }
+  
+  SH_DEINITOBJ(SHFloatArray, p->cacheStrokeDash);
+  for (i=0; i<SH_MAX_STROKE_ENTRIES; ++i) {
+    SH_DEINITOBJ(SHFloatArray, p->strokeEntries[i].dash);
+    SH_DEINITOBJ(SHVector2Array, p->strokeEntries[i].stroke);
+    SH_DEINITOBJ(SHUint8Array, p->strokeEntries[i].strokeIndices);
+    SH_DEINITOBJ(SHVector2Array, p->strokeEntries[i].strokeCover);
+    SH_DEINITOBJ(SHStrokeCursorArray, p->strokeEntries[i].strokeContours);
+  }
+  
+  SH_DEINITOBJ(SHFloatArray, p->pendingDash);
+  
+  if (p->vaoVertices) glDeleteVertexArrays(1, &p->vaoVertices);
+  if (p->vboVertices) glDeleteBuffers(1, &p->vboVertices);
+  if (p->vaoStroke) glDeleteVertexArrays(1, &p->vaoStroke);
+  if (p->vboStroke) glDeleteBuffers(1, &p->vboStroke);
+  if (p->eboStroke) glDeleteBuffers(1, &p->eboStroke);
+  if (p->vaoCurveLines) glDeleteVertexArrays(1, &p->vaoCurveLines);
+  if (p->vaoCurves) glDeleteVertexArrays(1, &p->vaoCurves);
+  if (p->vboCurves) glDeleteBuffers(1, &p->vboCurves);
+  if (p->vaoImplicit) glDeleteVertexArrays(1, &p->vaoImplicit);
+  if (p->vboImplicit) glDeleteBuffers(1, &p->vboImplicit);
+  if (p->vaoStrokeSegments) glDeleteVertexArrays(1, &p->vaoStrokeSegments);
+  if (p->vboStrokeSegments) glDeleteBuffers(1, &p->vboStrokeSegments);
 }
 
 /*-----------------------------------------------------
@@ -126,6 +301,76 @@ static SHint shIsArcSegment(SHint s)
           s == VG_LCWARC_TO || s == VG_LCCWARC_TO);
 }
 
+/*-------------------------------------------------
+ * Marks the path data changed from the given
+ * segment on. Geometry built from the segments
+ * before it can be kept.
+ *-------------------------------------------------*/
+
+static void shInvalidatePathFrom(SHPath *p, SHint seg)
+{
+  p->cacheDataValid = VG_FALSE;
+  p->cacheDirtySeg = SH_MIN(p->cacheDirtySeg, seg);
+  p->cacheLengthValid = VG_FALSE;
+  p->cacheInterpValid = VG_FALSE;
+}
+
+/*-------------------------------------------------
+ * Reallocates storage for segment and coordinate
+ * data of the specified path to the given capacity
+ * (in items). On failure the old storage is kept.
+ *-------------------------------------------------*/
+
+static int shSetPathCapacity(SHPath *p, SHint segCapacity,
+                             SHint dataCapacity)
+{
+  SHuint8 *newSegs = NULL;
+  void *newData = NULL;
+  
+  if (segCapacity != p->segCapacity) {
+    if (segCapacity > 0) {
+      newSegs = (SHuint8*)realloc(p->segs, segCapacity);
+      if (newSegs == NULL) return 0;
+    }else free(p->segs);
+    p->segs = newSegs;
+    p->segCapacity = segCapacity;
+  }
+  
+  if (dataCapacity != p->dataCapacity) {
+    if (dataCapacity > 0) {
+      newData = realloc(p->data, dataCapacity *
+                        shBytesPerDatatype[p->datatype]);
+      if (newData == NULL) return 0;
+    }else free(p->data);
+    p->data = newData;
+    p->dataCapacity = dataCapacity;
+  }
+  
+  return 1;
+}
+
+/*-------------------------------------------------
+ * Makes room for the given number of segments and
+ * coordinates past the end of the path data. The
+ * capacity grows geometrically so that appending
+ * a segment at a time takes amortized constant time
+ *-------------------------------------------------*/
+
+static int shReservePathData(SHPath *p, SHint newSegCount,
+                             SHint newDataCount)
+{
+  SHint segCapacity = p->segCapacity;
+  SHint dataCapacity = p->dataCapacity;
+  
+  if (p->segCount + newSegCount > segCapacity)
+    segCapacity = SH_MAX(p->segCount + newSegCount, 2 * segCapacity);
+  
+  if (p->dataCount + newDataCount > dataCapacity)
+    dataCapacity = SH_MAX(p->dataCount + newDataCount, 2 * dataCapacity);
+  
+  return shSetPathCapacity(p, segCapacity, dataCapacity);
+}
+
 /*-------------------------------------------------------
  * Allocates a path resource in the current context and
  * sets its capabilities.
@@ -163,10 +408,18 @@ VG_API_CALL VGPath vgCreatePath(VGint pathFormat,
   p->dataHint = coordCapacityHint;
   p->datatype = datatype;
   p->caps = capabilities & VG_PATH_CAPABILITY_ALL;
+  
+  /* Pre-size storage from the hints. They are only hints,
+     so failing to honor them is not an error */
+  shSetPathCapacity(p,
+    SH_MIN(SH_MAX(segmentCapacityHint, 0), SH_MAX_PATH_CAPACITY_HINT),
+    SH_MIN(SH_MAX(coordCapacityHint, 0), SH_MAX_PATH_CAPACITY_HINT));
 
   /* Init cache flags */
   p->cacheDataValid = VG_TRUE;
-  p->cacheTransformInit = VG_FALSE;
+  p->cacheLevelInit = VG_FALSE;
+  p->cacheLevel = 0;
+  p->cacheRenderingQuality = VG_RENDERING_QUALITY_BETTER;
   p->cacheStrokeInit = VG_FALSE;
   
   VG_RETURN((VGPath)p);
@@ -185,21 +438,16 @@ VG_API_CALL void vgClearPath(VGPath path, VGbitfield capabilities)
   VG_RETURN_ERR_IF(!shIsValidPath(context, path),
                    VG_BAD_HANDLE_ERROR, VG_NO_RETVAL);
   
-  /* Clear raw data */
+  /* Clear raw data, keeping its storage for new data */
   p = (SHPath*)path;
-  free(p->segs);
-  free(p->data);
-  p->segs = NULL;
-  p->data = NULL;
+  shFlushPendingPath(context, p);
+  
   p->segCount = 0;
   p->dataCount = 0;
 
-  /* Mark change */
-  p->cacheDataValid = VG_FALSE;
-  
-  /* Downsize arrays to save memory */
-  shVertexArrayRealloc(&p->vertices, 1);
-  shVector2ArrayRealloc(&p->stroke, 1);
+  /* Mark change. Geometry storage is kept too, so that
+     paths rebuilt every frame reuse it. */
+  shInvalidatePathFrom(p, 0);
   
   /* Re-set capabilities */
   p->caps = capabilities & VG_PATH_CAPABILITY_ALL;
@@ -221,6 +469,7 @@ VG_API_CALL void vgDestroyPath(VGPath path)
   VG_RETURN_ERR_IF(index == -1, VG_BAD_HANDLE_ERROR, VG_NO_RETVAL);
   
   /* Delete object and remove resource */
+  shFlushPendingPath(context, (SHPath*)path);
   SH_DELETEOBJ(SHPath, (SHPath*)path);
   shPathArrayRemoveAt(&context->paths, index);
   
@@ -279,27 +528,6 @@ static SHint shCoordCountForData(VGint segcount, const SHuint8 *segs)
   return count;
 }
 
-/*-------------------------------------------------------
- * Interpretes the path data array according to the
- * path data type and returns the value at given index
- * in final interpretation (including scale and bias)
- *-------------------------------------------------------*/
-
-static SHfloat shRealCoordFromData(VGPathDatatype type, SHfloat scale, SHfloat bias,
-                                   void *data, SHint index)
-{
-  switch (type) {
-  case VG_PATH_DATATYPE_S_8:
-    return ( (SHfloat) ((SHint8*)data)[index] ) * scale + bias;
-  case VG_PATH_DATATYPE_S_16:
-    return ( (SHfloat) ((SHint16*)data)[index] ) * scale + bias;
-  case VG_PATH_DATATYPE_S_32:
-    return ( (SHfloat) ((SHint32*)data)[index] ) * scale + bias;;
-  default:
-    return ( (SHfloat) ((SHfloat32*)data)[index] ) * scale + bias;
-  }
-}
-
 /*-------------------------------------------------------
  * Interpretes the path data array according to the
  * path data type and sets the value at given index
@@ -324,46 +552,15 @@ static void shRealCoordToData(VGPathDatatype type, SHfloat scale, SHfloat bias,
   }
 }
 
-/*-------------------------------------------------
- * Resizes storage for segment and coordinate data
- * of the specified path by given number of items
- *-------------------------------------------------*/
-
-static int shResizePathData(SHPath *p, SHint newSegCount, SHint newDataCount,
-                            SHuint8 **newSegs, SHuint8 **newData)
-{
-  SHint oldDataSize = 0;
-  SHint newDataSize = 0;
-  
-  /* Allocate memory for new segments */
-  (*newSegs) = (SHuint8*)malloc(p->segCount + newSegCount);
-  if ((*newSegs) == NULL) return 0;
-  
-  /* Allocate memory for new data */
-  oldDataSize = p->dataCount * shBytesPerDatatype[p->datatype];
-  newDataSize = newDataCount * shBytesPerDatatype[p->datatype];
-  (*newData) = (SHuint8*)malloc(oldDataSize + newDataSize);
-  if ((*newData) == NULL) {free(*newSegs); return 0;}
-  
-  /* Copy old segments */
-  memcpy(*newSegs, p->segs, p->segCount);
-  
-  /* Copy old data */
-  memcpy(*newData, p->data, oldDataSize);
-  
-  return 1;
-}
-
 /*-------------------------------------------------------------
  * Appends path data from source to destination path resource
  *-------------------------------------------------------------*/
 
 VG_API_CALL void vgAppendPath(VGPath dstPath, VGPath srcPath)
 {
-  int i;
+  int i, j, n;
+  SHfloat coords[SH_PATH_DECODE_CHUNK];
   SHPath *src, *dst;
-  SHuint8 *newSegs = NULL;
-  SHuint8 *newData = NULL;
   VG_GETCONTEXT(VG_NO_RETVAL);
   
   VG_RETURN_ERR_IF(!shIsValidPath(context, srcPath) ||
@@ -375,35 +572,72 @@ VG_API_CALL void vgAppendPath(VGPath dstPath, VGPath srcPath)
                    !(dst->caps & VG_PATH_CAPABILITY_APPEND_TO),
                    VG_PATH_CAPABILITY_ERROR, VG_NO_RETVAL);
   
-  /* Resize path storage */
-  shResizePathData(dst, src->segCount, src->dataCount, &newSegs, &newData);
-  VG_RETURN_ERR_IF(!newData, VG_OUT_OF_MEMORY_ERROR, VG_NO_RETVAL);
+  shFlushPendingPath(context, dst);
+  
+  /* Grow path storage (src may be dst) */
+  VG_RETURN_ERR_IF(!shReservePathData(dst, src->segCount, src->dataCount),
+                   VG_OUT_OF_MEMORY_ERROR, VG_NO_RETVAL);
   
   /* Copy new segments */
-  memcpy(newSegs+dst->segCount, src->segs, src->segCount);
+  memcpy(dst->segs+dst->segCount, src->segs, src->segCount);
   
-  /* Copy new coordinates */
-  for (i=0; i<src->dataCount; ++i) {
+  /* Copy new coordinates, decoded in runs */
+  for (i=0; i<src->dataCount; i+=n) {
     
-    SHfloat coord = shRealCoordFromData(src->datatype, src->scale,
-                                        src->bias, src->data, i);
+    n = SH_MIN(src->dataCount - i, SH_PATH_DECODE_CHUNK);
+    shDecodeCoords(src->datatype, src->scale, src->bias,
+                   src->data, i, coords, n);
     
-    shRealCoordToData(dst->datatype, dst->scale, dst->bias,
-                      newData, dst->dataCount+i, coord);
+    for (j=0; j<n; ++j)
+      shRealCoordToData(dst->datatype, dst->scale, dst->bias,
+                        dst->data, dst->dataCount+i+j, coords[j]);
   }
   
-  /* Free old arrays */
-  free(dst->segs);
-  free(dst->data);
+  /* Mark change past the old data */
+  shInvalidatePathFrom(dst, dst->segCount);
   
   /* Adjust new properties */
-  dst->segs = newSegs;
-  dst->data = newData;
   dst->segCount += src->segCount;
   dst->dataCount += src->dataCount;
+  
+  VG_RETURN(VG_NO_RETVAL);
+}
 
-  /* Mark change */
-  dst->cacheDataValid = VG_FALSE;
+/*-----------------------------------------------------
+ * Releases storage not used by the path data, and the
+ * geometry storage of an empty path
+ *-----------------------------------------------------*/
+
+VG_API_CALL void vgTrimPathSH(VGPath path)
+{
+  SHPath *p = NULL;
+  VG_GETCONTEXT(VG_NO_RETVAL);
+  
+  VG_RETURN_ERR_IF(!shIsValidPath(context, path),
+                   VG_BAD_HANDLE_ERROR, VG_NO_RETVAL);
+  
+  p = (SHPath*)path;
+  shFlushPendingPath(context, p);
+  
+  /* Shrinking should not fail, but keep the spare room if it does */
+  shSetPathCapacity(p, p->segCount, p->dataCount);
+  
+  /* Downsize arrays to save memory */
+  if (p->segCount == 0) {
+    shInvalidatePathFrom(p, 0);
+    shVector2ArrayRealloc(&p->vertices, 1);
+    shUint8ArrayRealloc(&p->vertexFlags, 1);
+    shIntArrayRealloc(&p->contours, 1);
+    shVector2ArrayRealloc(&p->stroke, 1);
+    shUint8ArrayRealloc(&p->strokeIndices, 1);
+    shTessContourArrayRealloc(&p->tessContours, 1);
+    shStrokeCursorArrayRealloc(&p->strokeContours, 1);
+    shVector2ArrayRealloc(&p->lengthPoints, 1);
+    shFloatArrayRealloc(&p->lengths, 1);
+    shIntArrayRealloc(&p->lengthSegs, 1);
+    shUint8ArrayRealloc(&p->interpSegs, 1);
+    shFloatArrayRealloc(&p->interpData, 1);
+  }
   
   VG_RETURN(VG_NO_RETVAL);
 }
@@ -421,8 +655,6 @@ VG_API_CALL void vgAppendPathData(VGPath dstPath, VGint newSegCount,
   SHint newDataCount = 0;
   SHint oldDataSize = 0;
   SHint newDataSize = 0;
-  SHuint8 *newSegs = NULL;
-  SHuint8 *newData = NULL;
   VG_GETCONTEXT(VG_NO_RETVAL);
   
   VG_RETURN_ERR_IF(!shIsValidPath(context, dstPath),
@@ -444,34 +676,30 @@ VG_API_CALL void vgAppendPathData(VGPath dstPath, VGint newSegCount,
   VG_RETURN_ERR_IF(newDataCount == -1, VG_ILLEGAL_ARGUMENT_ERROR,
                    VG_NO_RETVAL);
   
-  /* Resize path storage */
-  shResizePathData(dst, newSegCount, newDataCount, &newSegs, &newData);
-  VG_RETURN_ERR_IF(!newData, VG_OUT_OF_MEMORY_ERROR, VG_NO_RETVAL);
+  shFlushPendingPath(context, dst);
+  
+  /* Grow path storage */
+  VG_RETURN_ERR_IF(!shReservePathData(dst, newSegCount, newDataCount),
+                   VG_OUT_OF_MEMORY_ERROR, VG_NO_RETVAL);
   
   /* Copy new segments */
-  memcpy(newSegs+dst->segCount, segs, newSegCount);
+  memcpy(dst->segs+dst->segCount, segs, newSegCount);
   
   /* Copy new coordinates */
   if (dst->datatype == VG_PATH_DATATYPE_F) {
     for (i=0; i<newDataCount; ++i)
-      ((SHfloat32*)newData) [dst->dataCount+i] =
+      ((SHfloat32*)dst->data) [dst->dataCount+i] =
         shValidInputFloat( ((VGfloat*)data) [i] );
   }else{
-    memcpy(newData+oldDataSize, data, newDataSize);
+    memcpy((SHuint8*)dst->data+oldDataSize, data, newDataSize);
   }
   
-  /* Free old arrays */
-  free(dst->segs);
-  free(dst->data);
+  /* Mark change past the old data */
+  shInvalidatePathFrom(dst, dst->segCount);
   
   /* Adjust new properties */
-  dst->segs = newSegs;
-  dst->data = newData;
   dst->segCount += newSegCount;
   dst->dataCount += newDataCount;
-
-  /* Mark change */
-  dst->cacheDataValid = VG_FALSE;
   
   VG_RETURN(VG_NO_RETVAL);
 }
@@ -504,6 +732,8 @@ VG_API_CALL void vgModifyPathCoords(VGPath dstPath, VGint startIndex,
   
   /* TODO: check data array alignment */
   
+  shFlushPendingPath(context, p);
+  
   /* Find start of the coordinates to be changed */
   dataStartCount = shCoordCountForData(startIndex, p->segs);
   dataStartSize = dataStartCount * shBytesPerDatatype[p->datatype];
@@ -522,7 +752,7 @@ VG_API_CALL void vgModifyPathCoords(VGPath dstPath, VGint startIndex,
   }
 
   /* Mark change */
-  p->cacheDataValid = VG_FALSE;
+  shInvalidatePathFrom(p, startIndex);
   
   VG_RETURN(VG_NO_RETVAL);
 }
@@ -676,6 +906,35 @@ void shProcessPathData(SHPath *p,
                        int flags,
                        SegmentFunc callback,
                        void *userData)
+{
+  SHPathCursor cursor;
+  shResetPathCursor(&cursor);
+  shProcessPathDataFrom(p, flags, &cursor, callback, userData);
+}
+
+void shResetPathCursor(SHPathCursor *cursor)
+{
+  cursor->seg = 0;
+  cursor->coord = 0;
+  SET2(cursor->start, 0,0);
+  SET2(cursor->pen, 0,0);
+  SET2(cursor->tan, 0,0);
+  cursor->open = 0;
+}
+
+/*-------------------------------------------------------
+ * Processing resumed at a cursor goes on exactly as if
+ * it had never stopped. The cursor holds the state
+ * before the segment being processed while the callback
+ * runs, and where processing stopped on return: the end
+ * of data or a trailing MOVE_TO skipped for now.
+ *-------------------------------------------------------*/
+
+void shProcessPathDataFrom(SHPath *p,
+                           int flags,
+                           SHPathCursor *cursor,
+                           SegmentFunc callback,
+                           void *userData)
 {
   SHint i=0, s=0, d=0, c=0;
   SHuint command;
@@ -684,17 +943,27 @@ void shProcessPathData(SHPath *p,
   VGPathAbsRel absrel;
   SHint numcoords;
   SHfloat data[SH_PATH_MAX_COORDS_PROCESSED];
+  SHfloat coords[SH_PATH_DECODE_CHUNK]; /* decoded ahead */
+  SHint coordFirst = 0, coordEnd = 0;
   SHVector2 start; /* start of the current contour */
   SHVector2 pen; /* current pen position */
   SHVector2 tan; /* backward tangent for smoothing */
-  SHint open = 0; /* contour-open flag */
+  SHint open; /* contour-open flag */
   
-  /* Reset points */
-  SET2(start, 0,0);
-  SET2(pen, 0,0);
-  SET2(tan, 0,0);
+  /* Pick up state */
+  SET2V(start, cursor->start);
+  SET2V(pen, cursor->pen);
+  SET2V(tan, cursor->tan);
+  open = cursor->open;
   
-  for (s=0; s<p->segCount; ++s, d+=numcoords) {
+  for (s=cursor->seg, d=cursor->coord; s<p->segCount; ++s, d+=numcoords) {
+    
+    /* Save state before the segment */
+    cursor->seg = s; cursor->coord = d;
+    SET2V(cursor->start, start);
+    SET2V(cursor->pen, pen);
+    SET2V(cursor->tan, tan);
+    cursor->open = open;
     
     /* Extract command */
     command = (p->segs[s]);
@@ -734,10 +1003,17 @@ void shProcessPathData(SHPath *p,
     data[1] = pen.y;
     c = 2;
     
-    /* Unpack coordinates from path data */
+    /* Unpack coordinates from path data, decoding the
+       next run in bulk once the segment reaches past it */
+    if (d + numcoords > coordEnd) {
+      coordFirst = d;
+      coordEnd = SH_MIN(d + SH_PATH_DECODE_CHUNK, p->dataCount);
+      shDecodeCoords(p->datatype, p->scale, p->bias, p->data,
+                     coordFirst, coords, coordEnd - coordFirst);
+    }
+    
     for (i=0; i<numcoords; ++i)
-      data[c++] = shRealCoordFromData(p->datatype, p->scale, p->bias,
-                                      p->data, d+i);
+      data[c++] = coords[d - coordFirst + i];
     
     /* Simplify complex segments */
     switch (segment)
@@ -908,6 +1184,13 @@ void shProcessPathData(SHPath *p,
       
     } /* switch (command) */
   } /* for each segment */
+  
+  /* Save state where processing stopped */
+  cursor->seg = s; cursor->coord = d;
+  SET2V(cursor->start, start);
+  SET2V(cursor->pen, pen);
+  SET2V(cursor->tan, tan);
+  cursor->open = open;
 }
 
 /*-------------------------------------------------------
@@ -1119,8 +1402,6 @@ VG_API_CALL void vgTransformPath(VGPath dstPath, VGPath srcPath)
   SHint newSegCount=0;
   SHint newDataCount=0;
   SHPath *src, *dst;
-  SHuint8 *newSegs = NULL;
-  SHuint8 *newData = NULL;
   SHint segCount = 0;
   SHint dataCount = 0;
   void *userData[5];
@@ -1138,31 +1419,27 @@ VG_API_CALL void vgTransformPath(VGPath dstPath, VGPath srcPath)
                    !(dst->caps & VG_PATH_CAPABILITY_TRANSFORM_TO),
                    VG_PATH_CAPABILITY_ERROR, VG_NO_RETVAL);
   
-  /* Resize path storage */
+  shFlushPendingPath(context, dst);
+  
+  /* Grow path storage (src may be dst) */
   shProcessedDataCount(src, processFlags, &newSegCount, &newDataCount);
-  shResizePathData(dst, newSegCount, newDataCount, &newSegs, &newData);
-  VG_RETURN_ERR_IF(!newData, VG_OUT_OF_MEMORY_ERROR, VG_NO_RETVAL);
+  VG_RETURN_ERR_IF(!shReservePathData(dst, newSegCount, newDataCount),
+                   VG_OUT_OF_MEMORY_ERROR, VG_NO_RETVAL);
   
-  /* Transform src path into new data */
+  /* Transform src path past the end of dst data */
   segCount = dst->segCount;
   dataCount = dst->dataCount;
-  userData[0] = newSegs; userData[1] = &segCount;
-  userData[2] = newData; userData[3] = &dataCount;
+  userData[0] = dst->segs; userData[1] = &segCount;
+  userData[2] = dst->data; userData[3] = &dataCount;
   userData[4] = dst;
   shProcessPathData(src, processFlags, shTransformSegment, userData);
   
-  /* Free old arrays */
-  free(dst->segs);
-  free(dst->data);
+  /* Mark change past the old data */
+  shInvalidatePathFrom(dst, dst->segCount);
   
   /* Adjust new properties */
-  dst->segs = newSegs;
-  dst->data = newData;
   dst->segCount = segCount;
   dst->dataCount = dataCount;
-
-  /* Mark change */
-  dst->cacheDataValid = VG_FALSE;
   
   VG_RETURN_ERR(VG_NO_ERROR, VG_NO_RETVAL);
 }
@@ -1186,22 +1463,80 @@ static void shInterpolateSegment(SHPath *p, VGPathSegment segment,
     procData[(*procDataCount)++] = data[i];
 }
 
-VG_API_CALL VGboolean vgInterpolatePath(VGPath dstPath, VGPath startPath,
-                                        VGPath endPath, VGfloat amount)
+/*-----------------------------------------------------
+ * Brings the data of a path processed for interpolation
+ * up to date. Kept until the path changes, so that the
+ * start and end of a morph are processed only once.
+ *-----------------------------------------------------*/
+
+static int shUpdateInterpolationData(SHPath *p)
 {
-  SHPath *dst, *start, *end;
-  SHuint8 *procSegs1, *procSegs2;
-  SHfloat *procData1, *procData2;
-  SHint procSegCount1=0, procSegCount2=0;
-  SHint procDataCount1=0, procDataCount2=0;
-  SHuint8 *newSegs, *newData;
+  SHint segCount = 0, dataCount = 0;
   void *userData[4];
-  SHint segment1, segment2;
-  SHint segindex, s,d,i;
   SHint processFlags =
     SH_PROCESS_SIMPLIFY_LINES |
     SH_PROCESS_SIMPLIFY_CURVES;
   
+  if (p->cacheInterpValid)
+    return 1;
+  
+  /* Allocate storage for processed path data */
+  shProcessedDataCount(p, processFlags, &segCount, &dataCount);
+  if (!shUint8ArrayReserve(&p->interpSegs, segCount) ||
+      !shFloatArrayReserve(&p->interpData, dataCount))
+    return 0;
+  
+  /* Process path data */
+  segCount = 0; dataCount = 0;
+  userData[0] = p->interpSegs.items; userData[1] = &segCount;
+  userData[2] = p->interpData.items; userData[3] = &dataCount;
+  shProcessPathData(p, processFlags, shInterpolateSegment, userData);
+  
+  p->interpSegs.size = segCount;
+  p->interpData.size = dataCount;
+  p->cacheInterpValid = VG_TRUE;
+  return 1;
+}
+
+/*-----------------------------------------------------
+ * Writes [count] coordinates interpolated between [a]
+ * and [b] past the end of the path data
+ *-----------------------------------------------------*/
+
+static void shInterpolateCoords(SHPath *p, const SHfloat *a, const SHfloat *b,
+                                SHfloat amount, SHint count)
+{
+  SHfloat coords[SH_PATH_DECODE_CHUNK];
+  SHfloat *out;
+  SHint i, j, n;
+  
+  /* Float data gets interpolated in place */
+  if (p->datatype == VG_PATH_DATATYPE_F) {
+    out = (SHfloat*)p->data + p->dataCount;
+    shLerpCoords(a, b, amount, out, count);
+    if (p->scale != 1.0f || p->bias != 0.0f)
+      for (i=0; i<count; ++i)
+        out[i] = (out[i] - p->bias) / p->scale;
+    return;
+  }
+  
+  for (i=0; i<count; i+=n) {
+    n = SH_MIN(count - i, SH_PATH_DECODE_CHUNK);
+    shLerpCoords(a+i, b+i, amount, coords, n);
+    for (j=0; j<n; ++j)
+      shRealCoordToData(p->datatype, p->scale, p->bias,
+                        p->data, p->dataCount+i+j, coords[j]);
+  }
+}
+
+VG_API_CALL VGboolean vgInterpolatePath(VGPath dstPath, VGPath startPath,
+                                        VGPath endPath, VGfloat amount)
+{
+  SHPath *dst, *start, *end;
+  SHint segCount, dataCount;
+  SHint segment1, segment2;
+  SHint s;
+  
   VG_GETCONTEXT(VG_FALSE);
   
   VG_RETURN_ERR_IF(!shIsValidPath(context, dstPath) ||
@@ -1219,45 +1554,26 @@ VG_API_CALL VGboolean vgInterpolatePath(VGPath dstPath, VGPath startPath,
   VG_RETURN_ERR_IF(start->segCount != end->segCount,
                    VG_NO_ERROR, VG_FALSE);
   
-  /* Allocate storage for processed path data */
-  shProcessedDataCount(start, processFlags, &procSegCount1, &procDataCount1);
-  shProcessedDataCount(end, processFlags, &procSegCount2, &procDataCount2);
-  procSegs1 = (SHuint8*)malloc(procSegCount1 * sizeof(SHuint8));
-  procSegs2 = (SHuint8*)malloc(procSegCount2 * sizeof(SHuint8));
-  procData1 = (SHfloat*)malloc(procDataCount1 * sizeof(SHfloat));
-  procData2 = (SHfloat*)malloc(procDataCount2 * sizeof(SHfloat));
-  if (!procSegs1 || !procSegs2 || !procData1 || !procData2) {
-    free(procSegs1); free(procSegs2); free(procData1); free(procData2);
-    VG_RETURN_ERR(VG_OUT_OF_MEMORY_ERROR, VG_FALSE);
-  }
+  shFlushPendingPath(context, dst);
   
-  /* Process data of start path */
-  procSegCount1 = 0; procDataCount1 = 0;
-  userData[0] = procSegs1; userData[1] = &procSegCount1;
-  userData[2] = procData1; userData[3] = &procDataCount1;
-  shProcessPathData(start, processFlags, shInterpolateSegment, userData);
-  
-  /* Process data of end path */
-  procSegCount2 = 0; procDataCount2 = 0;
-  userData[0] = procSegs2; userData[1] = &procSegCount2;
-  userData[2] = procData2; userData[3] = &procDataCount2;
-  shProcessPathData(end, processFlags, shInterpolateSegment, userData);
-  SH_ASSERT(procSegCount1 == procSegCount2 &&
-            procDataCount1 == procDataCount2);
-  
-  /* Resize dst path storage to include interpolated data */
-  shResizePathData(dst, procSegCount1, procDataCount1, &newSegs, &newData);
-  if (!newData) {
-    free(procSegs1); free(procData1);
-    free(procSegs2); free(procData2);
-    VG_RETURN_ERR(VG_OUT_OF_MEMORY_ERROR, VG_FALSE);
-  }
+  /* Processed data of start and end path */
+  VG_RETURN_ERR_IF(!shUpdateInterpolationData(start) ||
+                   !shUpdateInterpolationData(end),
+                   VG_OUT_OF_MEMORY_ERROR, VG_FALSE);
+  
+  /* Grow dst path storage to include interpolated data
+     (start or end may be dst, their data is a copy) */
+  segCount = start->interpSegs.size;
+  dataCount = start->interpData.size;
+  VG_RETURN_ERR_IF(!shReservePathData(dst, segCount, dataCount),
+                   VG_OUT_OF_MEMORY_ERROR, VG_FALSE);
   
-  /* Interpolate data between paths */
-  for (s=0, d=0; s<procSegCount1; ++s) {
+  /* Interpolated segments, whose types must match. Then
+     so do their coordinate counts. */
+  for (s=0; s<segCount; ++s) {
     
-    segment1 = (procSegs1[s] & 0x1E);
-    segment2 = (procSegs2[s] & 0x1E);
+    segment1 = (start->interpSegs.items[s] & 0x1E);
+    segment2 = (end->interpSegs.items[s] & 0x1E);
     
     /* Pick the right arc type */
     if (shIsArcSegment(segment1) &&
@@ -1270,36 +1586,22 @@ VG_API_CALL VGboolean vgInterpolatePath(VGPath dstPath, VGPath startPath,
     }
     
     /* Segment types must match */
-    if (segment1 != segment2) {
-      free(procSegs1); free(procData1);
-      free(procSegs2); free(procData2);
-      free(newSegs); free(newData);
-      VG_RETURN_ERR(VG_NO_ERROR, VG_FALSE);
-    }
+    VG_RETURN_ERR_IF(segment1 != segment2, VG_NO_ERROR, VG_FALSE);
     
-    /* Interpolate values */
-    segindex = (segment1 >> 1);
-    newSegs[s] = segment1 | VG_ABSOLUTE;
-    for (i=0; i<shCoordsPerCommand[segindex]; ++i, ++d) {
-      SHfloat diff = procData2[d] - procData1[d];
-      SHfloat value = procData1[d] + amount * diff;
-      shRealCoordToData(dst->datatype, dst->scale, dst->bias,
-                        newData, dst->dataCount + d, value);
-    }
+    dst->segs[dst->segCount + s] = segment1 | VG_ABSOLUTE;
   }
   
-  /* Free processed data */
-  free(procSegs1); free(procData1);
-  free(procSegs2); free(procData2);
+  /* Interpolate values between paths */
+  SH_ASSERT(end->interpData.size == dataCount);
+  shInterpolateCoords(dst, start->interpData.items,
+                      end->interpData.items, amount, dataCount);
   
-  /* Assign interpolated data */
-  dst->segs = newSegs;
-  dst->data = newData;
-  dst->segCount += procSegCount1;
-  dst->dataCount += procDataCount1;
-
-  /* Mark change */
-  dst->cacheDataValid = VG_FALSE;
+  /* Mark change past the old data */
+  shInvalidatePathFrom(dst, dst->segCount);
+  
+  /* Adjust new properties */
+  dst->segCount += segCount;
+  dst->dataCount += dataCount;
   
   VG_RETURN_ERR(VG_NO_ERROR, VG_TRUE);
 }
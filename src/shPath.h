@@ -45,28 +45,193 @@ typedef struct {
   SHfloat a2;
 } SHArc;
 
-/* SHVertex */
+/* Vertex flags for contour definition */
+#define SH_VERTEX_FLAG_CLOSE   (1 << 0)
+#define SH_VERTEX_FLAG_SEGEND  (1 << 1)
+#define SH_SEGMENT_TYPE_COUNT  13
+
+/* Path segment uploaded for curve evaluation on the GPU.
+   Lines and quadratics are stored as cubics. */
+typedef struct
+{
+  SHVector2 p0, p3;     /* end points */
+  SHVector2 p1, p2;     /* cubic controls or arc center and axis */
+  SHVector2 axis, pad;  /* second arc axis */
+  SHfloat type;         /* SH_CURVE_CUBIC or SH_CURVE_ARC */
+  SHfloat a1, a2;       /* arc angles */
+  SHfloat pad2;
+  
+} SHCurveSegment;
+
+#define SH_CURVE_CUBIC  0.0f
+#define SH_CURVE_ARC    1.0f
+
+/* Curve segment array */
+#define _ITEM_T SHCurveSegment
+#define _ARRAY_T SHCurveSegmentArray
+#define _FUNC_T shCurveSegmentArray
+#define _ARRAY_DECLARE
+#include "shArrayBase.h"
+
+/* Stencil vertex of the implicit curve fill. The coordinates
+   are barycentric weights of the second and third corner of
+   a conic hull triangle, the conic weight is 1 for parabolas. */
 typedef struct
 {
   SHVector2 point;
-  SHVector2 tangent;
-  SHfloat length;
-  SHuint flags;
+  SHVector2 coord;
+  SHfloat weight;
   
-} SHVertex;
+} SHImplicitVertex;
 
-/* Vertex flags for contour definition */
-#define SH_VERTEX_FLAG_CLOSE   (1 << 0)
-#define SH_VERTEX_FLAG_SEGEND  (1 << 1)
-#define SH_SEGMENT_TYPE_COUNT  13
+/* Implicit vertex array */
+#define _ITEM_T SHImplicitVertex
+#define _ARRAY_T SHImplicitVertexArray
+#define _FUNC_T shImplicitVertexArray
+#define _ARRAY_DECLARE
+#include "shArrayBase.h"
+
+/* Polyline segment of a stroke expanded on the GPU: its
+   end points, the point the segment joined at its end heads
+   to, and whether the start and end are capped (1) rather
+   than joined (0). The previous segment owns the start join. */
+typedef struct
+{
+  SHVector2 p0, p1;
+  SHVector2 next;
+  SHfloat startCap, endCap;
+  
+} SHStrokeSegment;
+
+/* Stroke segment array */
+#define _ITEM_T SHStrokeSegment
+#define _ARRAY_T SHStrokeSegmentArray
+#define _FUNC_T shStrokeSegmentArray
+#define _ARRAY_DECLARE
+#include "shArrayBase.h"
+
+/* State of path data processing before a segment, from
+   which processing can be picked up again */
+typedef struct
+{
+  SHint seg, coord;  /* segment and its first coordinate */
+  SHVector2 start;   /* start of the current contour */
+  SHVector2 pen;     /* current pen position */
+  SHVector2 tan;     /* backward tangent for smoothing */
+  SHint open;        /* contour-open flag */
+  
+} SHPathCursor;
 
-/* Vertex array */
-#define _ITEM_T SHVertex
-#define _ARRAY_T SHVertexArray
-#define _FUNC_T shVertexArray
+/* Where a contour of the flattening starts: processing
+   state before the segment that opened it, its first
+   vertex and the bounds of the vertices before it */
+typedef struct
+{
+  SHPathCursor cursor;
+  SHint vertex;
+  SHVector2 min, max;
+  
+} SHTessContour;
+
+/* Tessellation contour array */
+#define _ITEM_T SHTessContour
+#define _ARRAY_T SHTessContourArray
+#define _FUNC_T shTessContourArray
 #define _ARRAY_DECLARE
 #include "shArrayBase.h"
 
+/* State of stroke generation before an edge of the
+   flattening, from which the path can be re-stroked */
+typedef struct
+{
+  SHint vertex;        /* first vertex of the edge */
+  SHint contourIndex;  /* contours entered before it */
+  SHint contourStart;  /* first vertex of its contour */
+  SHVector2 dprev, tprev;
+  SHVector2 lprev, rprev;
+  SHint ilprev, irprev;
+  SHint strokeSize;    /* stroke vertices, indices and */
+  SHint indexCount;    /* bounds generated before it */
+  SHVector2 strokeMin, strokeMax;
+  
+} SHStrokeCursor;
+
+/* Stroke cursor array */
+#define _ITEM_T SHStrokeCursor
+#define _ARRAY_T SHStrokeCursorArray
+#define _FUNC_T shStrokeCursorArray
+#define _ARRAY_DECLARE
+#include "shArrayBase.h"
+
+/* Flattened geometry of a path kept for a scale level
+   other than the one currently in use */
+typedef struct
+{
+  SHint level;
+  VGRenderingQuality quality;
+  SHuint generation;
+  SHfloat tolerance;
+  SHuint stamp;
+  
+  SHVector2Array vertices;
+  SHUint8Array vertexFlags;
+  SHIntArray contours;
+  SHVector2 min, max;
+  VGboolean convex;
+  SHVector2Array fillCover;
+  SHTessContourArray tessContours;
+  SHPathCursor tessCursor;
+  
+} SHTessLevel;
+
+/* Stroke parameters, read from the context or from a
+   copy queued with the path */
+typedef struct
+{
+  SHfloat lineWidth;
+  VGCapStyle capStyle;
+  VGJoinStyle joinStyle;
+  SHfloat miterLimit;
+  const SHfloat *dashPattern;
+  SHint dashCount;
+  SHuint dashHash;
+  SHfloat dashPhase;
+  VGboolean dashPhaseReset;
+  
+} SHStrokeStyle;
+
+/* Parameters stroke geometry was generated with */
+typedef struct
+{
+  SHuint tessGeneration;
+  SHfloat lineWidth;
+  VGCapStyle capStyle;
+  VGJoinStyle joinStyle;
+  SHfloat miterLimit;
+  SHint dashCount;
+  SHuint dashHash;
+  SHfloat dashPhase;
+  VGboolean dashPhaseReset;
+  
+} SHStrokeKey;
+
+/* Stroke geometry kept for parameters other than
+   the ones currently in use */
+typedef struct
+{
+  SHStrokeKey key;
+  SHFloatArray dash;
+  SHuint stamp;
+  
+  SHVector2Array stroke;
+  SHUint8Array strokeIndices;
+  SHint strokeIndexSize;
+  SHVector2Array strokeCover;
+  SHVector2 strokeMin, strokeMax;
+  SHStrokeCursorArray strokeContours;
+  SHStrokeCursor strokeTail;
+  
+} SHStrokeEntry;
 
 /* SHPath */
 typedef struct SHPath
@@ -80,34 +245,148 @@ typedef struct SHPath
   VGbitfield caps;
   VGPathDatatype datatype;
   
-  /* Raw data */
+  /* Raw data, with room for segCapacity segments and
+     dataCapacity coordinates before it has to grow */
   SHuint8 *segs;
   void *data;
   SHint segCount;
   SHint dataCount;
+  SHint segCapacity;
+  SHint dataCapacity;
 
-  /* Subdivision */
-  SHVertexArray vertices;
+  /* Subdivision, kept as a packed point stream with
+     parallel vertex flags and the vertex count of
+     each contour */
+  SHVector2Array vertices;
+  SHUint8Array vertexFlags;
+  SHIntArray contours;
   SHVector2 min, max;
+  VGboolean convex; /* single convex contour */
+  SHVector2Array fillCover;
+  SHVector2Array coverScratch; /* hull building */
+  
+  /* Where each contour of the subdivision starts and
+     where processing of the path data stopped, so that
+     changed data can be flattened from there on */
+  SHTessContourArray tessContours;
+  SHPathCursor tessCursor;
   
-  /* Additional stroke geometry (dash vertices if
-     path dashed or triangle vertices if width > 1 */
+  /* Additional stroke geometry: unique vertices and
+     the triangles indexing them, with 16-bit indices
+     while the vertex count allows and 32-bit after */
   SHVector2Array stroke;
+  SHUint8Array strokeIndices;
+  SHint strokeIndexSize;
+  SHVector2Array strokeCover;
+  SHVector2 strokeMin, strokeMax;
+  
+  /* Stroke state at the start of each contour, plus one
+     past the last, and before the last edge of the last
+     contour, so that changed contours can be re-stroked */
+  SHStrokeCursorArray strokeContours;
+  SHStrokeCursor strokeTail;
+  
+  /* Set while building the stroke once memory ran out */
+  SHint strokeFailed;
+  
+  /* Segments for curve evaluation on the GPU, lines
+     first, with conservative bounds and cover */
+  SHCurveSegmentArray curves;
+  SHint curveLines;
+  SHVector2 curveMin, curveMax;
+  SHVector2Array curveCover;
+  
+  /* Stencil triangles of the implicit curve fill, built
+     from the curve segments and covered by their cover */
+  SHImplicitVertexArray implicit;
+  
+  /* Polyline of the tessellation the GPU strokes, valid
+     for any stroke style */
+  SHStrokeSegmentArray strokeSegments;
+  SHuint strokeSegmentsGeneration;
+  
+  /* Arc-length table: a flattening of the path in its own
+     space with the distance along the path at each point,
+     and the first and last point of each segment */
+  SHVector2Array lengthPoints;
+  SHFloatArray lengths;
+  SHIntArray lengthSegs;
+  VGboolean cacheLengthValid;
+  
+  /* Path data processed for interpolation: absolute
+     segments with lines and smooth curves simplified */
+  SHUint8Array interpSegs;
+  SHFloatArray interpData;
+  VGboolean cacheInterpValid;
 
-  /* Cache */
+  /* Cache, with the first segment changed since it
+     was valid */
   VGboolean      cacheDataValid;
+  SHint          cacheDirtySeg;
 
-  VGboolean      cacheTransformInit;
-  SHMatrix3x3    cacheTransform;
+  VGboolean      cacheLevelInit;
+  SHint          cacheLevel;
+  VGRenderingQuality cacheRenderingQuality;
+  SHuint         cacheTessGeneration;
+  SHfloat        cacheTolerance;
+  SHuint         tessGenerationCount;
+  
+  /* Tessellations of other scale levels, least
+     recently used gets replaced first */
+  SHTessLevel    tessLevels[SH_MAX_TESS_LEVELS];
+  SHint          tessLevelCount;
+  SHuint         tessStamp;
+
+  VGboolean      cacheCurvesValid;
+  VGboolean      cacheImplicitValid;
 
   VGboolean      cacheStrokeInit;
-  VGboolean      cacheStrokeTessValid;
-  SHfloat        cacheStrokeLineWidth;
-  VGCapStyle     cacheStrokeCapStyle;
-  VGJoinStyle    cacheStrokeJoinStyle;
-  SHfloat        cacheStrokeMiterLimit;
-  SHfloat        cacheStrokeDashPhase;
-  VGboolean      cacheStrokeDashPhaseReset;
+  SHStrokeKey    cacheStroke;
+  SHFloatArray   cacheStrokeDash;
+  
+  /* Strokes with other parameters, least recently
+     used gets replaced first */
+  SHStrokeEntry  strokeEntries[SH_MAX_STROKE_ENTRIES];
+  SHint          strokeEntryCount;
+  SHuint         strokeStamp;
+  
+  /* Work queued for the next flush of deferred draws,
+     with a copy of the stroke style it needs */
+  VGboolean      pending;
+  SHint          pendingLevel;
+  VGRenderingQuality pendingQuality;
+  SHfloat        pendingTolerance;
+  VGboolean      pendingStroke;
+  SHStrokeStyle  pendingStyle;
+  SHFloatArray   pendingDash;
+
+  /* GPU-resident copies of vertices and stroke triangles,
+     re-uploaded only when the matching cache is rebuilt */
+  GLuint         vaoVertices;
+  GLuint         vboVertices;
+  VGboolean      vboVerticesDirty;
+  SHint          vboVerticesRebuilds;
+
+  GLuint         vaoStroke;
+  GLuint         vboStroke;
+  GLuint         eboStroke;
+  VGboolean      vboStrokeDirty;
+  SHint          vboStrokeRebuilds;
+  
+  /* Curve segments share one buffer, the line and
+     curve ranges get a vertex array each */
+  GLuint         vaoCurveLines;
+  GLuint         vaoCurves;
+  GLuint         vboCurves;
+  VGboolean      vboCurvesDirty;
+  
+  GLuint         vaoImplicit;
+  GLuint         vboImplicit;
+  VGboolean      vboImplicitDirty;
+  
+  GLuint         vaoStrokeSegments;
+  GLuint         vboStrokeSegments;
+  VGboolean      vboStrokeSegmentsDirty;
   
 } SHPath;
 
@@ -131,6 +410,14 @@ void shProcessPathData(SHPath *p, int flags,
                        SegmentFunc callback,
                        void *userData);
 
+/* Same, from the state in [cursor] on, which is kept
+   up to date as segments get processed */
+void shResetPathCursor(SHPathCursor *cursor);
+void shProcessPathDataFrom(SHPath *p, int flags,
+                           SHPathCursor *cursor,
+                           SegmentFunc callback,
+                           void *userData);
+
 
 /* Pointer-to-path array */
 #define _ITEM_T SHPath*
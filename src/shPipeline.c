@@ -27,11 +27,15 @@
 #include "shImage.h"
 #include "shGeometry.h"
 #include "shPaint.h"
+#include <string.h>
+#include <stddef.h>
 
 void shPremultiplyFramebuffer()
 {
   /* Multiply target color with its own alpha */
-  glBlendFunc(GL_ZERO, GL_DST_ALPHA);
+  VG_GETCONTEXT(VG_NO_RETVAL);
+  shGLBlendFunc(&context->gl, GL_ZERO, GL_DST_ALPHA);
+  VG_RETURN(VG_NO_RETVAL);
 }
 
 void shUnpremultiplyFramebuffer()
@@ -39,225 +43,1632 @@ void shUnpremultiplyFramebuffer()
   /* TODO: hmmmm..... any idea? */
 }
 
-void updateBlendingStateGL(VGContext *c, int alphaIsOne)
+static void shSetBlendModeGL(SHGLState *s, VGBlendMode mode, int alphaIsOne)
 {
   /* Most common drawing mode (SRC_OVER with alpha=1)
      as well as SRC is optimized by turning OpenGL
      blending off. In other cases its turned on. */
   
-  switch (c->blendMode)
+  switch (mode)
   {
   case VG_BLEND_SRC:
-    glBlendFunc(GL_ONE, GL_ZERO);
-    glDisable(GL_BLEND); break;
+    shGLBlendFunc(s, GL_ONE, GL_ZERO);
+    shGLDisable(s, GL_BLEND); break;
 
   case VG_BLEND_SRC_IN:
-    glBlendFunc(GL_DST_ALPHA, GL_ZERO);
-    glEnable(GL_BLEND); break;
+    shGLBlendFunc(s, GL_DST_ALPHA, GL_ZERO);
+    shGLEnable(s, GL_BLEND); break;
 
   case VG_BLEND_DST_IN:
-    glBlendFunc(GL_ZERO, GL_SRC_ALPHA);
-    glEnable(GL_BLEND); break;
+    shGLBlendFunc(s, GL_ZERO, GL_SRC_ALPHA);
+    shGLEnable(s, GL_BLEND); break;
     
   case VG_BLEND_SRC_OUT_SH:
-    glBlendFunc(GL_ONE_MINUS_DST_ALPHA, GL_ZERO);
-    glEnable(GL_BLEND); break;
+    shGLBlendFunc(s, GL_ONE_MINUS_DST_ALPHA, GL_ZERO);
+    shGLEnable(s, GL_BLEND); break;
 
   case VG_BLEND_DST_OUT_SH:
-    glBlendFunc(GL_ZERO, GL_ONE_MINUS_SRC_ALPHA);
-    glEnable(GL_BLEND); break;
+    shGLBlendFunc(s, GL_ZERO, GL_ONE_MINUS_SRC_ALPHA);
+    shGLEnable(s, GL_BLEND); break;
 
   case VG_BLEND_SRC_ATOP_SH:
-    glBlendFunc(GL_DST_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-    glEnable(GL_BLEND); break;
+    shGLBlendFunc(s, GL_DST_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    shGLEnable(s, GL_BLEND); break;
 
   case VG_BLEND_DST_ATOP_SH:
-    glBlendFunc(GL_ONE_MINUS_DST_ALPHA, GL_SRC_ALPHA);
-    glEnable(GL_BLEND); break;
+    shGLBlendFunc(s, GL_ONE_MINUS_DST_ALPHA, GL_SRC_ALPHA);
+    shGLEnable(s, GL_BLEND); break;
 
   case VG_BLEND_DST_OVER:
-    glBlendFunc(GL_ONE_MINUS_DST_ALPHA, GL_DST_ALPHA);
-    glEnable(GL_BLEND); break;
+    shGLBlendFunc(s, GL_ONE_MINUS_DST_ALPHA, GL_DST_ALPHA);
+    shGLEnable(s, GL_BLEND); break;
 
   case VG_BLEND_SRC_OVER: default:
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-    if (alphaIsOne) glDisable(GL_BLEND);
-    else glEnable(GL_BLEND); break;
+    shGLBlendFunc(s, GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    if (alphaIsOne) shGLDisable(s, GL_BLEND);
+    else shGLEnable(s, GL_BLEND); break;
   };
 }
 
+void updateBlendingStateGL(VGContext *c, int alphaIsOne)
+{
+  shSetBlendModeGL(&c->gl, c->blendMode, alphaIsOne);
+}
+
+/*-----------------------------------------------------------
+ * Stencil state for the two passes of stencil-then-cover:
+ * the first one marks the covered pixels with color writes
+ * off, the second one paints where the fill rule says the
+ * pixel is inside and clears the stencil for the next path.
+ *
+ * Even-odd fills flip the stencil for each covering fan
+ * triangle. Non-zero fills count the winding number instead:
+ * front faces increment, back faces decrement (with wrap so
+ * that negative counts work), and anything non-zero is in.
+ *-----------------------------------------------------------*/
+
+static void shSetStencilPassGL(SHGLState *s, VGPaintMode mode,
+                               VGFillRule fillRule)
+{
+  shGLEnable(s, GL_STENCIL_TEST);
+  
+  if (mode == VG_FILL_PATH && fillRule == VG_NON_ZERO) {
+    shGLStencilFunc(s, GL_ALWAYS, 0, 0);
+    shGLStencilOpSeparate(s, GL_FRONT, GL_KEEP, GL_KEEP, GL_INCR_WRAP);
+    shGLStencilOpSeparate(s, GL_BACK, GL_KEEP, GL_KEEP, GL_DECR_WRAP);
+  }else if (mode == VG_FILL_PATH) {
+    shGLStencilFunc(s, GL_ALWAYS, 0, 0);
+    shGLStencilOp(s, GL_INVERT, GL_INVERT, GL_INVERT);
+  }else{
+    shGLStencilFunc(s, GL_NOTEQUAL, 1, 1);
+    shGLStencilOp(s, GL_KEEP, GL_INCR, GL_INCR);
+  }
+  
+  shGLColorMask(s, GL_FALSE);
+}
+
+/*-----------------------------------------------------------
+ * Returns true if a stroke can be painted without the
+ * stencil pass: blending is off for its paint, so pixels
+ * covered by overlapping triangles cannot blend twice.
+ *-----------------------------------------------------------*/
+
+static int shIsStrokeDirect(VGBlendMode mode, int alphaIsOne)
+{
+  /* Blending is off for these, see shSetBlendModeGL */
+  return (mode == VG_BLEND_SRC ||
+          (mode == VG_BLEND_SRC_OVER && alphaIsOne));
+}
+
+/*-----------------------------------------------------------
+ * State for painting geometry straight away, without
+ * touching the stencil buffer: convex fills, and strokes
+ * whose overlapping triangles cannot blend twice.
+ *-----------------------------------------------------------*/
+
+static void shSetDirectPassGL(SHGLState *s)
+{
+  shGLDisable(s, GL_STENCIL_TEST);
+  shGLColorMask(s, GL_TRUE);
+}
+
+static void shSetCoverPassGL(SHGLState *s, VGPaintMode mode,
+                             VGFillRule fillRule)
+{
+  if (mode == VG_FILL_PATH && fillRule == VG_NON_ZERO)
+    shGLStencilFunc(s, GL_NOTEQUAL, 0, 0xFF);
+  else shGLStencilFunc(s, GL_EQUAL, 1, 1);
+  
+  shGLStencilOp(s, GL_ZERO, GL_ZERO, GL_ZERO);
+  shGLColorMask(s, GL_TRUE);
+}
+
+/*-----------------------------------------------------------
+ * Creates / destroys the streaming vertex buffer used for
+ * geometry that changes on every draw (cover quads, image
+ * quads and paths that keep getting re-tessellated).
+ *-----------------------------------------------------------*/
+
+void shInitStreamBuffer(VGContext *c)
+{
+  glGenVertexArrays(1, &c->streamVAO);
+  glGenBuffers(1, &c->streamVBO);
+  
+  glBindVertexArray(c->streamVAO);
+  glBindBuffer(GL_ARRAY_BUFFER, c->streamVBO);
+  glBufferData(GL_ARRAY_BUFFER, SH_STREAM_BUFFER_SIZE, NULL, GL_STREAM_DRAW);
+  glEnableVertexAttribArray(SH_ATTRIB_POS);
+  
+  /* Indices are streamed into the same buffer */
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, c->streamVBO);
+  
+  glBindVertexArray(0);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  GL_CEHCK_ERROR;
+  
+  c->streamSize = SH_STREAM_BUFFER_SIZE;
+  c->streamOffset = 0;
+}
+
+void shDeinitStreamBuffer(VGContext *c)
+{
+  if (c->streamVAO) glDeleteVertexArrays(1, &c->streamVAO);
+  if (c->streamVBO) glDeleteBuffers(1, &c->streamVBO);
+  c->streamVAO = 0;
+  c->streamVBO = 0;
+  c->streamSize = 0;
+  c->streamOffset = 0;
+}
+
+/*-----------------------------------------------------------
+ * Appends vertex data, followed by [indexBytes] of index
+ * data if any, to the stream buffer and binds its VAO. When
+ * the ring wraps the storage is orphaned so the driver never
+ * has to wait for pending draws to finish. Returns the byte
+ * offset of the vertices inside the buffer; the indices
+ * start at [indexOffset].
+ *-----------------------------------------------------------*/
+
+static GLintptr shStreamMesh(VGContext *c, const void *data, GLsizeiptr bytes,
+                             const void *indices, GLsizeiptr indexBytes,
+                             GLintptr *indexOffset)
+{
+  GLsizeiptr vertexBytes = (bytes + 15) & ~((GLsizeiptr)15);
+  GLsizeiptr total = (indexBytes ? vertexBytes + indexBytes : bytes);
+  GLintptr offset;
+  GLubyte *dst;
+  
+  glBindVertexArray(c->streamVAO);
+  glBindBuffer(GL_ARRAY_BUFFER, c->streamVBO);
+  
+  if (total > c->streamSize) {
+    /* Grow to fit the largest upload seen so far */
+    while (c->streamSize < total) c->streamSize *= 2;
+    glBufferData(GL_ARRAY_BUFFER, c->streamSize, NULL, GL_STREAM_DRAW);
+    c->streamOffset = 0;
+  }else if (c->streamOffset + total > c->streamSize) {
+    /* Orphan and restart at the beginning */
+    glBufferData(GL_ARRAY_BUFFER, c->streamSize, NULL, GL_STREAM_DRAW);
+    c->streamOffset = 0;
+  }
+  
+  offset = c->streamOffset;
+  dst = (GLubyte*)glMapBufferRange(GL_ARRAY_BUFFER, offset, total,
+                                   GL_MAP_WRITE_BIT |
+                                   GL_MAP_INVALIDATE_RANGE_BIT |
+                                   GL_MAP_UNSYNCHRONIZED_BIT);
+  if (dst) {
+    memcpy(dst, data, bytes);
+    if (indexBytes) memcpy(dst + vertexBytes, indices, indexBytes);
+    glUnmapBuffer(GL_ARRAY_BUFFER);
+  }else{
+    glBufferSubData(GL_ARRAY_BUFFER, offset, bytes, data);
+    if (indexBytes)
+      glBufferSubData(GL_ARRAY_BUFFER, offset + vertexBytes, indexBytes, indices);
+  }
+  
+  if (indexOffset) *indexOffset = offset + vertexBytes;
+  
+  /* Keep following uploads 16-byte aligned */
+  c->streamOffset += (total + 15) & ~((GLintptr)15);
+  return offset;
+}
+
+static GLintptr shStreamVertices(VGContext *c, const void *data, GLsizeiptr bytes)
+{
+  return shStreamMesh(c, data, bytes, NULL, 0, NULL);
+}
+
+/*-----------------------------------------------------------
+ * Uploads cached path geometry into the given buffer,
+ * creating the buffer and its vertex array on first use.
+ *-----------------------------------------------------------*/
+
+static void shUploadPathBuffer(GLuint *vao, GLuint *vbo,
+                               const void *data, GLsizeiptr bytes)
+{
+  if (*vao == 0) {
+    glGenVertexArrays(1, vao);
+    glGenBuffers(1, vbo);
+    glBindVertexArray(*vao);
+    glBindBuffer(GL_ARRAY_BUFFER, *vbo);
+    glEnableVertexAttribArray(SH_ATTRIB_POS);
+    glVertexAttribPointer(SH_ATTRIB_POS, 2, GL_FLOAT, GL_FALSE, 0, (void*)0);
+  }else{
+    glBindVertexArray(*vao);
+    glBindBuffer(GL_ARRAY_BUFFER, *vbo);
+  }
+  
+  /* Re-specifying the whole store lets the driver orphan
+     the old one if it is still in use */
+  glBufferData(GL_ARRAY_BUFFER, bytes, data, GL_STATIC_DRAW);
+}
+
+/*-----------------------------------------------------------
+ * Restores the default vertex array and buffer bindings so
+ * the rest of the library (and the application) can keep
+ * using client-side arrays.
+ *-----------------------------------------------------------*/
+
+static void shResetVertexArrayState(void)
+{
+  glBindVertexArray(0);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+/*-----------------------------------------------------------
+ * Creates / destroys the uniform buffer holding per-draw
+ * paint and transform records (SHDrawBlock in the shaders).
+ *-----------------------------------------------------------*/
+
+void shInitDrawBlock(VGContext *c)
+{
+  glGenBuffers(1, &c->drawBlockUBO);
+  glBindBuffer(GL_UNIFORM_BUFFER, c->drawBlockUBO);
+  glBufferData(GL_UNIFORM_BUFFER, SH_DRAW_RECORDS * sizeof(SHDrawRecord),
+               NULL, GL_STREAM_DRAW);
+  glBindBuffer(GL_UNIFORM_BUFFER, 0);
+  GL_CEHCK_ERROR;
+  
+  c->drawBlockNext = 0;
+  c->drawBlockLast = -1;
+}
+
+void shDeinitDrawBlock(VGContext *c)
+{
+  if (c->drawBlockUBO) glDeleteBuffers(1, &c->drawBlockUBO);
+  c->drawBlockUBO = 0;
+  c->drawBlockNext = 0;
+  c->drawBlockLast = -1;
+}
+
+/*-----------------------------------------------------------
+ * Appends [count] records to the draw block and returns the
+ * index of the first one. Slots are never rewritten while
+ * draws may still read them: when the block is full its
+ * storage is orphaned and filling restarts at the beginning.
+ *-----------------------------------------------------------*/
+
+static SHint shUploadDrawRecords(VGContext *c, const SHDrawRecord *r, SHint count)
+{
+  SHint first;
+  
+  shGLBindDrawBlock(&c->gl, c->drawBlockUBO);
+  glBindBuffer(GL_UNIFORM_BUFFER, c->drawBlockUBO);
+  
+  if (c->drawBlockNext + count > SH_DRAW_RECORDS) {
+    glBufferData(GL_UNIFORM_BUFFER, SH_DRAW_RECORDS * sizeof(SHDrawRecord),
+                 NULL, GL_STREAM_DRAW);
+    c->drawBlockNext = 0;
+  }
+  
+  first = c->drawBlockNext;
+  glBufferSubData(GL_UNIFORM_BUFFER, first * sizeof(SHDrawRecord),
+                  count * sizeof(SHDrawRecord), r);
+  c->drawBlockNext += count;
+  c->drawBlockLast = -1;
+  
+  return first;
+}
+
+/*-----------------------------------------------------------
+ * Makes the given record the current one for following
+ * draws. A record identical to the last submitted one is
+ * not uploaded again.
+ *-----------------------------------------------------------*/
+
+void shSubmitDrawRecord(VGContext *c, const SHDrawRecord *r)
+{
+  if (c->drawBlockLast < 0 ||
+      memcmp(r, &c->drawBlockLastRecord, sizeof(SHDrawRecord)) != 0) {
+    c->drawBlockLast = shUploadDrawRecords(c, r, 1);
+    c->drawBlockLastRecord = *r;
+  }
+  
+  shGLUniform1i(&c->gl, c->locationDraw.drawIndex,
+                &c->gl.uniforms.drawIndex, c->drawBlockLast);
+}
+
+/*-----------------------------------------------------------
+ * Clears a draw record and sets its transform and drawing
+ * mode. Paint space defaults to user space.
+ *-----------------------------------------------------------*/
+
+static void shBeginDrawRecord(SHDrawRecord *r, SHMatrix3x3 *transform,
+                              GLint drawMode)
+{
+  memset(r, 0, sizeof(SHDrawRecord));
+  shMatrixToGL(transform, r->model);
+  r->paintInverted[0] = 1.0f;
+  r->paintInverted[5] = 1.0f;
+  r->paintInverted[10] = 1.0f;
+  r->drawMode = drawMode;
+}
+
+/*-----------------------------------------------------------
+ * Fills the paint part of a draw record and binds the
+ * textures the paint samples from.
+ *-----------------------------------------------------------*/
+
+static void shLoadPaint(SHPaint *p, VGPaintMode mode,
+                        VGMatrixMode matrixMode, SHDrawRecord *r)
+{
+  switch (p->type) {
+  case VG_PAINT_TYPE_LINEAR_GRADIENT:
+    shLoadLinearGradientMesh(p, mode, matrixMode, r);
+    break; 
+
+  case VG_PAINT_TYPE_RADIAL_GRADIENT:
+    shLoadRadialGradientMesh(p, mode, matrixMode, r);
+    break; 
+    
+  case VG_PAINT_TYPE_PATTERN:
+    if (p->pattern != VG_INVALID_HANDLE) {
+      shLoadPatternMesh(p, mode, matrixMode, r);
+      break;
+    }/* else behave as a color paint */
+  
+  case VG_PAINT_TYPE_COLOR:
+    shLoadOneColorMesh(p, r);
+    break;  
+  }
+}
+
+/*-----------------------------------------------------------
+ * Draws the triangles representing the stroke of a path,
+ * [instances] times with consecutive draw records.
+ *-----------------------------------------------------------*/
+
+static void shDrawStroke(VGContext *c, SHPath *p, GLsizei instances)
+{
+  GLsizeiptr bytes = p->stroke.size * sizeof(SHVector2);
+  GLsizei count = p->strokeIndices.size / p->strokeIndexSize;
+  GLenum type = (p->strokeIndexSize == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT);
+  GLintptr offset, indexOffset = 0;
+  
+  if (count == 0) return;
+  
+  if (p->vboStrokeRebuilds >= SH_DYNAMIC_PATH_REBUILDS) {
+    /* Geometry changes every frame: stream it */
+    offset = shStreamMesh(c, p->stroke.items, bytes, p->strokeIndices.items,
+                          p->strokeIndices.size, &indexOffset);
+    glVertexAttribPointer(SH_ATTRIB_POS, 2, GL_FLOAT, GL_FALSE, 0, (void*)offset);
+    p->vboStrokeDirty = VG_TRUE;
+  }else if (p->vboStrokeDirty) {
+    shUploadPathBuffer(&p->vaoStroke, &p->vboStroke,
+                       p->stroke.items, bytes);
+    
+    /* Element buffer is part of the vertex array state */
+    if (p->eboStroke == 0) {
+      glGenBuffers(1, &p->eboStroke);
+      glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, p->eboStroke);
+    }
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, p->strokeIndices.size,
+                 p->strokeIndices.items, GL_STATIC_DRAW);
+    p->vboStrokeDirty = VG_FALSE;
+  }else glBindVertexArray(p->vaoStroke);
+  
+  glDrawElementsInstanced(GL_TRIANGLES, count, type,
+                          (void*)indexOffset, instances);
+  GL_CEHCK_ERROR;
+}
+
+/*-----------------------------------------------------------
+ * Draws the subdivided vertices in the OpenGL mode given
+ * (this could be VG_TRIANGLE_FAN or VG_LINE_STRIP),
+ * [instances] times with consecutive draw records.
+ *-----------------------------------------------------------*/
+
+static void shDrawVertices(VGContext *c, SHPath *p, GLenum mode,
+                           GLsizei instances)
+{
+  GLsizeiptr bytes = p->vertices.size * sizeof(SHVector2);
+  GLintptr offset;
+  int start = 0;
+  int i;
+  
+  if (p->vertices.size == 0) return;
+  
+  if (p->vboVerticesRebuilds >= SH_DYNAMIC_PATH_REBUILDS) {
+    /* Geometry changes every frame: stream it */
+    offset = shStreamVertices(c, p->vertices.items, bytes);
+    glVertexAttribPointer(SH_ATTRIB_POS, 2, GL_FLOAT, GL_FALSE,
+                          0, (void*)offset);
+    p->vboVerticesDirty = VG_TRUE;
+  }else if (p->vboVerticesDirty) {
+    shUploadPathBuffer(&p->vaoVertices, &p->vboVertices,
+                       p->vertices.items, bytes);
+    p->vboVerticesDirty = VG_FALSE;
+  }else glBindVertexArray(p->vaoVertices);
+  
+  /* We separate vertex arrays by contours to properly
+     handle the fill modes */
+  for (i=0; i<p->contours.size; ++i) {
+    glDrawArraysInstanced(mode, start, p->contours.items[i], instances);
+    start += p->contours.items[i];
+  }
+  
+  GL_CEHCK_ERROR;
+}
+
+/*-----------------------------------------------------------
+ * Brings the geometry derived from the path data up to date
+ * if the data changed since it was built. The tessellation
+ * in use and the stroke built on it get the changed contours
+ * flattened and stroked again, everything else is dropped.
+ *-----------------------------------------------------------*/
+
+static void shValidatePathData(SHPath *p)
+{
+  SHStrokeStyle s;
+  SHint vertex, contour;
+  SHint seg = p->cacheDirtySeg;
+  
+  if (p->cacheDataValid == VG_TRUE)
+    return;
+  
+  p->cacheDataValid = VG_TRUE;
+  p->cacheDirtySeg = VG_MAXINT;
+  p->tessLevelCount = 0;
+  p->strokeEntryCount = 0;
+  p->cacheCurvesValid = VG_FALSE;
+  p->cacheImplicitValid = VG_FALSE;
+  
+  if (p->cacheLevelInit == VG_FALSE || seg == 0) {
+    p->cacheLevelInit = VG_FALSE;
+    p->cacheStrokeInit = VG_FALSE;
+    return;
+  }
+  
+  /* Stroke in use must be built on the tessellation */
+  if (p->cacheStroke.tessGeneration != p->cacheTessGeneration)
+    p->cacheStrokeInit = VG_FALSE;
+  
+  shReflattenPath(p, seg, p->cacheTolerance, &vertex, &contour);
+  shBuildFillCover(p);
+  p->cacheTessGeneration = ++p->tessGenerationCount;
+  p->vboVerticesDirty = VG_TRUE;
+  
+  /* Dash patterns are not kept with the stroke */
+  if (p->cacheStrokeInit == VG_FALSE || p->cacheStroke.dashCount > 0) {
+    p->cacheStrokeInit = VG_FALSE;
+    return;
+  }
+  
+  s.lineWidth = p->cacheStroke.lineWidth;
+  s.capStyle = p->cacheStroke.capStyle;
+  s.joinStyle = p->cacheStroke.joinStyle;
+  s.miterLimit = p->cacheStroke.miterLimit;
+  s.dashPattern = NULL;
+  s.dashCount = 0;
+  s.dashHash = 0;
+  s.dashPhase = 0.0f;
+  s.dashPhaseReset = VG_FALSE;
+  
+  if (!shRestrokePath(&s, p->cacheTolerance, p, vertex, contour)) {
+    p->cacheStrokeInit = VG_FALSE;
+    return;
+  }
+  
+  shBuildStrokeCover(p);
+  p->cacheStroke.tessGeneration = p->cacheTessGeneration;
+  p->vboStrokeDirty = VG_TRUE;
+}
+
+/*-----------------------------------------------------------
+ * Whether fills evaluate their curves on the GPU. A user
+ * vertex shader would not see the curve program, so the
+ * tessellated path is used with one.
+ *-----------------------------------------------------------*/
+
+static int shUseGPUCurves(VGContext *c)
+{
+  return (c->gpuCurves && c->userShaderVertex == NULL);
+}
+
+static int shUseImplicitCurves(VGContext *c)
+{
+  return (c->implicitCurves && c->userShaderVertex == NULL);
+}
+
+/*-----------------------------------------------------------
+ * Whether strokes get expanded from the polyline on the GPU.
+ * The stroke program stands in for both user shaders, and
+ * dashed strokes are left to the CPU stroker.
+ *-----------------------------------------------------------*/
+
+static int shUseGPUStrokes(VGContext *c)
+{
+  return (c->gpuStrokes &&
+          c->userShaderVertex == NULL &&
+          c->userShaderFragment == NULL &&
+          c->strokeDashPattern.size < 2);
+}
+
+/*-----------------------------------------------------------
+ * Rebuilds the curve segments if the path data changed.
+ *-----------------------------------------------------------*/
+
+static void shUpdateCurves(SHPath *p)
+{
+  shValidatePathData(p);
+  
+  if (p->cacheCurvesValid == VG_FALSE) {
+    shBuildCurves(p);
+    p->cacheCurvesValid = VG_TRUE;
+    p->vboCurvesDirty = VG_TRUE;
+    p->cacheImplicitValid = VG_FALSE;
+  }
+}
+
+/*-----------------------------------------------------------
+ * Rebuilds the implicit fill triangles if the curve
+ * segments changed. They do not depend on the transform.
+ *-----------------------------------------------------------*/
+
+static void shUpdateImplicit(SHPath *p)
+{
+  shUpdateCurves(p);
+  
+  if (p->cacheImplicitValid == VG_FALSE) {
+    shBuildImplicit(p);
+    p->cacheImplicitValid = VG_TRUE;
+    p->vboImplicitDirty = VG_TRUE;
+  }
+}
+
+/*-----------------------------------------------------------
+ * Points the per-segment attributes of a vertex array at
+ * the curve segments starting from [first].
+ *-----------------------------------------------------------*/
+
+static void shSetupCurveArray(GLuint vao, GLuint vbo, SHint first)
+{
+  const GLsizei stride = sizeof(SHCurveSegment);
+  GLintptr base = first * sizeof(SHCurveSegment);
+  
+  glBindVertexArray(vao);
+  glBindBuffer(GL_ARRAY_BUFFER, vbo);
+  glEnableVertexAttribArray(SH_ATTRIB_CURVE_ENDS);
+  glEnableVertexAttribArray(SH_ATTRIB_CURVE_CTRL);
+  glEnableVertexAttribArray(SH_ATTRIB_CURVE_AXIS);
+  glEnableVertexAttribArray(SH_ATTRIB_CURVE_INFO);
+  glVertexAttribPointer(SH_ATTRIB_CURVE_ENDS, 4, GL_FLOAT, GL_FALSE, stride,
+                        (void*)(base + offsetof(SHCurveSegment, p0)));
+  glVertexAttribPointer(SH_ATTRIB_CURVE_CTRL, 4, GL_FLOAT, GL_FALSE, stride,
+                        (void*)(base + offsetof(SHCurveSegment, p1)));
+  glVertexAttribPointer(SH_ATTRIB_CURVE_AXIS, 4, GL_FLOAT, GL_FALSE, stride,
+                        (void*)(base + offsetof(SHCurveSegment, axis)));
+  glVertexAttribPointer(SH_ATTRIB_CURVE_INFO, 4, GL_FLOAT, GL_FALSE, stride,
+                        (void*)(base + offsetof(SHCurveSegment, type)));
+  glVertexAttribDivisor(SH_ATTRIB_CURVE_ENDS, 1);
+  glVertexAttribDivisor(SH_ATTRIB_CURVE_CTRL, 1);
+  glVertexAttribDivisor(SH_ATTRIB_CURVE_AXIS, 1);
+  glVertexAttribDivisor(SH_ATTRIB_CURVE_INFO, 1);
+}
+
+/*-----------------------------------------------------------
+ * Draws the fill fan of the path into the stencil with the
+ * curve program, one instance per segment, for the draw
+ * record submitted last. Lines need a single triangle, the
+ * curves as many as the vertex stage picks for their size
+ * on the surface. Leaves the draw program bound.
+ *-----------------------------------------------------------*/
+
+static void shDrawCurves(VGContext *c, SHPath *p)
+{
+  SHint curveCount = p->curves.size - p->curveLines;
+  
+  if (p->curves.size == 0) return;
+  
+  if (p->vboCurvesDirty) {
+    if (p->vboCurves == 0) {
+      glGenBuffers(1, &p->vboCurves);
+      glGenVertexArrays(1, &p->vaoCurveLines);
+      glGenVertexArrays(1, &p->vaoCurves);
+    }
+    
+    glBindBuffer(GL_ARRAY_BUFFER, p->vboCurves);
+    glBufferData(GL_ARRAY_BUFFER, p->curves.size * sizeof(SHCurveSegment),
+                 p->curves.items, GL_STATIC_DRAW);
+    shSetupCurveArray(p->vaoCurveLines, p->vboCurves, 0);
+    shSetupCurveArray(p->vaoCurves, p->vboCurves, p->curveLines);
+    p->vboCurvesDirty = VG_FALSE;
+  }
+  
+  shGLUseProgram(&c->gl, c->progCurve);
+  shGLUniform1i(&c->gl, c->locationCurve.drawIndex,
+                &c->gl.uniforms.curveDrawIndex, c->drawBlockLast);
+  glUniform2f(c->locationCurve.pivot,
+              p->curves.items[0].p0.x, p->curves.items[0].p0.y);
+  glUniform1f(c->locationCurve.tolerance, shFlattenTolerance(c, 1));
+  
+  if (p->curveLines > 0) {
+    glBindVertexArray(p->vaoCurveLines);
+    glDrawArraysInstanced(GL_TRIANGLES, 0, 3, p->curveLines);
+  }
+  
+  if (curveCount > 0) {
+    glBindVertexArray(p->vaoCurves);
+    glDrawArraysInstanced(GL_TRIANGLES, 0, 3 * SH_GPU_CURVE_SEGMENTS,
+                          curveCount);
+  }
+  
+  shGLUseProgram(&c->gl, c->progDraw);
+  GL_CEHCK_ERROR;
+}
+
+/*-----------------------------------------------------------
+ * Draws the implicit fill triangles of the path into the
+ * stencil for the draw record submitted last. Leaves the
+ * draw program bound.
+ *-----------------------------------------------------------*/
+
+static void shDrawImplicit(VGContext *c, SHPath *p)
+{
+  const GLsizei stride = sizeof(SHImplicitVertex);
+  
+  if (p->implicit.size == 0) return;
+  
+  if (p->vboImplicitDirty) {
+    if (p->vboImplicit == 0) {
+      glGenBuffers(1, &p->vboImplicit);
+      glGenVertexArrays(1, &p->vaoImplicit);
+      glBindVertexArray(p->vaoImplicit);
+      glBindBuffer(GL_ARRAY_BUFFER, p->vboImplicit);
+      glEnableVertexAttribArray(SH_ATTRIB_IMPLICIT_POS);
+      glEnableVertexAttribArray(SH_ATTRIB_IMPLICIT_COORD);
+      glEnableVertexAttribArray(SH_ATTRIB_IMPLICIT_WEIGHT);
+      glVertexAttribPointer(SH_ATTRIB_IMPLICIT_POS, 2, GL_FLOAT, GL_FALSE, stride,
+                            (void*)offsetof(SHImplicitVertex, point));
+      glVertexAttribPointer(SH_ATTRIB_IMPLICIT_COORD, 2, GL_FLOAT, GL_FALSE, stride,
+                            (void*)offsetof(SHImplicitVertex, coord));
+      glVertexAttribPointer(SH_ATTRIB_IMPLICIT_WEIGHT, 1, GL_FLOAT, GL_FALSE, stride,
+                            (void*)offsetof(SHImplicitVertex, weight));
+    }
+    
+    glBindBuffer(GL_ARRAY_BUFFER, p->vboImplicit);
+    glBufferData(GL_ARRAY_BUFFER, p->implicit.size * sizeof(SHImplicitVertex),
+                 p->implicit.items, GL_STATIC_DRAW);
+    p->vboImplicitDirty = VG_FALSE;
+  }
+  
+  shGLUseProgram(&c->gl, c->progImplicit);
+  shGLUniform1i(&c->gl, c->locationImplicit.drawIndex,
+                &c->gl.uniforms.implicitDrawIndex, c->drawBlockLast);
+  
+  glBindVertexArray(p->vaoImplicit);
+  glDrawArrays(GL_TRIANGLES, 0, p->implicit.size);
+  
+  shGLUseProgram(&c->gl, c->progDraw);
+  GL_CEHCK_ERROR;
+}
+
+/*-----------------------------------------------------------
+ * Rebuilds the polyline stroked on the GPU if the path got
+ * tessellated anew. The stroke style is not part of it.
+ *-----------------------------------------------------------*/
+
+static void shUpdateStrokeSegments(SHPath *p)
+{
+  if (p->strokeSegmentsGeneration != p->cacheTessGeneration) {
+    shBuildStrokeSegments(p);
+    p->strokeSegmentsGeneration = p->cacheTessGeneration;
+    p->vboStrokeSegmentsDirty = VG_TRUE;
+  }
+}
+
+/*-----------------------------------------------------------
+ * Draws the stroke of the path with the stroke program, one
+ * quad per polyline segment, for the draw record submitted
+ * last. [pass] tells the fragment stage whether to output
+ * coverage, clip at the outline or paint the whole quad.
+ * Leaves the draw program bound.
+ *-----------------------------------------------------------*/
+
+static void shDrawGPUStroke(VGContext *c, SHPath *p, GLint pass)
+{
+  const GLsizei stride = sizeof(SHStrokeSegment);
+  
+  if (p->strokeSegments.size == 0) return;
+  
+  if (p->vboStrokeSegmentsDirty) {
+    if (p->vboStrokeSegments == 0) {
+      glGenBuffers(1, &p->vboStrokeSegments);
+      glGenVertexArrays(1, &p->vaoStrokeSegments);
+      glBindVertexArray(p->vaoStrokeSegments);
+      glBindBuffer(GL_ARRAY_BUFFER, p->vboStrokeSegments);
+      glEnableVertexAttribArray(SH_ATTRIB_STROKE_ENDS);
+      glEnableVertexAttribArray(SH_ATTRIB_STROKE_NEXT);
+      glVertexAttribPointer(SH_ATTRIB_STROKE_ENDS, 4, GL_FLOAT, GL_FALSE, stride,
+                            (void*)offsetof(SHStrokeSegment, p0));
+      glVertexAttribPointer(SH_ATTRIB_STROKE_NEXT, 4, GL_FLOAT, GL_FALSE, stride,
+                            (void*)offsetof(SHStrokeSegment, next));
+      glVertexAttribDivisor(SH_ATTRIB_STROKE_ENDS, 1);
+      glVertexAttribDivisor(SH_ATTRIB_STROKE_NEXT, 1);
+    }
+    
+    glBindBuffer(GL_ARRAY_BUFFER, p->vboStrokeSegments);
+    glBufferData(GL_ARRAY_BUFFER, p->strokeSegments.size * sizeof(SHStrokeSegment),
+                 p->strokeSegments.items, GL_STATIC_DRAW);
+    p->vboStrokeSegmentsDirty = VG_FALSE;
+  }
+  
+  shGLUseProgram(&c->gl, c->progStroke);
+  shGLUniform1i(&c->gl, c->locationStroke.drawIndex,
+                &c->gl.uniforms.strokeDrawIndex, c->drawBlockLast);
+  glUniform4f(c->locationStroke.params,
+              c->strokeLineWidth / 2, c->strokeMiterLimit,
+              (GLfloat)(c->strokeCapStyle - VG_CAP_BUTT),
+              (GLfloat)(c->strokeJoinStyle - VG_JOIN_MITER));
+  glUniform1i(c->locationStroke.pass, pass);
+  
+  glBindVertexArray(p->vaoStrokeSegments);
+  glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, p->strokeSegments.size);
+  
+  shGLUseProgram(&c->gl, c->progDraw);
+  GL_CEHCK_ERROR;
+}
+
+/*--------------------------------------------------------------
+ * Draws the cover triangles of a fill or stroke. The paint of
+ * the current draw record fills them where the stencil allows.
+ *--------------------------------------------------------------*/
+
+static void shDrawPaintMesh(VGContext *c, SHVector2Array *cover,
+                            GLsizei instances)
+{
+  GLintptr offset;
+  
+  if (cover->size == 0) return;
+  
+  offset = shStreamVertices(c, cover->items, cover->size * sizeof(SHVector2));
+  glVertexAttribPointer(SH_ATTRIB_POS, 2, GL_FLOAT, GL_FALSE, 0, (void*)offset);
+  glDrawArraysInstanced(GL_TRIANGLES, 0, cover->size, instances);
+  GL_CEHCK_ERROR;
+}
+
+/*-----------------------------------------------------------
+ * Returns the power-of-two scale level the path has to be
+ * flattened at to meet the tolerance under the current
+ * path transformation.
+ *-----------------------------------------------------------*/
+
+static SHint shTessScaleLevel(VGContext *c)
+{
+  SHfloat sx, sy;
+  int e;
+  
+  sx = SH_SQRT(c->pathTransform.m[0][0] * c->pathTransform.m[0][0] +
+               c->pathTransform.m[1][0] * c->pathTransform.m[1][0]);
+  sy = SH_SQRT(c->pathTransform.m[0][1] * c->pathTransform.m[0][1] +
+               c->pathTransform.m[1][1] * c->pathTransform.m[1][1]);
+  sx = SH_MAX(sx, sy);
+  
+  if (!(sx > ldexp(1.0, -SH_MAX_TESS_LEVEL))) return -SH_MAX_TESS_LEVEL;
+  if (!(sx < ldexp(1.0, SH_MAX_TESS_LEVEL))) return SH_MAX_TESS_LEVEL;
+  
+  /* Round log2 up so the level is never too coarse */
+  if (frexp((double)sx, &e) == 0.5) --e;
+  return (SHint)e;
+}
+
+VGboolean shIsTessCacheValid (SHPath *p, SHint level,
+                               VGRenderingQuality quality)
+{
+  VGboolean valid = VG_TRUE;
+
+  shValidatePathData(p);
+  
+  if (p->cacheLevelInit == VG_FALSE) {
+    valid = VG_FALSE;
+  }
+  else if (p->cacheRenderingQuality != quality) {
+    valid = VG_FALSE;
+  }
+  else if (p->cacheLevel < level || p->cacheLevel > level + 1) {
+    
+    /* Too coarse, or finer than needed by more
+       than one level */
+    valid = VG_FALSE;
+  }
+  
+  return valid;
+}
+
+/*-----------------------------------------------------------
+ * Exchanges the geometry in use with a cached tessellation
+ * of the given scale level. Returns VG_FALSE when no such
+ * level is cached, in which case the geometry in use has
+ * been stashed away and the path must be re-flattened.
+ *-----------------------------------------------------------*/
+
+static VGboolean shSwapTessLevel(SHPath *p, SHint level,
+                                 VGRenderingQuality quality)
+{
+  SHTessLevel *t, *slot = NULL;
+  SHTessLevel tmp;
+  VGboolean found;
+  SHint i;
+  
+  /* Coarsest cached level that is fine enough */
+  for (i=0; i<p->tessLevelCount; ++i) {
+    t = &p->tessLevels[i];
+    if (t->quality != quality ||
+        t->level < level || t->level > level + 1) continue;
+    if (slot == NULL || t->level < slot->level) slot = t;
+  }
+  
+  found = (slot != NULL);
+  if (!found) {
+    
+    /* Nothing worth keeping in use */
+    if (p->cacheLevelInit == VG_FALSE) return VG_FALSE;
+    
+    /* Stash into a free or the least recently used slot */
+    if (p->tessLevelCount < SH_MAX_TESS_LEVELS) {
+      slot = &p->tessLevels[p->tessLevelCount++];
+    }else{
+      slot = &p->tessLevels[0];
+      for (i=1; i<p->tessLevelCount; ++i)
+        if (p->tessLevels[i].stamp < slot->stamp)
+          slot = &p->tessLevels[i];
+    }
+  }
+  
+  /* Swap storage so neither side gets reallocated */
+  tmp = *slot;
+  slot->level = p->cacheLevel;
+  slot->quality = p->cacheRenderingQuality;
+  slot->generation = p->cacheTessGeneration;
+  slot->tolerance = p->cacheTolerance;
+  slot->stamp = ++p->tessStamp;
+  slot->vertices = p->vertices;
+  slot->vertexFlags = p->vertexFlags;
+  slot->contours = p->contours;
+  slot->min = p->min;
+  slot->max = p->max;
+  slot->convex = p->convex;
+  slot->fillCover = p->fillCover;
+  slot->tessContours = p->tessContours;
+  slot->tessCursor = p->tessCursor;
+  
+  p->vertices = tmp.vertices;
+  p->vertexFlags = tmp.vertexFlags;
+  p->contours = tmp.contours;
+  p->min = tmp.min;
+  p->max = tmp.max;
+  p->convex = tmp.convex;
+  p->fillCover = tmp.fillCover;
+  p->tessContours = tmp.tessContours;
+  p->tessCursor = tmp.tessCursor;
+  if (found) {
+    p->cacheLevel = tmp.level;
+    p->cacheTessGeneration = tmp.generation;
+    p->cacheTolerance = tmp.tolerance;
+  }
+  
+  /* Geometry in use was not a valid level, so the slot
+     only holds its storage now */
+  if (found && p->cacheLevelInit == VG_FALSE) {
+    tmp = *slot;
+    *slot = p->tessLevels[--p->tessLevelCount];
+    p->tessLevels[p->tessLevelCount] = tmp;
+  }
+  
+  return found;
+}
+
+/*-----------------------------------------------------------
+ * Reads the stroke style from the context state.
+ *-----------------------------------------------------------*/
+
+static void shGetStrokeStyle(VGContext *c, SHStrokeStyle *s)
+{
+  s->lineWidth = c->strokeLineWidth;
+  s->capStyle = c->strokeCapStyle;
+  s->joinStyle = c->strokeJoinStyle;
+  s->miterLimit = c->strokeMiterLimit;
+  s->dashPattern = c->strokeDashPattern.items;
+  s->dashCount = c->strokeDashPattern.size;
+  s->dashHash = c->strokeDashHash;
+  s->dashPhase = c->strokeDashPhase;
+  s->dashPhaseReset = c->strokeDashPhaseReset;
+}
+
+/*-----------------------------------------------------------
+ * Collects the parameters that stroke geometry depends on.
+ * Strokes built on another tessellation of the path never
+ * match thanks to the generation.
+ *-----------------------------------------------------------*/
+
+static void shGetStrokeKey(const SHStrokeStyle *s, SHPath *p,
+                           SHStrokeKey *key)
+{
+  key->tessGeneration = p->cacheTessGeneration;
+  key->lineWidth = s->lineWidth;
+  key->capStyle = s->capStyle;
+  key->joinStyle = s->joinStyle;
+  key->miterLimit = s->miterLimit;
+  key->dashCount = s->dashCount;
+  
+  /* Dash state matters only when dashing */
+  if (key->dashCount > 0) {
+    key->dashHash = s->dashHash;
+    key->dashPhase = s->dashPhase;
+    key->dashPhaseReset = s->dashPhaseReset;
+  }else{
+    key->dashHash = 0;
+    key->dashPhase = 0.0f;
+    key->dashPhaseReset = VG_FALSE;
+  }
+}
+
+static VGboolean shStrokeKeyEqual(const SHStrokeKey *a, const SHStrokeKey *b)
+{
+  return (a->tessGeneration == b->tessGeneration &&
+          a->lineWidth == b->lineWidth &&
+          a->capStyle == b->capStyle &&
+          a->joinStyle == b->joinStyle &&
+          a->miterLimit == b->miterLimit &&
+          a->dashCount == b->dashCount &&
+          a->dashHash == b->dashHash &&
+          a->dashPhase == b->dashPhase &&
+          a->dashPhaseReset == b->dashPhaseReset);
+}
+
+/*-----------------------------------------------------------
+ * Strokes keep a copy of the dash pattern they were built
+ * with. Keys found equal still get their patterns compared,
+ * the hash only rejects different patterns quickly.
+ *-----------------------------------------------------------*/
+
+static VGboolean shDashPatternEqual(const SHStrokeKey *key,
+                                    const SHfloat *a, const SHfloat *b)
+{
+  return (key->dashCount == 0 ||
+          memcmp(a, b, key->dashCount * sizeof(SHfloat)) == 0);
+}
+
+static int shCopyDashPattern(SHFloatArray *dst, const SHfloat *pattern,
+                             SHint count)
+{
+  shFloatArrayClear(dst);
+  if (!shFloatArrayReserve(dst, SH_MAX(count, 1)))
+    return 0;
+  
+  memcpy(dst->items, pattern, count * sizeof(SHfloat));
+  dst->size = count;
+  return 1;
+}
+
+VGboolean shIsStrokeCacheValid (SHPath *p, const SHStrokeKey *key,
+                                const SHfloat *dashPattern)
+{
+  VGboolean valid = VG_TRUE;
+
+  if (p->cacheStrokeInit == VG_FALSE) {
+    valid = VG_FALSE;
+  }
+  else if (!shStrokeKeyEqual(&p->cacheStroke, key) ||
+           !shDashPatternEqual(key, dashPattern, p->cacheStrokeDash.items)) {
+    valid = VG_FALSE;
+  }
+
+  return valid;
+}
+
+/*-----------------------------------------------------------
+ * Exchanges the stroke in use with a cached one built for
+ * the given key. Returns VG_FALSE when there is none, in
+ * which case the stroke in use has been stashed away and
+ * the path must be re-stroked.
+ *-----------------------------------------------------------*/
+
+static VGboolean shSwapStrokeEntry(SHPath *p, const SHStrokeKey *key,
+                                   const SHfloat *dashPattern)
+{
+  SHStrokeEntry *e, *slot = NULL;
+  SHStrokeEntry tmp;
+  VGboolean found;
+  SHint i;
+  
+  for (i=0; i<p->strokeEntryCount; ++i) {
+    e = &p->strokeEntries[i];
+    if (shStrokeKeyEqual(&e->key, key) &&
+        shDashPatternEqual(key, dashPattern, e->dash.items)) {
+      slot = e; break;
+    }
+  }
+  
+  found = (slot != NULL);
+  if (!found) {
+    
+    /* Nothing worth keeping in use */
+    if (p->cacheStrokeInit == VG_FALSE) return VG_FALSE;
+    
+    /* Stash into a free or the least recently used slot */
+    if (p->strokeEntryCount < SH_MAX_STROKE_ENTRIES) {
+      slot = &p->strokeEntries[p->strokeEntryCount++];
+    }else{
+      slot = &p->strokeEntries[0];
+      for (i=1; i<p->strokeEntryCount; ++i)
+        if (p->strokeEntries[i].stamp < slot->stamp)
+          slot = &p->strokeEntries[i];
+    }
+  }
+  
+  /* Swap storage so neither side gets reallocated */
+  tmp = *slot;
+  slot->key = p->cacheStroke;
+  slot->dash = p->cacheStrokeDash;
+  slot->stamp = ++p->strokeStamp;
+  slot->stroke = p->stroke;
+  slot->strokeIndices = p->strokeIndices;
+  slot->strokeIndexSize = p->strokeIndexSize;
+  slot->strokeCover = p->strokeCover;
+  slot->strokeMin = p->strokeMin;
+  slot->strokeMax = p->strokeMax;
+  slot->strokeContours = p->strokeContours;
+  slot->strokeTail = p->strokeTail;
+  
+  p->cacheStrokeDash = tmp.dash;
+  p->stroke = tmp.stroke;
+  p->strokeIndices = tmp.strokeIndices;
+  p->strokeIndexSize = tmp.strokeIndexSize;
+  p->strokeCover = tmp.strokeCover;
+  p->strokeMin = tmp.strokeMin;
+  p->strokeMax = tmp.strokeMax;
+  p->strokeContours = tmp.strokeContours;
+  p->strokeTail = tmp.strokeTail;
+  
+  /* Stroke in use was not valid, so the slot only
+     holds its storage now */
+  if (found && p->cacheStrokeInit == VG_FALSE) {
+    tmp = *slot;
+    *slot = p->strokeEntries[--p->strokeEntryCount];
+    p->strokeEntries[p->strokeEntryCount] = tmp;
+  }
+  
+  return found;
+}
+
+/*-----------------------------------------------------------
+ * Re-tessellates the path if the tessellation cache is not
+ * valid for the given scale level and quality. Touches
+ * nothing but the path, so it may run on a worker thread.
+ *-----------------------------------------------------------*/
+
+static void shUpdateVerticesAt(SHPath *p, SHint level,
+                               VGRenderingQuality quality, SHfloat tol)
+{
+  /* Tessellate in user space at the tolerance of the scale
+     level, reusing a cached level when zooming back */
+  if (shIsTessCacheValid( p, level, quality ) == VG_FALSE)
+  {
+    if (shSwapTessLevel(p, level, quality) == VG_FALSE) {
+      shFlattenPath(p, tol);
+      shBuildFillCover(p);
+      p->cacheLevel = level;
+      p->cacheTessGeneration = ++p->tessGenerationCount;
+      p->cacheTolerance = tol;
+    }
+    
+    p->cacheLevelInit = VG_TRUE;
+    p->cacheRenderingQuality = quality;
+    
+    /* Paths rebuilt on consecutive draws get streamed */
+    p->vboVerticesDirty = VG_TRUE;
+    p->vboVerticesRebuilds++;
+  }else p->vboVerticesRebuilds = 0;
+}
+
+/*-----------------------------------------------------------
+ * Rebuilds the stroke triangles if the stroke cache is not
+ * valid for the given stroke style. Touches nothing but the
+ * path and the style, so it may run on a worker thread.
+ * Returns 0 and leaves the stroke cache invalid if memory
+ * ran out.
+ *-----------------------------------------------------------*/
+
+static int shUpdateStrokeWith(SHPath *p, const SHStrokeStyle *s)
+{
+  SHStrokeKey key;
+  
+  shGetStrokeKey(s, p, &key);
+  if (shIsStrokeCacheValid( p, &key, s->dashPattern ) == VG_FALSE)
+  {
+    if (shSwapStrokeEntry(p, &key, s->dashPattern) == VG_FALSE) {
+      
+      /* Generate stroke triangles in user space, keeping
+         the dash pattern they were generated with */
+      if (!shStrokePath(s, p->cacheTolerance, p) ||
+          !shCopyDashPattern(&p->cacheStrokeDash, s->dashPattern,
+                             s->dashCount)) {
+        p->cacheStrokeInit = VG_FALSE;
+        p->vboStrokeDirty = VG_TRUE;
+        return 0;
+      }
+      
+      shBuildStrokeCover(p);
+    }
+    
+    p->cacheStrokeInit = VG_TRUE;
+    p->cacheStroke = key;
+    p->vboStrokeDirty = VG_TRUE;
+    p->vboStrokeRebuilds++;
+  }else p->vboStrokeRebuilds = 0;
+  
+  return 1;
+}
+
+/*-----------------------------------------------------------
+ * Brings the tessellation and the stroke up to date with
+ * the context state.
+ *-----------------------------------------------------------*/
+
+static SHfloat shTessLevelTolerance(VGContext *c, SHint level)
+{
+  return (SHfloat)ldexp(shFlattenTolerance(c, 1), -level);
+}
+
+static void shUpdateVertices(VGContext *c, SHPath *p)
+{
+  SHint level = shTessScaleLevel(c);
+  shUpdateVerticesAt(p, level, c->renderingQuality,
+                     shTessLevelTolerance(c, level));
+}
+
+static int shUpdateStroke(VGContext *c, SHPath *p)
+{
+  SHStrokeStyle s;
+  shGetStrokeStyle(c, &s);
+  return shUpdateStrokeWith(p, &s);
+}
+
+/*-----------------------------------------------------------
+ * Appends [count] points to a deferred vertex stream,
+ * growing its storage geometrically.
+ *-----------------------------------------------------------*/
+
+static int shPushDrawVertices(SHVector2Array *a, const SHVector2 *v,
+                              SHint count)
+{
+  if (a->size + count > a->capacity) {
+    if (!shVector2ArrayReserveAndCopy(a, SH_MAX(a->capacity * 2, a->size + count)))
+      return 0;
+  }
+  
+  memcpy(a->items + a->size, v, count * sizeof(SHVector2));
+  a->size += count;
+  return 1;
+}
+
+/*-----------------------------------------------------------
+ * Appends the 16- or 32-bit [indices] to a deferred index
+ * stream, adding [base] to each.
+ *-----------------------------------------------------------*/
+
+static int shPushDrawIndices(SHIntArray *a, const SHUint8Array *indices,
+                             SHint indexSize, SHint base)
+{
+  SHint count = indices->size / indexSize;
+  SHint *dst;
+  SHint i;
+  
+  if (a->size + count > a->capacity) {
+    if (!shIntArrayReserveAndCopy(a, SH_MAX(a->capacity * 2, a->size + count)))
+      return 0;
+  }
+  
+  dst = a->items + a->size;
+  if (indexSize == 2) {
+    const SHuint16 *src = (const SHuint16*)indices->items;
+    for (i=0; i<count; ++i) dst[i] = base + src[i];
+  }else{
+    const SHuint32 *src = (const SHuint32*)indices->items;
+    for (i=0; i<count; ++i) dst[i] = base + (SHint)src[i];
+  }
+  
+  a->size += count;
+  return 1;
+}
+
+/*-----------------------------------------------------------
+ * Copies the stencil and cover geometry of a recorded
+ * command into the deferred vertex streams.
+ *-----------------------------------------------------------*/
+
+static int shCopyDrawGeometry(VGContext *c, SHDrawCommand *cmd, SHPath *p)
+{
+  SHVector2Array *cover;
+  SHint start, i;
+  int ok = 1;
+  
+  /* Stroke may have failed to build on a worker thread */
+  if (cmd->mode == VG_STROKE_PATH && p->cacheStrokeInit == VG_FALSE)
+    return 0;
+  
+  if (cmd->mode == VG_FILL_PATH)
+    cmd->direct = p->convex;
+  
+  cmd->rangeFirst = c->drawFirsts.size;
+  cmd->indexFirst = c->drawIndices.size;
+  
+  if (cmd->mode == VG_FILL_PATH) {
+    
+    /* One range per contour (drawn as triangle fans) */
+    for (i=0, start=c->drawVertices.size; i<p->contours.size && ok; ++i) {
+      ok = shIntArrayPushBack(&c->drawFirsts, start) &&
+           shIntArrayPushBack(&c->drawCounts, p->contours.items[i]);
+      start += p->contours.items[i];
+    }
+    ok = ok && shPushDrawVertices(&c->drawVertices, p->vertices.items,
+                                  p->vertices.size);
+    
+  }else{
+    
+    /* Stroke indices get rebased onto the vertex stream */
+    ok = shPushDrawIndices(&c->drawIndices, &p->strokeIndices,
+                           p->strokeIndexSize, c->drawVertices.size) &&
+         shPushDrawVertices(&c->drawVertices, p->stroke.items,
+                            p->stroke.size);
+  }
+  
+  cmd->rangeCount = c->drawFirsts.size - cmd->rangeFirst;
+  cmd->indexCount = c->drawIndices.size - cmd->indexFirst;
+  
+  /* Direct draws need no cover */
+  cover = (cmd->mode == VG_FILL_PATH ? &p->fillCover : &p->strokeCover);
+  cmd->coverFirst = c->drawCovers.size;
+  cmd->coverCount = (cmd->direct ? 0 : cover->size);
+  ok = ok && shPushDrawVertices(&c->drawCovers, cover->items,
+                                cmd->coverCount);
+  
+  /* Tight bounds of the stencil geometry */
+  if (cmd->mode == VG_FILL_PATH) {
+    SET2V(cmd->min, p->min); SET2V(cmd->max, p->max);
+  }else{
+    SET2V(cmd->min, p->strokeMin); SET2V(cmd->max, p->strokeMax);
+  }
+  SUB2(cmd->min, SH_COVER_PADDING, SH_COVER_PADDING);
+  ADD2(cmd->max, SH_COVER_PADDING, SH_COVER_PADDING);
+  
+  return ok;
+}
+
+/*-----------------------------------------------------------
+ * Records one stencil-then-cover pass of a path painted
+ * with a color paint. Paint color and transform are copied
+ * so the paint may change before the command is submitted.
+ * Geometry is copied too, unless the path is queued for
+ * the worker threads, in which case it gets copied at flush
+ * and the path must not change until then.
+ *-----------------------------------------------------------*/
+
+static void shRecordDrawCommand(VGContext *c, SHPath *p,
+                                VGPaintMode mode, SHPaint *paint)
+{
+  SHDrawCommand cmd;
+  int ok = 1;
+  
+  cmd.mode = mode;
+  cmd.color = paint->color;
+  cmd.blendMode = c->blendMode;
+  cmd.fillRule = c->fillRule;
+  cmd.direct = (mode == VG_FILL_PATH ? VG_FALSE :
+                shIsStrokeDirect(c->blendMode, paint->color.a == 1.0f));
+  cmd.transform = c->pathTransform;
+  cmd.scissoring = c->scissoring;
+  if (c->scissoring) cmd.scissor = c->scissor.items[0];
+  
+  if (p->pending) {
+    cmd.path = p;
+    cmd.rangeFirst = cmd.rangeCount = 0;
+    cmd.indexFirst = cmd.indexCount = 0;
+    cmd.coverFirst = cmd.coverCount = 0;
+  }else{
+    cmd.path = NULL;
+    ok = shCopyDrawGeometry(c, &cmd, p);
+  }
+  
+  if (!ok || !shDrawCommandArrayPushBackP(&c->drawCommands, &cmd))
+    shSetError(c, VG_OUT_OF_MEMORY_ERROR);
+}
+
+/*-----------------------------------------------------------
+ * Queues the path for tessellation (and stroking) on the
+ * worker threads at the next flush, with a snapshot of the
+ * parameters it depends on. Returns VG_FALSE if the path is
+ * queued already with parameters that do not match.
+ *-----------------------------------------------------------*/
+
+static VGboolean shQueuePendingPath(VGContext *c, SHPath *p,
+                                    VGboolean doStroke)
+{
+  SHStrokeStyle s;
+  SHStrokeKey a, b;
+  SHint level = shTessScaleLevel(c);
+  
+  shGetStrokeStyle(c, &s);
+  
+  if (p->pending) {
+    
+    /* A path holds one tessellation and one stroke at once */
+    if (p->pendingLevel != level ||
+        p->pendingQuality != c->renderingQuality)
+      return VG_FALSE;
+    
+    if (doStroke && p->pendingStroke) {
+      shGetStrokeKey(&p->pendingStyle, p, &a);
+      shGetStrokeKey(&s, p, &b);
+      if (!shStrokeKeyEqual(&a, &b) ||
+          !shDashPatternEqual(&a, p->pendingStyle.dashPattern, s.dashPattern))
+        return VG_FALSE;
+    }
+    
+  }else{
+    
+    if (!shPathArrayPushBack(&c->pendingPaths, p))
+      return VG_FALSE;
+    
+    p->pending = VG_TRUE;
+    p->pendingLevel = level;
+    p->pendingQuality = c->renderingQuality;
+    p->pendingTolerance = shTessLevelTolerance(c, level);
+    p->pendingStroke = VG_FALSE;
+  }
+  
+  if (doStroke && !p->pendingStroke) {
+    
+    /* Dash pattern may change before the flush */
+    if (!shCopyDashPattern(&p->pendingDash, s.dashPattern, s.dashCount))
+      return VG_FALSE;
+    
+    p->pendingStyle = s;
+    p->pendingStyle.dashPattern = p->pendingDash.items;
+    p->pendingStroke = VG_TRUE;
+  }
+  
+  return VG_TRUE;
+}
+
+static void shRunPendingPath(void *item)
+{
+  SHPath *p = *(SHPath**)item;
+  
+  shUpdateVerticesAt(p, p->pendingLevel, p->pendingQuality,
+                     p->pendingTolerance);
+  
+  if (p->pendingStroke)
+    shUpdateStrokeWith(p, &p->pendingStyle);
+}
+
 /*-----------------------------------------------------------
- * Draws the triangles representing the stroke of a path.
+ * Submits recorded draws before a queued path changes.
  *-----------------------------------------------------------*/
 
-static void shDrawStroke(SHPath *p)
+void shFlushPendingPath(VGContext *c, SHPath *p)
 {
-  VG_GETCONTEXT(VG_NO_RETVAL);
-  glEnableVertexAttribArray(context->locationDraw.pos);
-  glVertexAttribPointer(context->locationDraw.pos, 2, GL_FLOAT, GL_FALSE, 0, p->stroke.items);
-  glDrawArrays(GL_TRIANGLES, 0, p->stroke.size);
-  glDisableVertexAttribArray(context->locationDraw.pos);
-  GL_CEHCK_ERROR;
+  if (p->pending)
+    shFlushDrawCommands(c);
 }
 
 /*-----------------------------------------------------------
- * Draws the subdivided vertices in the OpenGL mode given
- * (this could be VG_TRIANGLE_FAN or VG_LINE_STRIP).
+ * Returns true if two recorded commands can be drawn within
+ * the same stencil and cover pass.
  *-----------------------------------------------------------*/
 
-static void shDrawVertices(SHPath *p, GLenum mode)
+static int shCanMergeDrawCommands(SHDrawCommand *a, SHDrawCommand *b)
 {
-  int start = 0;
-  int size = 0;
+  int i,j;
   
-  /* We separate vertex arrays by contours to properly
-     handle the fill modes */
-  VG_GETCONTEXT(VG_NO_RETVAL);
-  glEnableVertexAttribArray(context->locationDraw.pos);
-  glVertexAttribPointer(context->locationDraw.pos, 2, GL_FLOAT, GL_FALSE, sizeof(SHVertex), p->vertices.items);
+  if (a->mode != b->mode ||
+      a->blendMode != b->blendMode ||
+      a->fillRule != b->fillRule ||
+      a->direct != b->direct ||
+      a->scissoring != b->scissoring)
+    return 0;
   
-  while (start < p->vertices.size) {
-    size = p->vertices.items[start].flags;
-    glDrawArrays(mode, start, size);
-    start += size;
-  }
+  if (a->color.r != b->color.r || a->color.g != b->color.g ||
+      a->color.b != b->color.b || a->color.a != b->color.a)
+    return 0;
   
-  glDisableVertexAttribArray(context->locationDraw.pos);
-  GL_CEHCK_ERROR;
-}
-
-/*--------------------------------------------------------------
- * Constructs & draws colored OpenGL primitives that cover the
- * given bounding box to represent the currently selected
- * stroke or fill paint
- *--------------------------------------------------------------*/
-
-static void shDrawPaintMesh(VGContext *c, SHVector2 *min, SHVector2 *max,
-                            VGPaintMode mode, GLenum texUnit)
-{
-  SHPaint *p;
-  SHVector2 pmin, pmax;
-  SHfloat K = 1.0f;
+  if (a->scissoring &&
+      (a->scissor.x != b->scissor.x || a->scissor.y != b->scissor.y ||
+       a->scissor.w != b->scissor.w || a->scissor.h != b->scissor.h))
+    return 0;
   
-  /* Pick the right paint */
-  if (mode == VG_FILL_PATH) {
-    p = (c->fillPaint ? c->fillPaint : &c->defaultPaint);
-  }else if (mode == VG_STROKE_PATH) {
-    p = (c->strokePaint ? c->strokePaint : &c->defaultPaint);
-    K = SH_CEIL(c->strokeMiterLimit * c->strokeLineWidth) + 1.0f;
-  }
+  for (i=0; i<3; ++i)
+    for (j=0; j<3; ++j)
+      if (a->transform.m[i][j] != b->transform.m[i][j])
+        return 0;
   
-  /* We want to be sure to cover every pixel of this path so better
-     take a pixel more than leave some out (multisampling is tricky). */
-  SET2V(pmin, (*min)); SUB2(pmin, K,K);
-  SET2V(pmax, (*max)); ADD2(pmax, K,K);
+  return 1;
+}
 
-  /* Construct appropriate OpenGL primitives so as
-     to fill the stencil mask with select paint */
+static int shDrawCommandsOverlap(SHDrawCommand *a, SHDrawCommand *b)
+{
+  return (a->min.x <= b->max.x && b->min.x <= a->max.x &&
+          a->min.y <= b->max.y && b->min.y <= a->max.y);
+}
 
-  switch (p->type) {
-  case VG_PAINT_TYPE_LINEAR_GRADIENT:
-    shLoadLinearGradientMesh(p, mode, VG_MATRIX_PATH_USER_TO_SURFACE);
-    break; 
+/*-----------------------------------------------------------
+ * Draws the stencil geometry of commands [first] to [last]:
+ * one fan per fill contour, or the stroke triangles.
+ *-----------------------------------------------------------*/
 
-  case VG_PAINT_TYPE_RADIAL_GRADIENT:
-    shLoadRadialGradientMesh(p, mode, VG_MATRIX_PATH_USER_TO_SURFACE);
-    break; 
-    
-  case VG_PAINT_TYPE_PATTERN:
-    if (p->pattern != VG_INVALID_HANDLE) {
-    shLoadPatternMesh(p, mode, VG_MATRIX_PATH_USER_TO_SURFACE);
-      break;
-    }/* else behave as a color paint */
-  
-  case VG_PAINT_TYPE_COLOR:
-    shLoadOneColorMesh(p);
-    break;  
+static void shDrawCommandGeometry(VGContext *c, SHDrawCommand *first,
+                                  SHDrawCommand *last, GLintptr indexOffset)
+{
+  if (first->mode == VG_FILL_PATH) {
+    glMultiDrawArrays(GL_TRIANGLE_FAN,
+                      c->drawFirsts.items + first->rangeFirst,
+                      c->drawCounts.items + first->rangeFirst,
+                      last->rangeFirst + last->rangeCount - first->rangeFirst);
+  }else{
+    glDrawElements(GL_TRIANGLES,
+                   last->indexFirst + last->indexCount - first->indexFirst,
+                   GL_UNSIGNED_INT,
+                   (void*)(indexOffset + first->indexFirst * sizeof(SHint)));
   }
-
-  GLfloat v[] = { pmin.x, pmin.y,
-                  pmax.x, pmin.y,
-                  pmin.x, pmax.y,
-                  pmax.x, pmax.y };
-  glEnableVertexAttribArray(c->locationDraw.pos);
-  glVertexAttribPointer(c->locationDraw.pos, 2, GL_FLOAT, GL_FALSE, 0, v);
-  glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
-  glDisableVertexAttribArray(c->locationDraw.pos);
-  GL_CEHCK_ERROR;
 }
 
-VGboolean shIsTessCacheValid (VGContext *c, SHPath *p)
-{
-  SHfloat nX, nY;
-  SHVector2 X, Y;
-  SHMatrix3x3 mi, mchange;
-  VGboolean valid = VG_TRUE;
+/*-----------------------------------------------------------
+ * Submits recorded draw commands. Consecutive commands with
+ * identical state whose bounds do not overlap are
+ * merged into a single stencil pass and a single cover pass.
+ * All geometry is uploaded at once, draw records once per
+ * batch of SH_DRAW_RECORDS groups.
+ *-----------------------------------------------------------*/
 
-  if (p->cacheDataValid == VG_FALSE) {
-    valid = VG_FALSE;
-  }
-  else if (p->cacheTransformInit == VG_FALSE) {
-    valid = VG_FALSE;
+void shFlushDrawCommands(VGContext *c)
+{
+  SHDrawCommand *cmds = c->drawCommands.items;
+  SHDrawCommand *first, *last;
+  SHDrawRecord records[SH_DRAW_RECORDS];
+  SHint ends[SH_DRAW_RECORDS];
+  SHint count = c->drawCommands.size;
+  SHint coverStart;
+  SHint i, j, k, g, n, start, base;
+  GLintptr offset, indexOffset;
+  
+  if (count == 0 && c->pendingPaths.size == 0) return;
+  
+  /* Tessellate queued paths in parallel, then copy their
+     geometry in command order */
+  if (c->pendingPaths.size > 0) {
+    shRunWorkerPool(&c->workers, shRunPendingPath, c->pendingPaths.items,
+                    sizeof(SHPath*), c->pendingPaths.size);
+    
+    for (i=0; i<count; ++i) {
+      if (cmds[i].path == NULL) continue;
+      if (!shCopyDrawGeometry(c, &cmds[i], cmds[i].path)) {
+        shSetError(c, VG_OUT_OF_MEMORY_ERROR);
+        shDiscardDrawCommands(c);
+        return;
+      }
+    }
   }
-  else if (shInvertMatrix( &p->cacheTransform, &mi ) == VG_FALSE) {
-    valid = VG_FALSE;
+  
+  if (count == 0) {
+    shDiscardDrawCommands(c);
+    return;
   }
-  else
-  {
-    /* TODO: Compare change matrix for any scale or shear  */
-    MULMATMAT( c->pathTransform, mi, mchange );
-    SET2( X, mi.m[0][0], mi.m[1][0] );
-    SET2( Y, mi.m[0][1], mi.m[1][1] );
-    nX = NORM2( X ); nY = NORM2( Y );
-    if (nX > 1.01f || nX < 0.99 ||
-        nY > 1.01f || nY < 0.99)
-      valid = VG_FALSE;
+  
+  /* Append cover triangles behind the stencil geometry */
+  coverStart = c->drawVertices.size;
+  if (!shPushDrawVertices(&c->drawVertices, c->drawCovers.items,
+                          c->drawCovers.size)) {
+    shSetError(c, VG_OUT_OF_MEMORY_ERROR);
+    shDiscardDrawCommands(c);
+    return;
   }
-
-  if (valid == VG_FALSE)
-  {
-    /* Update cache */
-    p->cacheDataValid = VG_TRUE;
-    p->cacheTransformInit = VG_TRUE;
-    p->cacheTransform = c->pathTransform;
-    p->cacheStrokeTessValid = VG_FALSE;
+  
+  offset = shStreamMesh(c, c->drawVertices.items,
+                        c->drawVertices.size * sizeof(SHVector2),
+                        c->drawIndices.items,
+                        c->drawIndices.size * sizeof(SHint), &indexOffset);
+  glVertexAttribPointer(SH_ATTRIB_POS, 2, GL_FLOAT, GL_FALSE, 0, (void*)offset);
+  
+  shGLUseProgram(&c->gl, c->progDraw);
+  
+  for (i=0; i<count; i=ends[g-1]) {
+    
+    /* Group consecutive commands while state matches and
+       nothing overlaps, one draw record per group */
+    for (g=0, j=i; g<SH_DRAW_RECORDS && j<count; ++g) {
+      start = j;
+      first = &cmds[start];
+      for (++j; j<count; ++j) {
+        if (!shCanMergeDrawCommands(first, &cmds[j])) break;
+        
+        /* Direct strokes write without blending: overlaps
+           within the group give the same result */
+        if (first->direct && first->mode == VG_STROKE_PATH) continue;
+        
+        for (k=start; k<j; ++k)
+          if (shDrawCommandsOverlap(&cmds[k], &cmds[j])) break;
+        if (k < j) break;
+      }
+      ends[g] = j;
+      
+      shBeginDrawRecord(&records[g], &first->transform, 0);
+      records[g].paintType = VG_PAINT_TYPE_COLOR;
+      records[g].paintColor[0] = first->color.r;
+      records[g].paintColor[1] = first->color.g;
+      records[g].paintColor[2] = first->color.b;
+      records[g].paintColor[3] = first->color.a;
+    }
+    
+    /* Upload all records of this batch at once */
+    base = shUploadDrawRecords(c, records, g);
+    
+    for (n=0, j=i; n<g; ++n) {
+      first = &cmds[j];
+      last = &cmds[ends[n]-1];
+      
+      shGLUniform1i(&c->gl, c->locationDraw.drawIndex,
+                    &c->gl.uniforms.drawIndex, base + n);
+      
+      if (first->scissoring) {
+        shGLScissor(&c->gl, (GLint)first->scissor.x, (GLint)first->scissor.y,
+                    (GLint)first->scissor.w, (GLint)first->scissor.h );
+        shGLEnable(&c->gl, GL_SCISSOR_TEST);
+      }else shGLDisable(&c->gl, GL_SCISSOR_TEST);
+      
+      if (first->mode == VG_STROKE_PATH) {
+        if (first->direct) c->strokesDirect += ends[n] - j;
+        else c->strokesStenciled += ends[n] - j;
+      }
+      
+      if (first->direct) {
+        
+        /* Paint convex fans or stroke triangles directly */
+        shSetDirectPassGL(&c->gl);
+        shSetBlendModeGL(&c->gl, first->blendMode, first->color.a == 1.0f);
+        shDrawCommandGeometry(c, first, last, indexOffset);
+        j = ends[n];
+        continue;
+      }
+      
+      /* Tesselate into stencil */
+      shSetStencilPassGL(&c->gl, first->mode, first->fillRule);
+      shDrawCommandGeometry(c, first, last, indexOffset);
+      
+      /* Setup blending */
+      shSetBlendModeGL(&c->gl, first->blendMode, first->color.a == 1.0f);
+      
+      /* Draw paint where inside */
+      shSetCoverPassGL(&c->gl, first->mode, first->fillRule);
+      glDrawArrays(GL_TRIANGLES, coverStart + first->coverFirst,
+                   last->coverFirst + last->coverCount - first->coverFirst);
+      j = ends[n];
+    }
   }
   
-  return valid;
+  shResetVertexArrayState();
+  GL_CEHCK_ERROR;
+  
+  shDiscardDrawCommands(c);
 }
 
-VGboolean shIsStrokeCacheValid (VGContext *c, SHPath *p)
+void shDiscardDrawCommands(VGContext *c)
 {
-  VGboolean valid = VG_TRUE;
-
-  if (p->cacheStrokeInit == VG_FALSE) {
-    valid = VG_FALSE;
-  }
-  else if (p->cacheStrokeTessValid == VG_FALSE) {
-    valid = VG_FALSE;
-  }
-  else if (c->strokeDashPattern.size > 0) {
-    valid = VG_FALSE;
-  }
-  else if (p->cacheStrokeLineWidth  != c->strokeLineWidth  ||
-           p->cacheStrokeCapStyle   != c->strokeCapStyle   ||
-           p->cacheStrokeJoinStyle  != c->strokeJoinStyle  ||
-           p->cacheStrokeMiterLimit != c->strokeMiterLimit) {
-    valid = VG_FALSE;
-  }
-
-  if (valid == VG_FALSE)
-  {
-    /* Update cache */
-    p->cacheStrokeInit = VG_TRUE;
-    p->cacheStrokeTessValid = VG_TRUE;
-    p->cacheStrokeLineWidth  = c->strokeLineWidth;
-    p->cacheStrokeCapStyle   = c->strokeCapStyle;
-    p->cacheStrokeJoinStyle  = c->strokeJoinStyle;
-    p->cacheStrokeMiterLimit = c->strokeMiterLimit;
+  SHint i;
+  
+  for (i=0; i<c->pendingPaths.size; ++i) {
+    c->pendingPaths.items[i]->pending = VG_FALSE;
+    c->pendingPaths.items[i]->pendingStroke = VG_FALSE;
   }
-
-  return valid;
+  shPathArrayClear(&c->pendingPaths);
+  
+  shDrawCommandArrayClear(&c->drawCommands);
+  shVector2ArrayClear(&c->drawVertices);
+  shVector2ArrayClear(&c->drawCovers);
+  shIntArrayClear(&c->drawFirsts);
+  shIntArrayClear(&c->drawCounts);
+  shIntArrayClear(&c->drawIndices);
 }
 
 /*-----------------------------------------------------------
@@ -268,10 +1679,11 @@ VGboolean shIsStrokeCacheValid (VGContext *c, SHPath *p)
 VG_API_CALL void vgDrawPath(VGPath path, VGbitfield paintModes)
 {
   SHPath *p;
-  SHMatrix3x3 mi;
-  SHfloat mgl[16];
+  SHDrawRecord record;
   SHPaint *fill, *stroke;
   SHRectangle *rect;
+  VGboolean doStroke, gpuFill, gpuStroke, deferred;
+  int alphaIsOne;
   
   VG_GETCONTEXT(VG_NO_RETVAL);
   
@@ -283,98 +1695,212 @@ VG_API_CALL void vgDrawPath(VGPath path, VGbitfield paintModes)
 
   /* Check whether scissoring is enabled and scissor
      rectangle is valid */
+  rect = NULL;
   if (context->scissoring == VG_TRUE) {
-    rect = &context->scissor.items[0];
     if (context->scissor.size == 0) VG_RETURN( VG_NO_RETVAL );
+    rect = &context->scissor.items[0];
     if (rect->w <= 0.0f || rect->h <= 0.0f) VG_RETURN( VG_NO_RETVAL );
-    glScissor( (GLint)rect->x, (GLint)rect->y, (GLint)rect->w, (GLint)rect->h );
-    glEnable( GL_SCISSOR_TEST );
   }
   
   p = (SHPath*)path;
   
-  /* If user-to-surface matrix invertible tessellate in
-     surface space for better path resolution */
-  if (shIsTessCacheValid( context, p ) == VG_FALSE)
-  {
-    if (shInvertMatrix(&context->pathTransform, &mi)) {
-      shFlattenPath(p, 1);
-      shTransformVertices(&mi, p);
-    }else shFlattenPath(p, 0);
-    shFindBoundbox(p);
-  }
-  
   /* Pick paint if available or default*/
   fill = (context->fillPaint ? context->fillPaint : &context->defaultPaint);
   stroke = (context->strokePaint ? context->strokePaint : &context->defaultPaint);
+  doStroke = ((paintModes & VG_STROKE_PATH) &&
+              context->strokeLineWidth > 0.0f);
+  gpuFill = ((paintModes & VG_FILL_PATH) &&
+             (shUseImplicitCurves(context) || shUseGPUCurves(context)));
+  gpuStroke = (doStroke && shUseGPUStrokes(context));
   
-  /* Apply transformation */
-  shMatrixToGL(&context->pathTransform, mgl);
-  glUseProgram(context->progDraw);
-  glUniformMatrix4fv(context->locationDraw.model, 1, GL_FALSE, mgl);
-  glUniform1i(context->locationDraw.drawMode, 0); /* drawMode: path */
-  GL_CEHCK_ERROR;
+  /* Record the draw if deferred mode is on and all the
+     requested paints are plain colors. Anything else must
+     be drawn in order with what was recorded before. */
+  deferred = (context->deferredDraw && !gpuFill && !gpuStroke &&
+              (!(paintModes & VG_FILL_PATH) || fill->type == VG_PAINT_TYPE_COLOR) &&
+              (!doStroke || stroke->type == VG_PAINT_TYPE_COLOR));
   
-  if (paintModes & VG_FILL_PATH) {
+  /* With worker threads the path gets tessellated at flush,
+     along with all the others drawn until then */
+  if (deferred && context->workerThreads > 0) {
+    if (!shQueuePendingPath(context, p, doStroke)) {
+      shFlushDrawCommands(context);
+      VG_RETURN_ERR_IF(!shQueuePendingPath(context, p, doStroke),
+                       VG_OUT_OF_MEMORY_ERROR, VG_NO_RETVAL);
+    }
+    
+    if (paintModes & VG_FILL_PATH)
+      shRecordDrawCommand(context, p, VG_FILL_PATH, fill);
+    if (doStroke)
+      shRecordDrawCommand(context, p, VG_STROKE_PATH, stroke);
+    
+    VG_RETURN(VG_NO_RETVAL);
+  }
+  
+  shFlushPendingPath(context, p);
+  
+  /* Fills with curves evaluated on the GPU need no
+     tessellation, strokes still do */
+  if (!gpuFill || doStroke)
+    shUpdateVertices(context, p);
+  
+  /* Build the stroke before anything gets drawn, so that
+     running out of memory leaves no half-drawn path */
+  if (doStroke && !gpuStroke) {
+    VG_RETURN_ERR_IF(!shUpdateStroke(context, p),
+                     VG_OUT_OF_MEMORY_ERROR, VG_NO_RETVAL);
+  }
+  
+  if (deferred) {
     
-    /* Tesselate into stencil */
-    glEnable(GL_STENCIL_TEST);
-    glStencilFunc(GL_ALWAYS, 0, 0);
-    glStencilOp(GL_INVERT, GL_INVERT, GL_INVERT);
-    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
-    shDrawVertices(p, GL_TRIANGLE_FAN);
+    if (paintModes & VG_FILL_PATH)
+      shRecordDrawCommand(context, p, VG_FILL_PATH, fill);
     
-    /* Setup blending */
-    updateBlendingStateGL(context,
-                          fill->type == VG_PAINT_TYPE_COLOR &&
-                          fill->color.a == 1.0f);
+    if (doStroke)
+      shRecordDrawCommand(context, p, VG_STROKE_PATH, stroke);
     
-    /* Draw paint where stencil odd */
-    glStencilFunc(GL_EQUAL, 1, 1);
-    glStencilOp(GL_ZERO, GL_ZERO, GL_ZERO);
-    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
-    shDrawPaintMesh(context, &p->min, &p->max, VG_FILL_PATH, GL_TEXTURE0);
-
-    /* Reset state */
-    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
-    glDisable(GL_STENCIL_TEST);
-    glDisable(GL_BLEND);
+    VG_RETURN(VG_NO_RETVAL);
   }
   
-  if ((paintModes & VG_STROKE_PATH) &&
-      context->strokeLineWidth > 0.0f) {
+  if (context->deferredDraw)
+    shFlushDrawCommands(context);
+  
+  if (rect) {
+    shGLScissor(&context->gl, (GLint)rect->x, (GLint)rect->y,
+                (GLint)rect->w, (GLint)rect->h );
+    shGLEnable(&context->gl, GL_SCISSOR_TEST);
+  }else shGLDisable(&context->gl, GL_SCISSOR_TEST);
+  
+  shGLUseProgram(&context->gl, context->progDraw);
+  
+  if (paintModes & VG_FILL_PATH) {
     
-    if (1) {/*context->strokeLineWidth > 1.0f) {*/
-
-      if (shIsStrokeCacheValid( context, p ) == VG_FALSE)
-      {
-        /* Generate stroke triangles in user space */
-        shVector2ArrayClear(&p->stroke);
-        shStrokePath(context, p);
-      }
-
-      /* Stroke into stencil */
-      glEnable(GL_STENCIL_TEST);
-      glStencilFunc(GL_NOTEQUAL, 1, 1);
-      glStencilOp(GL_KEEP, GL_INCR, GL_INCR);
-      glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
-      shDrawStroke(p);
-
+    /* Apply transformation and paint */
+    shBeginDrawRecord(&record, &context->pathTransform, 0); /* drawMode: path */
+    shLoadPaint(fill, VG_FILL_PATH, VG_MATRIX_PATH_USER_TO_SURFACE, &record);
+    shSubmitDrawRecord(context, &record);
+    GL_CEHCK_ERROR;
+    
+    if (gpuFill) {
+      
+      /* Evaluate curves into stencil */
+      shUpdateCurves(p);
+      shSetStencilPassGL(&context->gl, VG_FILL_PATH, context->fillRule);
+      if (shUseImplicitCurves(context)) {
+        shUpdateImplicit(p);
+        shDrawImplicit(context, p);
+      }else shDrawCurves(context, p);
+      
+      /* Setup blending */
+      updateBlendingStateGL(context,
+                            fill->type == VG_PAINT_TYPE_COLOR &&
+                            fill->color.a == 1.0f);
+      
+      /* Draw paint where inside */
+      shSetCoverPassGL(&context->gl, VG_FILL_PATH, context->fillRule);
+      shDrawPaintMesh(context, &p->curveCover, 1);
+      
+    }else if (p->convex) {
+      
+      /* Convex fan covers each pixel once: paint it directly */
+      shSetDirectPassGL(&context->gl);
+      updateBlendingStateGL(context,
+                            fill->type == VG_PAINT_TYPE_COLOR &&
+                            fill->color.a == 1.0f);
+      shDrawVertices(context, p, GL_TRIANGLE_FAN, 1);
+      
+    }else{
+      
+      /* Tesselate into stencil */
+      shSetStencilPassGL(&context->gl, VG_FILL_PATH, context->fillRule);
+      shDrawVertices(context, p, GL_TRIANGLE_FAN, 1);
+      
       /* Setup blending */
       updateBlendingStateGL(context,
-                            stroke->type == VG_PAINT_TYPE_COLOR &&
-                            stroke->color.a == 1.0f);
-
-      /* Draw paint where stencil odd */
-      glStencilFunc(GL_EQUAL, 1, 1);
-      glStencilOp(GL_ZERO, GL_ZERO, GL_ZERO);
-      glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
-      shDrawPaintMesh(context, &p->min, &p->max, VG_STROKE_PATH, GL_TEXTURE0);
+                            fill->type == VG_PAINT_TYPE_COLOR &&
+                            fill->color.a == 1.0f);
+      
+      /* Draw paint where inside */
+      shSetCoverPassGL(&context->gl, VG_FILL_PATH, context->fillRule);
+      shDrawPaintMesh(context, &p->fillCover, 1);
+    }
+  }
+  
+  if (gpuStroke) {
+    
+    shUpdateStrokeSegments(p);
+    
+    /* Apply transformation and paint */
+    shBeginDrawRecord(&record, &context->pathTransform, 0); /* drawMode: path */
+    shLoadPaint(stroke, VG_STROKE_PATH, VG_MATRIX_PATH_USER_TO_SURFACE, &record);
+    shSubmitDrawRecord(context, &record);
+    GL_CEHCK_ERROR;
+    
+    alphaIsOne = (stroke->type == VG_PAINT_TYPE_COLOR &&
+                  stroke->color.a == 1.0f);
+    
+    if (shIsStrokeDirect(context->blendMode, alphaIsOne)) {
+      
+      /* Overlaps are opaque: blend the coverage in directly,
+         or clip at the outline where blending stays off */
+      shSetDirectPassGL(&context->gl);
+      if (context->blendMode == VG_BLEND_SRC_OVER) {
+        updateBlendingStateGL(context, 0);
+        shDrawGPUStroke(context, p, SH_STROKE_PASS_COVERAGE);
+      }else{
+        updateBlendingStateGL(context, alphaIsOne);
+        shDrawGPUStroke(context, p, SH_STROKE_PASS_CLIP);
+      }
+      context->strokesDirect++;
+      
+    }else{
+      
+      /* Stroke into stencil */
+      shSetStencilPassGL(&context->gl, VG_STROKE_PATH, context->fillRule);
+      shDrawGPUStroke(context, p, SH_STROKE_PASS_CLIP);
+      
+      /* Paint the same quads where stencil set */
+      updateBlendingStateGL(context, alphaIsOne);
+      shSetCoverPassGL(&context->gl, VG_STROKE_PATH, context->fillRule);
+      shDrawGPUStroke(context, p, SH_STROKE_PASS_COVER);
+      context->strokesStenciled++;
+    }
+    
+  }else if (doStroke) {
+    
+    if (1) {/*context->strokeLineWidth > 1.0f) {*/
+      
+      /* Apply transformation and paint */
+      shBeginDrawRecord(&record, &context->pathTransform, 0); /* drawMode: path */
+      shLoadPaint(stroke, VG_STROKE_PATH, VG_MATRIX_PATH_USER_TO_SURFACE, &record);
+      shSubmitDrawRecord(context, &record);
+      GL_CEHCK_ERROR;
       
-      /* Reset state */
-      glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
-      glDisable(GL_STENCIL_TEST);
-      glDisable(GL_BLEND);
+      alphaIsOne = (stroke->type == VG_PAINT_TYPE_COLOR &&
+                    stroke->color.a == 1.0f);
+      
+      if (shIsStrokeDirect(context->blendMode, alphaIsOne)) {
+        
+        /* Overlaps cannot blend twice: paint triangles directly */
+        shSetDirectPassGL(&context->gl);
+        updateBlendingStateGL(context, alphaIsOne);
+        shDrawStroke(context, p, 1);
+        context->strokesDirect++;
+        
+      }else{
+        
+        /* Stroke into stencil */
+        shSetStencilPassGL(&context->gl, VG_STROKE_PATH, context->fillRule);
+        shDrawStroke(context, p, 1);
+        
+        /* Setup blending */
+        updateBlendingStateGL(context, alphaIsOne);
+        
+        /* Draw paint where stencil odd */
+        shSetCoverPassGL(&context->gl, VG_STROKE_PATH, context->fillRule);
+        shDrawPaintMesh(context, &p->strokeCover, 1);
+        context->strokesStenciled++;
+      }
       
     }else{
       
@@ -384,23 +1910,233 @@ VG_API_CALL void vgDrawPath(VGPath path, VGbitfield paintModes)
         c.a *= context->strokeLineWidth;
       
       /* Draw contour as a line */
-      glEnable(GL_BLEND);
-      glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-      shDrawVertices(p, GL_LINE_STRIP);
-      glDisable(GL_BLEND);
+      shGLDisable(&context->gl, GL_STENCIL_TEST);
+      shGLEnable(&context->gl, GL_BLEND);
+      shGLBlendFunc(&context->gl, GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+      shDrawVertices(context, p, GL_LINE_STRIP, 1);
+    }
+  }
+  
+  shResetVertexArrayState();
+
+  VG_RETURN(VG_NO_RETVAL);
+}
+
+/*-----------------------------------------------------------
+ * Computes the surface-space bounds of an instance from the
+ * bounds of the geometry it draws.
+ *-----------------------------------------------------------*/
+
+static void shInstanceBounds(SHMatrix3x3 *m, SHVector2 *min, SHVector2 *max,
+                             SHVector2 *bmin, SHVector2 *bmax)
+{
+  SHfloat K = SH_COVER_PADDING;
+  SHVector2 corners[4], v;
+  int i;
+  
+  SET2(corners[0], min->x - K, min->y - K);
+  SET2(corners[1], max->x + K, min->y - K);
+  SET2(corners[2], min->x - K, max->y + K);
+  SET2(corners[3], max->x + K, max->y + K);
+  
+  for (i=0; i<4; ++i) {
+    TRANSFORM2TO(corners[i], (*m), v);
+    if (i == 0 || v.x < bmin->x) bmin->x = v.x;
+    if (i == 0 || v.y < bmin->y) bmin->y = v.y;
+    if (i == 0 || v.x > bmax->x) bmax->x = v.x;
+    if (i == 0 || v.y > bmax->y) bmax->y = v.y;
+  }
+}
+
+/*-----------------------------------------------------------
+ * Draws one stencil-then-cover pass for a batch of path
+ * instances. Each instance gets a copy of the paint record
+ * with its own transform and optionally its own color.
+ *-----------------------------------------------------------*/
+
+static void shDrawInstanceBatch(VGContext *c, SHPath *p, VGPaintMode mode,
+                                SHPaint *paint, SHMatrix3x3 *transforms,
+                                const VGfloat *colors, SHint count)
+{
+  SHDrawRecord records[SH_DRAW_RECORDS];
+  SHint i, base;
+  int isColor, alphaIsOne;
+  
+  /* Paint is loaded once, textures get bound here too */
+  shBeginDrawRecord(&records[0], &c->pathTransform, 0); /* drawMode: path */
+  shLoadPaint(paint, mode, VG_MATRIX_PATH_USER_TO_SURFACE, &records[0]);
+  isColor = (records[0].paintType == VG_PAINT_TYPE_COLOR);
+  alphaIsOne = isColor;
+  
+  for (i=0; i<count; ++i) {
+    if (i > 0) records[i] = records[0];
+    shMatrixToGL(&transforms[i], records[i].model);
+    if (isColor && colors) {
+      records[i].paintColor[0] = colors[i*4+0];
+      records[i].paintColor[1] = colors[i*4+1];
+      records[i].paintColor[2] = colors[i*4+2];
+      records[i].paintColor[3] = colors[i*4+3];
+    }
+    if (records[i].paintColor[3] != 1.0f) alphaIsOne = 0;
+  }
+  
+  base = shUploadDrawRecords(c, records, count);
+  shGLUniform1i(&c->gl, c->locationDraw.drawIndex,
+                &c->gl.uniforms.drawIndex, base);
+  GL_CEHCK_ERROR;
+  
+  if (mode == VG_FILL_PATH && p->convex) {
+    
+    /* Paint convex fans directly */
+    shSetDirectPassGL(&c->gl);
+    updateBlendingStateGL(c, alphaIsOne);
+    shDrawVertices(c, p, GL_TRIANGLE_FAN, count);
+    return;
+  }
+  
+  if (mode == VG_STROKE_PATH) {
+    if (shIsStrokeDirect(c->blendMode, alphaIsOne)) {
+      
+      /* Paint stroke triangles directly */
+      shSetDirectPassGL(&c->gl);
+      updateBlendingStateGL(c, alphaIsOne);
+      shDrawStroke(c, p, count);
+      c->strokesDirect += count;
+      return;
     }
+    c->strokesStenciled += count;
   }
   
-  if (context->scissoring == VG_TRUE)
-    glDisable( GL_SCISSOR_TEST );
+  /* Tesselate into stencil */
+  shSetStencilPassGL(&c->gl, mode, c->fillRule);
+  if (mode == VG_FILL_PATH)
+    shDrawVertices(c, p, GL_TRIANGLE_FAN, count);
+  else shDrawStroke(c, p, count);
+  
+  /* Setup blending */
+  updateBlendingStateGL(c, alphaIsOne);
+  
+  /* Draw paint where inside */
+  shSetCoverPassGL(&c->gl, mode, c->fillRule);
+  shDrawPaintMesh(c, mode == VG_FILL_PATH ? &p->fillCover : &p->strokeCover,
+                  count);
+}
+
+/*-----------------------------------------------------------
+ * Draws [count] copies of a path. Each copy is transformed
+ * by the path-user-to-surface matrix multiplied by its own
+ * affine matrix (9 floats each, as in vgLoadMatrix). If
+ * [colors] is not NULL it holds 4 floats (sRGBA) per copy
+ * that replace the color of the fill paint, or of the stroke
+ * paint when not filling, if that is a color paint.
+ *
+ * The path is tessellated and stroked only once. Copies are
+ * drawn in order; consecutive copies whose bounds do not
+ * overlap share a single instanced stencil and cover pass.
+ *-----------------------------------------------------------*/
 
+VG_API_CALL void vgDrawPathInstancedSH(VGPath path, VGbitfield paintModes,
+                                       VGint count, const VGfloat *matrices,
+                                       const VGfloat *colors)
+{
+  SHPath *p;
+  SHPaint *fill, *stroke;
+  SHRectangle *rect;
+  VGboolean doStroke;
+  SHMatrix3x3 transforms[SH_DRAW_RECORDS], mul;
+  SHVector2 bmin[SH_DRAW_RECORDS], bmax[SH_DRAW_RECORDS];
+  SHVector2 min, max;
+  const VGfloat *mm;
+  SHint i, j, n;
+  
+  VG_GETCONTEXT(VG_NO_RETVAL);
+  
+  VG_RETURN_ERR_IF(!shIsValidPath(context, path),
+                   VG_BAD_HANDLE_ERROR, VG_NO_RETVAL);
+  
+  VG_RETURN_ERR_IF(paintModes & (~(VG_STROKE_PATH | VG_FILL_PATH)),
+                   VG_ILLEGAL_ARGUMENT_ERROR, VG_NO_RETVAL);
+  
+  VG_RETURN_ERR_IF(count < 0 || (count > 0 && !matrices),
+                   VG_ILLEGAL_ARGUMENT_ERROR, VG_NO_RETVAL);
+  
+  /* Check whether scissoring is enabled and scissor
+     rectangle is valid */
+  rect = NULL;
+  if (context->scissoring == VG_TRUE) {
+    if (context->scissor.size == 0) VG_RETURN( VG_NO_RETVAL );
+    rect = &context->scissor.items[0];
+    if (rect->w <= 0.0f || rect->h <= 0.0f) VG_RETURN( VG_NO_RETVAL );
+  }
+  
+  if (count == 0 || paintModes == 0) VG_RETURN( VG_NO_RETVAL );
+  
+  /* Keep order with recorded draws */
+  shFlushDrawCommands(context);
+  
+  p = (SHPath*)path;
+  shUpdateVertices(context, p);
+  
+  /* Pick paint if available or default*/
+  fill = (context->fillPaint ? context->fillPaint : &context->defaultPaint);
+  stroke = (context->strokePaint ? context->strokePaint : &context->defaultPaint);
+  doStroke = ((paintModes & VG_STROKE_PATH) &&
+              context->strokeLineWidth > 0.0f);
+  
+  SET2V(min, p->min); SET2V(max, p->max);
+  if (doStroke) {
+    VG_RETURN_ERR_IF(!shUpdateStroke(context, p),
+                     VG_OUT_OF_MEMORY_ERROR, VG_NO_RETVAL);
+    min.x = SH_MIN(min.x, p->strokeMin.x); min.y = SH_MIN(min.y, p->strokeMin.y);
+    max.x = SH_MAX(max.x, p->strokeMax.x); max.y = SH_MAX(max.y, p->strokeMax.y);
+  }
+  
+  if (rect) {
+    shGLScissor(&context->gl, (GLint)rect->x, (GLint)rect->y,
+                (GLint)rect->w, (GLint)rect->h );
+    shGLEnable(&context->gl, GL_SCISSOR_TEST);
+  }else shGLDisable(&context->gl, GL_SCISSOR_TEST);
+  
+  shGLUseProgram(&context->gl, context->progDraw);
+  
+  for (i=0; i<count; i+=n) {
+    
+    /* Gather consecutive instances that do not overlap */
+    for (n=0; n<SH_DRAW_RECORDS && i+n<count; ++n) {
+      mm = matrices + (i+n) * 9;
+      SETMAT(mul,
+             mm[0], mm[3], mm[6],
+             mm[1], mm[4], mm[7],
+             0.0f,  0.0f,  1.0f);
+      MULMATMAT(context->pathTransform, mul, transforms[n]);
+      shInstanceBounds(&transforms[n], &min, &max, &bmin[n], &bmax[n]);
+      
+      for (j=0; j<n; ++j)
+        if (bmin[j].x <= bmax[n].x && bmin[n].x <= bmax[j].x &&
+            bmin[j].y <= bmax[n].y && bmin[n].y <= bmax[j].y) break;
+      if (j < n) break;
+    }
+    
+    if (paintModes & VG_FILL_PATH)
+      shDrawInstanceBatch(context, p, VG_FILL_PATH, fill, transforms,
+                          colors ? colors + i*4 : NULL, n);
+    
+    /* Colors go to the stroke only if not filling */
+    if (doStroke)
+      shDrawInstanceBatch(context, p, VG_STROKE_PATH, stroke, transforms,
+                          colors && !(paintModes & VG_FILL_PATH) ?
+                          colors + i*4 : NULL, n);
+  }
+  
+  shResetVertexArrayState();
+  
   VG_RETURN(VG_NO_RETVAL);
 }
 
 VG_API_CALL void vgDrawImage(VGImage image)
 {
   SHImage *i;
-  SHfloat mgl[16];
+  SHDrawRecord record;
   SHPaint *fill;
   SHVector2 min, max;
   SHRectangle *rect;
@@ -412,46 +2148,46 @@ VG_API_CALL void vgDrawImage(VGImage image)
 
   /* TODO: check if image is current render target */
   
+  /* Images are never recorded, keep them in order */
+  shFlushDrawCommands(context);
+  
   /* Check whether scissoring is enabled and scissor
      rectangle is valid */
   if (context->scissoring == VG_TRUE) {
     rect = &context->scissor.items[0];
     if (context->scissor.size == 0) VG_RETURN( VG_NO_RETVAL );
     if (rect->w <= 0.0f || rect->h <= 0.0f) VG_RETURN( VG_NO_RETVAL );
-    glScissor( (GLint)rect->x, (GLint)rect->y, (GLint)rect->w, (GLint)rect->h );
-    glEnable( GL_SCISSOR_TEST );
-  }
+    shGLScissor(&context->gl, (GLint)rect->x, (GLint)rect->y,
+                (GLint)rect->w, (GLint)rect->h );
+    shGLEnable(&context->gl, GL_SCISSOR_TEST);
+  }else shGLDisable(&context->gl, GL_SCISSOR_TEST);
+  
+  /* Images are not masked by the stencil buffer */
+  shGLDisable(&context->gl, GL_STENCIL_TEST);
+  shGLColorMask(&context->gl, GL_TRUE);
   
   /* Apply image-user-to-surface transformation */
   i = (SHImage*)image;
-  shMatrixToGL(&context->imageTransform, mgl);
-  glUseProgram(context->progDraw);
-  glUniformMatrix4fv(context->locationDraw.model, 1, GL_FALSE, mgl);
-  glUniform1i(context->locationDraw.drawMode, 1); /* drawMode: image */
-  GL_CEHCK_ERROR;
+  shGLUseProgram(&context->gl, context->progDraw);
+  shBeginDrawRecord(&record, &context->imageTransform, 1); /* drawMode: image */
   
   /* Clamp to edge for proper filtering, modulate for multiply mode */
-  glActiveTexture(GL_TEXTURE0);
-  glBindTexture(GL_TEXTURE_2D, i->texture);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  shGLActiveTexture(&context->gl, GL_TEXTURE0);
+  shGLBindTexture(&context->gl, i->texture);
+  shGLTexParameteri(&context->gl, &i->texState, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  shGLTexParameteri(&context->gl, &i->texState, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
   
   /* Adjust antialiasing to settings */
   if (context->imageQuality == VG_IMAGE_QUALITY_NONANTIALIASED) {
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    shGLTexParameteri(&context->gl, &i->texState, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    shGLTexParameteri(&context->gl, &i->texState, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
   }else{
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    shGLTexParameteri(&context->gl, &i->texState, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    shGLTexParameteri(&context->gl, &i->texState, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
   }
   
-  glEnableVertexAttribArray(context->locationDraw.textureUV);
-  GLfloat uv[] = { 0.0f, 0.0f,
-                   1.0f, 0.0f,
-                   0.0f, 1.0f,
-                   1.0f, 1.0f };
-  glVertexAttribPointer(context->locationDraw.textureUV, 2, GL_FLOAT, GL_FALSE, 0, uv);
-  glUniform1i(context->locationDraw.imageSampler, 0);
+  shGLUniform1i(&context->gl, context->locationDraw.imageSampler,
+                &context->gl.uniforms.imageSampler, 0);
   GL_CEHCK_ERROR;
   
   /* Pick fill paint */
@@ -461,46 +2197,33 @@ VG_API_CALL void vgDrawImage(VGImage image)
   updateBlendingStateGL(context, 0);
 
   /* Draw textured quad */
-  glEnable(GL_TEXTURE_2D);
-    
-  if (context->imageMode == VG_DRAW_IMAGE_MULTIPLY){
-      /* Multiply each colors */
-      glUniform1i(context->locationDraw.imageMode, VG_DRAW_IMAGE_MULTIPLY );
-      switch(fill->type){
-          case VG_PAINT_TYPE_RADIAL_GRADIENT:
-              shLoadRadialGradientMesh(fill, VG_FILL_PATH, VG_MATRIX_IMAGE_USER_TO_SURFACE);
-              break;
-          case VG_PAINT_TYPE_LINEAR_GRADIENT:
-              shLoadLinearGradientMesh(fill, VG_FILL_PATH, VG_MATRIX_IMAGE_USER_TO_SURFACE);
-              break;
-          case VG_PAINT_TYPE_PATTERN:
-              shLoadPatternMesh(fill, VG_FILL_PATH, VG_MATRIX_IMAGE_USER_TO_SURFACE);
-              break;
-          default:
-          case VG_PAINT_TYPE_COLOR:
-              shLoadOneColorMesh(fill);
-              break;
-      }
-  } else {
-      glUniform1i(context->locationDraw.imageMode, VG_DRAW_IMAGE_NORMAL );
-  }
+  shGLEnable(&context->gl, GL_TEXTURE_2D);
+  
+  if (context->imageMode == VG_DRAW_IMAGE_MULTIPLY) {
+    /* Multiply each colors */
+    record.imageMode = VG_DRAW_IMAGE_MULTIPLY;
+    shLoadPaint(fill, VG_FILL_PATH, VG_MATRIX_IMAGE_USER_TO_SURFACE, &record);
+  }else record.imageMode = VG_DRAW_IMAGE_NORMAL;
+  
+  shSubmitDrawRecord(context, &record);
+  GL_CEHCK_ERROR;
 
-  GLfloat v[] = { 0.0f, 0.0f,
-                  i->width, 0.0f,
-                  0.0f, i->height,
-                  i->width, i->height };
-  glVertexAttribPointer(context->locationDraw.pos, 2, GL_FLOAT, GL_FALSE, 0, v);
-  glEnableVertexAttribArray(context->locationDraw.pos);
+  /* Interleaved position and texture coordinates */
+  GLfloat v[] = { 0.0f,     0.0f,      0.0f, 0.0f,
+                  i->width, 0.0f,      1.0f, 0.0f,
+                  0.0f,     i->height, 0.0f, 1.0f,
+                  i->width, i->height, 1.0f, 1.0f };
+  GLintptr offset = shStreamVertices(context, v, sizeof(v));
+  glVertexAttribPointer(SH_ATTRIB_POS, 2, GL_FLOAT, GL_FALSE,
+                        4 * sizeof(GLfloat), (void*)offset);
+  glVertexAttribPointer(SH_ATTRIB_TEXTURE_UV, 2, GL_FLOAT, GL_FALSE,
+                        4 * sizeof(GLfloat), (void*)(offset + 2 * sizeof(GLfloat)));
+  glEnableVertexAttribArray(SH_ATTRIB_TEXTURE_UV);
   glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
-  glDisableVertexAttribArray(context->locationDraw.pos);
-    
-  glDisable(GL_TEXTURE_2D);
+  glDisableVertexAttribArray(SH_ATTRIB_TEXTURE_UV);
   GL_CEHCK_ERROR;
  
-  glDisableVertexAttribArray(context->locationDraw.textureUV);
-
-  if (context->scissoring == VG_TRUE)
-    glDisable( GL_SCISSOR_TEST );
+  shResetVertexArrayState();
   
   VG_RETURN(VG_NO_RETVAL);
 }
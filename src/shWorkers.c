@@ -0,0 +1,175 @@
+/*
+ * Copyright (c) 2007 Ivan Leben
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * 
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library in the file COPYING;
+ * if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include "openvg.h"
+#include "shWorkers.h"
+#include <stdlib.h>
+
+void SHWorkerPool_ctor(SHWorkerPool *pool)
+{
+  pool->threadCount = 0;
+  
+#if defined(SH_WORKER_THREADS_SUPPORTED)
+  pool->threads = NULL;
+  pthread_mutex_init(&pool->lock, NULL);
+  pthread_cond_init(&pool->wake, NULL);
+  pthread_cond_init(&pool->done, NULL);
+#endif
+  
+  pool->func = NULL;
+  pool->items = NULL;
+  pool->itemSize = 0;
+  pool->itemCount = 0;
+  pool->next = 0;
+  pool->finished = 0;
+  pool->quit = VG_FALSE;
+}
+
+void SHWorkerPool_dtor(SHWorkerPool *pool)
+{
+  shResizeWorkerPool(pool, 0);
+  
+#if defined(SH_WORKER_THREADS_SUPPORTED)
+  pthread_mutex_destroy(&pool->lock);
+  pthread_cond_destroy(&pool->wake);
+  pthread_cond_destroy(&pool->done);
+#endif
+}
+
+#if defined(SH_WORKER_THREADS_SUPPORTED)
+
+/*--------------------------------------------------------
+ * Takes jobs of the current batch until none is left.
+ * Called and returns with the pool lock held.
+ *--------------------------------------------------------*/
+
+static void shTakeJobs(SHWorkerPool *pool)
+{
+  void *item;
+  
+  while (pool->next < pool->itemCount) {
+    item = pool->items + pool->next * pool->itemSize;
+    pool->next++;
+    
+    pthread_mutex_unlock(&pool->lock);
+    pool->func(item);
+    pthread_mutex_lock(&pool->lock);
+    
+    if (++pool->finished == pool->itemCount)
+      pthread_cond_signal(&pool->done);
+  }
+}
+
+static void* shWorkerMain(void *arg)
+{
+  SHWorkerPool *pool = (SHWorkerPool*)arg;
+  
+  pthread_mutex_lock(&pool->lock);
+  
+  while (!pool->quit) {
+    if (pool->next < pool->itemCount) shTakeJobs(pool);
+    else pthread_cond_wait(&pool->wake, &pool->lock);
+  }
+  
+  pthread_mutex_unlock(&pool->lock);
+  return NULL;
+}
+
+#endif
+
+/*--------------------------------------------------------
+ * Stops the running threads and starts [threadCount] new
+ * ones. Fewer may be running if creating them fails.
+ *--------------------------------------------------------*/
+
+void shResizeWorkerPool(SHWorkerPool *pool, SHint threadCount)
+{
+#if defined(SH_WORKER_THREADS_SUPPORTED)
+  SHint i;
+  
+  if (threadCount == pool->threadCount)
+    return;
+  
+  if (pool->threadCount > 0) {
+    pthread_mutex_lock(&pool->lock);
+    pool->quit = VG_TRUE;
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+    
+    for (i=0; i<pool->threadCount; ++i)
+      pthread_join(pool->threads[i], NULL);
+    
+    free(pool->threads);
+    pool->threads = NULL;
+    pool->threadCount = 0;
+    pool->quit = VG_FALSE;
+  }
+  
+  if (threadCount <= 0) return;
+  
+  pool->threads = (pthread_t*)malloc(threadCount * sizeof(pthread_t));
+  if (pool->threads == NULL) return;
+  
+  for (i=0; i<threadCount; ++i) {
+    if (pthread_create(&pool->threads[i], NULL, shWorkerMain, pool) != 0)
+      break;
+    pool->threadCount++;
+  }
+#endif
+}
+
+/*--------------------------------------------------------
+ * Calls [func] on each of [itemCount] items of [itemSize]
+ * bytes and waits for all of them. Jobs must not touch
+ * each other's data.
+ *--------------------------------------------------------*/
+
+void shRunWorkerPool(SHWorkerPool *pool, SHJobFunc func,
+                     void *items, SHint itemSize, SHint itemCount)
+{
+  SHint i;
+  
+#if defined(SH_WORKER_THREADS_SUPPORTED)
+  if (pool->threadCount > 0 && itemCount > 1) {
+    
+    pthread_mutex_lock(&pool->lock);
+    pool->func = func;
+    pool->items = (SHuint8*)items;
+    pool->itemSize = itemSize;
+    pool->itemCount = itemCount;
+    pool->next = 0;
+    pool->finished = 0;
+    pthread_cond_broadcast(&pool->wake);
+    
+    /* Help out, then wait for jobs still running */
+    shTakeJobs(pool);
+    while (pool->finished < pool->itemCount)
+      pthread_cond_wait(&pool->done, &pool->lock);
+    
+    pool->itemCount = 0;
+    pool->next = 0;
+    pthread_mutex_unlock(&pool->lock);
+    return;
+  }
+#endif
+  
+  for (i=0; i<itemCount; ++i)
+    func((SHuint8*)items + i * itemSize);
+}
@@ -0,0 +1,70 @@
+/*
+ * Copyright (c) 2007 Ivan Leben
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * 
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library in the file COPYING;
+ * if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef __SHWORKERS_H
+#define __SHWORKERS_H
+
+#include "shDefs.h"
+
+#if !defined(_WIN32)
+#  include <pthread.h>
+#  define SH_WORKER_THREADS_SUPPORTED
+#endif
+
+/* Job callback, called with a pointer to one job item */
+typedef void (*SHJobFunc)(void *item);
+
+/*------------------------------------------------------------
+ * Pool of worker threads running one batch of jobs at a
+ * time. The calling thread takes jobs too and returns once
+ * all of them are done. Without thread support, or with no
+ * threads, jobs run on the calling thread.
+ *------------------------------------------------------------*/
+
+typedef struct
+{
+  SHint threadCount;
+  
+#if defined(SH_WORKER_THREADS_SUPPORTED)
+  pthread_t *threads;
+  pthread_mutex_t lock;
+  pthread_cond_t wake;
+  pthread_cond_t done;
+#endif
+  
+  /* Current batch */
+  SHJobFunc func;
+  SHuint8 *items;
+  SHint itemSize;
+  SHint itemCount;
+  SHint next;
+  SHint finished;
+  VGboolean quit;
+  
+} SHWorkerPool;
+
+void SHWorkerPool_ctor(SHWorkerPool *pool);
+void SHWorkerPool_dtor(SHWorkerPool *pool);
+
+void shResizeWorkerPool(SHWorkerPool *pool, SHint threadCount);
+void shRunWorkerPool(SHWorkerPool *pool, SHJobFunc func,
+                     void *items, SHint itemSize, SHint itemCount);
+
+#endif /* __SHWORKERS_H */
@@ -25,19 +25,50 @@
 #include <string.h>
 #include <stdio.h>
 
+/* Shared by both pipeline stages. Must stay in sync with
+   SHDrawRecord (std140 layout). */
+static const char* vgShaderDrawBlock =
+    "#version 330\n"
+    "#define SH_DRAW_RECORDS " SH_STRINGIFY(SH_DRAW_RECORDS) "\n"
+R"glsl(
+/*** Per-draw state ***********/
+    struct SHDrawRecord {
+        mat4  model;
+        mat3  paintInverted;
+        vec4  paintColor;
+        vec4  paintParams[3];
+        ivec4 modes;          // paintType, drawMode, imageMode
+    };
+
+    layout(std140) uniform SHDrawBlock {
+        SHDrawRecord sh_Draws[SH_DRAW_RECORDS];
+    };
+
+    // Each stage defines SH_DRAW as the record it reads
+    #define sh_Model      (SH_DRAW.model)
+    #define paintInverted (SH_DRAW.paintInverted)
+    #define paintColor    (SH_DRAW.paintColor)
+    #define paintParams   (SH_DRAW.paintParams)
+    #define paintType     (SH_DRAW.modes.x)
+    #define drawMode      (SH_DRAW.modes.y)
+    #define imageMode     (SH_DRAW.modes.z)
+)glsl";
+
 static const char* vgShaderVertexPipeline = R"glsl(
-    #version 330
     
 /*** Input *******************/
     in vec2 pos;
     in vec2 textureUV;
-    uniform mat4 sh_Model;
+    uniform int drawIndex;
     uniform mat4 sh_Ortho;
-    uniform mat3 paintInverted;
+
+    // Instanced draws read consecutive records
+    #define SH_DRAW sh_Draws[drawIndex + gl_InstanceID]
 
 /*** Output ******************/
     out vec2 texImageCoord;
     out vec2 paintCoord;
+    flat out int drawID;
 
 /*** Grobal variables ********************/
     vec4 sh_Vertex;
@@ -62,6 +93,8 @@ static const char* vgShaderVertexPipeline = R"glsl(
         /* 2D pos in paint space (Back to paint space) */
         paintCoord = (paintInverted * vec3(pos, 1)).xy;
 
+        drawID = drawIndex + gl_InstanceID;
+
     }
 )glsl";
 
@@ -71,8 +104,6 @@ static const char* vgShaderVertexUserDefault = R"glsl(
 
 static const char* vgShaderFragmentPipeline = R"glsl(
 
-    #version 330
-
 /*** Enum constans ************************************/
 
     #define PAINT_TYPE_COLOR			0x1B00
@@ -90,18 +121,14 @@ static const char* vgShaderFragmentPipeline = R"glsl(
 
     in vec2 texImageCoord;
     in vec2 paintCoord;
+    flat in int drawID;
 
 /*** Input ********************************************/
 
-    // Basic rendering Mode
-    uniform int drawMode;
+    // Per-draw state: drawMode, imageMode, paintType, paintColor, paintParams
+    #define SH_DRAW sh_Draws[drawID]
     // Image
     uniform sampler2D imageSampler;
-    uniform int imageMode;
-    // Paint
-    uniform int paintType;
-    uniform vec4 paintColor;
-    uniform vec2 paintParams[3];
     // Gradient
     uniform sampler2D rampSampler;
     // Pattern
@@ -168,16 +195,16 @@ static const char* vgShaderFragmentPipeline = R"glsl(
         switch(paintType){
         case PAINT_TYPE_LINEAR_GRADIENT:
             {
-                vec2  x0 = paintParams[0];
-                vec2  x1 = paintParams[1];
+                vec2  x0 = paintParams[0].xy;
+                vec2  x1 = paintParams[1].xy;
                 float factor = linearGradient(paintCoord, x0, x1);
                 col = texture(rampSampler, vec2(factor, 0.5));
             }
             break;
         case PAINT_TYPE_RADIAL_GRADIENT:
             {
-                vec2  center = paintParams[0];
-                vec2  focal  = paintParams[1];
+                vec2  center = paintParams[0].xy;
+                vec2  focal  = paintParams[1].xy;
                 float radius = paintParams[2].x;
                 float factor = radialGradient(paintCoord, center, focal, radius);
                 col = texture(rampSampler, vec2(factor, 0.5));
@@ -215,6 +242,263 @@ static const char* vgShaderFragmentUserDefault = R"glsl(
     void shMain(){ gl_FragColor = sh_Color; };
 )glsl";
 
+/* Stencil pass of fills with curves evaluated on the GPU.
+   Each instance is one path segment and every three vertices
+   make a fan triangle from the pivot to a piece of it. */
+static const char* vgShaderVertexCurve =
+    "#define SH_GPU_CURVE_SEGMENTS " SH_STRINGIFY(SH_GPU_CURVE_SEGMENTS) "\n"
+R"glsl(
+    in vec4 curveEnds;    // p0, p3
+    in vec4 curveCtrl;    // p1, p2 or arc center, first axis
+    in vec4 curveAxis;    // second arc axis
+    in vec4 curveInfo;    // type (1 = arc), arc angles
+    uniform int drawIndex;
+    uniform mat4 sh_Ortho;
+    uniform vec2 curvePivot;
+    uniform float curveTolerance;
+
+    #define SH_DRAW sh_Draws[drawIndex]
+
+    vec2 toSurface(vec2 d){ return (sh_Model * vec4(d, 0, 0)).xy; }
+
+    // Same bounds as the CPU flattening, in surface space
+    int curveSegments(){
+        float n;
+        if (curveInfo.x > 0.5) {
+            float r = length(vec4(toSurface(curveCtrl.zw), toSurface(curveAxis.xy)));
+            if (r <= curveTolerance) return 1;
+            n = abs(curveInfo.z - curveInfo.y) / (2.0 * acos(1.0 - curveTolerance / r));
+        } else {
+            vec2 d1 = toSurface(curveEnds.xy - 2.0 * curveCtrl.xy + curveCtrl.zw);
+            vec2 d2 = toSurface(curveCtrl.xy - 2.0 * curveCtrl.zw + curveEnds.zw);
+            n = sqrt(0.75 * max(length(d1), length(d2)) / curveTolerance);
+        }
+        return int(clamp(ceil(n), 1.0, float(SH_GPU_CURVE_SEGMENTS)));
+    }
+
+    vec2 curvePoint(float t){
+        if (t <= 0.0) return curveEnds.xy;
+        if (t >= 1.0) return curveEnds.zw;
+        if (curveInfo.x > 0.5) {
+            float a = mix(curveInfo.y, curveInfo.z, t);
+            return curveCtrl.xy + curveCtrl.zw * cos(a) + curveAxis.xy * sin(a);
+        }
+        float s = 1.0 - t;
+        return s*s*s * curveEnds.xy + 3.0*s*s*t * curveCtrl.xy +
+               3.0*s*t*t * curveCtrl.zw + t*t*t * curveEnds.zw;
+    }
+
+    void main(){
+        int tri = gl_VertexID / 3;
+        int corner = gl_VertexID - 3 * tri;
+        int n = curveSegments();
+        vec2 p = curvePivot;
+        
+        // Triangles past the segment count collapse
+        if (tri < n && corner > 0)
+            p = curvePoint(float(tri + corner - 1) / float(n));
+        
+        gl_Position = sh_Ortho * sh_Model * vec4(p, 0, 1);
+    }
+)glsl";
+
+static const char* vgShaderFragmentCurve = R"glsl(
+    #version 330
+
+    out vec4 fragColor;
+
+    void main()
+    {
+        fragColor = vec4(0.0);
+    }
+)glsl";
+
+/* Stencil pass of fills with implicit curves. Hull triangles
+   carry barycentric coordinates of their conic, fragments on
+   the far side of the curve are dropped. */
+static const char* vgShaderVertexImplicit = R"glsl(
+    in vec2 implicitPos;
+    in vec2 implicitCoord;
+    in float implicitWeight;
+    out vec2 coord;
+    out float weight;
+    uniform int drawIndex;
+    uniform mat4 sh_Ortho;
+
+    void main(){
+        coord = implicitCoord;
+        weight = implicitWeight;
+        gl_Position = sh_Ortho * sh_Draws[drawIndex].model * vec4(implicitPos, 0, 1);
+    }
+)glsl";
+
+static const char* vgShaderFragmentImplicit = R"glsl(
+    #version 330
+
+    in vec2 coord;
+    in float weight;
+    out vec4 fragColor;
+
+    void main()
+    {
+        // Conic in barycentric form: t1^2 = 4 w^2 t0 t2
+        float t0 = 1.0 - coord.x - coord.y;
+        if (coord.x * coord.x > 4.0 * weight * weight * t0 * coord.y)
+            discard;
+        fragColor = vec4(0.0);
+    }
+)glsl";
+
+/* Strokes expanded from the polyline on the GPU. Each instance
+   is one segment, drawn as a quad around it and the join at its
+   end. The fragment stage takes the paint of the pipeline and
+   derives coverage from the distance to the stroke outline in
+   the frame of the segment. Both stages share the parameters. */
+static const char* vgShaderStrokeParams =
+    "#define SH_STROKE_PASS_COVERAGE " SH_STRINGIFY(SH_STROKE_PASS_COVERAGE) "\n"
+    "#define SH_STROKE_PASS_CLIP " SH_STRINGIFY(SH_STROKE_PASS_CLIP) "\n"
+R"glsl(
+    uniform vec4 strokeParams;    // half width, miter limit, cap, join
+
+    #define strokeHalfWidth  (strokeParams.x)
+    #define strokeMiterLimit (strokeParams.y)
+    #define strokeCap        (int(strokeParams.z))
+    #define strokeJoin       (int(strokeParams.w))
+
+    #define CAP_BUTT    0
+    #define CAP_ROUND   1
+    #define CAP_SQUARE  2
+    #define JOIN_MITER  0
+    #define JOIN_ROUND  1
+    #define JOIN_BEVEL  2
+)glsl";
+
+static const char* vgShaderVertexStroke = R"glsl(
+    in vec4 strokeEnds;           // p0, p1
+    in vec4 strokeNext;           // next point, start and end capped
+    uniform int drawIndex;
+    uniform mat4 sh_Ortho;
+
+    #define SH_DRAW sh_Draws[drawIndex]
+
+    out vec2 texImageCoord;
+    out vec2 paintCoord;
+    flat out int drawID;
+    out vec2 strokeLocal;         // along and across the segment
+    flat out vec4 strokeSegment;  // length, cap flags, next direction
+
+    void main(){
+        float w = strokeHalfWidth;
+        vec2 p0 = strokeEnds.xy;
+        vec2 d = strokeEnds.zw - p0;
+        float len = length(d);
+        d = (len > 0.0 ? d / len : vec2(1.0, 0.0));
+        vec2 n = vec2(-d.y, d.x);
+        
+        // Direction after the end join, in the segment frame
+        vec2 d2 = strokeNext.xy - strokeEnds.zw;
+        d2 = (length(d2) > 0.0 ? normalize(d2) : d);
+        d2 = vec2(dot(d2, d), dot(d2, n));
+        
+        // A pixel in user units leaves room for antialiasing
+        float px = inversesqrt(max(abs(determinant(mat2(sh_Model))), 1e-12));
+        
+        // Caps reach out by the half width at most, joins
+        // too unless it is a miter within the limit
+        float e0 = 0.0, e1 = w;
+        if (strokeNext.z > 0.0)
+            e0 = (strokeCap == CAP_BUTT ? 0.0 : w) + px;
+        if (strokeNext.w > 0.0)
+            e1 = (strokeCap == CAP_BUTT ? 0.0 : w);
+        else if (strokeJoin == JOIN_MITER &&
+                 2.0 <= strokeMiterLimit * strokeMiterLimit * (1.0 + d2.x))
+            e1 = max(w, w * abs(d2.y) / (1.0 + d2.x));
+        e1 += px;
+        
+        vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1);
+        strokeLocal = vec2(mix(-e0, len + e1, corner.x),
+                           mix(-w - px, w + px, corner.y));
+        strokeSegment = vec4(len, strokeNext.z + 2.0 * strokeNext.w, d2);
+        
+        vec2 pos = p0 + d * strokeLocal.x + n * strokeLocal.y;
+        gl_Position = sh_Ortho * sh_Model * vec4(pos, 0, 1);
+        texImageCoord = vec2(0.0);
+        paintCoord = (paintInverted * vec3(pos, 1)).xy;
+        drawID = drawIndex;
+    }
+)glsl";
+
+static const char* vgShaderFragmentStroke = R"glsl(
+    in vec2 strokeLocal;
+    flat in vec4 strokeSegment;
+    uniform int strokePass;
+
+    // Signed distance to the part of the stroke this segment
+    // draws. The previous segment draws the start join, the
+    // next one everything past the end join, so the cuts in
+    // between are hard and [eps] wide to leave no gaps.
+    float strokeDistance(float eps){
+        const float far = 1e30;
+        float w = strokeHalfWidth;
+        float len = strokeSegment.x;
+        int caps = int(strokeSegment.y);
+        vec2 x = strokeLocal;
+        
+        if ((caps & 1) == 0 && x.x < -eps) return far;
+        
+        if (x.x <= len + eps || (caps & 2) != 0) {
+            
+            // Body, square caps extend it
+            float e = (strokeCap == CAP_SQUARE ? w : 0.0);
+            float du = -far;
+            if ((caps & 1) != 0) du = max(du, -e - x.x);
+            if ((caps & 2) != 0) du = max(du, x.x - len - e);
+            vec2 q = vec2(du, abs(x.y) - w);
+            float d = length(max(q, 0.0)) + min(max(q.x, q.y), 0.0);
+            
+            if (strokeCap == CAP_ROUND) {
+                if ((caps & 1) != 0) d = min(d, length(x) - w);
+                if ((caps & 2) != 0) d = min(d, length(x - vec2(len, 0.0)) - w);
+            }
+            return d;
+        }
+        
+        // Join: the wedge between the end of this segment
+        // and the start of the next one, outside the turn
+        vec2 y = x - vec2(len, 0.0);
+        vec2 d2 = strokeSegment.zw;
+        if (dot(y, d2) >= eps) return far;
+        if (strokeJoin == JOIN_ROUND) return length(y) - w;
+        
+        float s = (d2.y > 0.0 ? -1.0 : 1.0);
+        vec2 n1 = vec2(0.0, s);
+        vec2 n2 = s * vec2(-d2.y, d2.x);
+        float c = 1.0 + d2.x;   // twice the squared cosine of half the turn
+        
+        if (strokeJoin == JOIN_MITER && 2.0 <= strokeMiterLimit * strokeMiterLimit * c)
+            return max(dot(y, n1), dot(y, n2)) - w;
+        if (c <= 1e-6) return far;
+        
+        vec2 nb = normalize(n1 + n2);
+        return dot(y, nb) - w * dot(n1, nb);
+    }
+
+    void shMain(){
+        float px = length(vec2(dFdx(strokeLocal.x), dFdy(strokeLocal.x)));
+        float d = strokeDistance(0.01 * px);
+        float cover = 1.0;
+        
+        if (strokePass == SH_STROKE_PASS_COVERAGE) {
+            cover = clamp(0.5 - d / max(px, 1e-12), 0.0, 1.0);
+            if (cover <= 0.0) discard;
+        }else if (strokePass == SH_STROKE_PASS_CLIP) {
+            if (d > 0.0) discard;
+        }
+        
+        gl_FragColor = vec4(sh_Color.rgb, sh_Color.a * cover);
+    }
+)glsl";
+
 static const char* vgShaderVertexColorRamp = R"glsl(
     #version 330
     
@@ -246,8 +530,8 @@ void shInitPiplelineShaders(void) {
   VG_GETCONTEXT(VG_NO_RETVAL);
   GLint  compileStatus;
   const char* extendedStage;
-  const char* buf[2];
-  GLint size[2];
+  const char* buf[3];
+  GLint size[3];
 
   context->vs = glCreateShader(GL_VERTEX_SHADER);
   if(context->userShaderVertex){
@@ -255,11 +539,13 @@ void shInitPiplelineShaders(void) {
   } else {
     extendedStage = vgShaderVertexUserDefault;
   }
-  buf[0] = vgShaderVertexPipeline;
-  buf[1] = extendedStage;
-  size[0] = strlen(vgShaderVertexPipeline);
-  size[1] = strlen(extendedStage);
-  glShaderSource(context->vs, 2, buf, size);
+  buf[0] = vgShaderDrawBlock;
+  buf[1] = vgShaderVertexPipeline;
+  buf[2] = extendedStage;
+  size[0] = strlen(vgShaderDrawBlock);
+  size[1] = strlen(vgShaderVertexPipeline);
+  size[2] = strlen(extendedStage);
+  glShaderSource(context->vs, 3, buf, size);
   glCompileShader(context->vs);
   glGetShaderiv(context->vs, GL_COMPILE_STATUS, &compileStatus);
   printf("Shader compile status :%d line:%d\n", compileStatus, __LINE__);
@@ -271,11 +557,13 @@ void shInitPiplelineShaders(void) {
   } else {
     extendedStage = vgShaderFragmentUserDefault;
   }
-  buf[0] = vgShaderFragmentPipeline;
-  buf[1] = extendedStage;
-  size[0] = strlen(vgShaderFragmentPipeline);
-  size[1] = strlen(extendedStage);
-  glShaderSource(context->fs, 2, buf, size);
+  buf[0] = vgShaderDrawBlock;
+  buf[1] = vgShaderFragmentPipeline;
+  buf[2] = extendedStage;
+  size[0] = strlen(vgShaderDrawBlock);
+  size[1] = strlen(vgShaderFragmentPipeline);
+  size[2] = strlen(extendedStage);
+  glShaderSource(context->fs, 3, buf, size);
   glCompileShader(context->fs);
   glGetShaderiv(context->fs, GL_COMPILE_STATUS, &compileStatus);
   printf("Shader compile status :%d line:%d\n", compileStatus, __LINE__);
@@ -284,27 +572,28 @@ void shInitPiplelineShaders(void) {
   context->progDraw = glCreateProgram();
   glAttachShader(context->progDraw, context->vs);
   glAttachShader(context->progDraw, context->fs);
+  glBindAttribLocation(context->progDraw, SH_ATTRIB_POS, "pos");
+  glBindAttribLocation(context->progDraw, SH_ATTRIB_TEXTURE_UV, "textureUV");
   glLinkProgram(context->progDraw);
+  glUniformBlockBinding(context->progDraw,
+                        glGetUniformBlockIndex(context->progDraw, "SHDrawBlock"),
+                        SH_DRAW_BLOCK_BINDING);
   GL_CEHCK_ERROR;
 
   context->locationDraw.pos            = glGetAttribLocation(context->progDraw,  "pos");
   context->locationDraw.textureUV      = glGetAttribLocation(context->progDraw,  "textureUV");
-  context->locationDraw.model          = glGetUniformLocation(context->progDraw, "sh_Model");
+  context->locationDraw.drawIndex      = glGetUniformLocation(context->progDraw, "drawIndex");
   context->locationDraw.projection     = glGetUniformLocation(context->progDraw, "sh_Ortho");
-  context->locationDraw.paintInverted  = glGetUniformLocation(context->progDraw, "paintInverted");
-  context->locationDraw.drawMode       = glGetUniformLocation(context->progDraw, "drawMode");
   context->locationDraw.imageSampler   = glGetUniformLocation(context->progDraw, "imageSampler");
-  context->locationDraw.imageMode      = glGetUniformLocation(context->progDraw, "imageMode");
-  context->locationDraw.paintType      = glGetUniformLocation(context->progDraw, "paintType");
   context->locationDraw.rampSampler    = glGetUniformLocation(context->progDraw, "rampSampler");
   context->locationDraw.patternSampler = glGetUniformLocation(context->progDraw, "patternSampler");
-  context->locationDraw.paintParams    = glGetUniformLocation(context->progDraw, "paintParams");
-  context->locationDraw.paintColor     = glGetUniformLocation(context->progDraw, "paintColor");
   context->locationDraw.scaleFactorBias= glGetUniformLocation(context->progDraw, "scaleFactorBias");
   GL_CEHCK_ERROR;
 
   // TODO: Support color transform to remove this from here
-  glUseProgram(context->progDraw);
+  /* Program and uniforms are new, forget everything cached */
+  shGLStateInvalidate(&context->gl);
+  shGLUseProgram(&context->gl, context->progDraw);
   GLfloat factor_bias[8] = {1.0,1.0,1.0,1.0,0.0,0.0,0.0,0.0};
   glUniform4fv(context->locationDraw.scaleFactorBias, 2, factor_bias);
   GL_CEHCK_ERROR;
@@ -363,6 +652,67 @@ void shDeinitRampShaders(void){
   glDeleteProgram(context->progColorRamp);
 }
 
+void shInitCurveShaders(void) {
+
+  VG_GETCONTEXT(VG_NO_RETVAL);
+  GLint  compileStatus;
+  const GLchar *buf[2];
+  GLint size[2];
+
+  GLuint vs = glCreateShader(GL_VERTEX_SHADER);
+  buf[0] = vgShaderDrawBlock;
+  buf[1] = vgShaderVertexCurve;
+  size[0] = strlen(vgShaderDrawBlock);
+  size[1] = strlen(vgShaderVertexCurve);
+  glShaderSource(vs, 2, buf, size);
+  glCompileShader(vs);
+  glGetShaderiv(vs, GL_COMPILE_STATUS, &compileStatus);
+  printf("Shader compile status :%d line:%d\n", compileStatus, __LINE__);
+  GL_CEHCK_ERROR;
+
+  GLuint fs = glCreateShader(GL_FRAGMENT_SHADER);
+  glShaderSource(fs, 1, &vgShaderFragmentCurve, NULL);
+  glCompileShader(fs);
+  glGetShaderiv(fs, GL_COMPILE_STATUS, &compileStatus);
+  printf("Shader compile status :%d line:%d\n", compileStatus, __LINE__);
+  GL_CEHCK_ERROR;
+
+  context->progCurve = glCreateProgram();
+  glAttachShader(context->progCurve, vs);
+  glAttachShader(context->progCurve, fs);
+  glBindAttribLocation(context->progCurve, SH_ATTRIB_CURVE_ENDS, "curveEnds");
+  glBindAttribLocation(context->progCurve, SH_ATTRIB_CURVE_CTRL, "curveCtrl");
+  glBindAttribLocation(context->progCurve, SH_ATTRIB_CURVE_AXIS, "curveAxis");
+  glBindAttribLocation(context->progCurve, SH_ATTRIB_CURVE_INFO, "curveInfo");
+  glLinkProgram(context->progCurve);
+  glUniformBlockBinding(context->progCurve,
+                        glGetUniformBlockIndex(context->progCurve, "SHDrawBlock"),
+                        SH_DRAW_BLOCK_BINDING);
+  glDeleteShader(vs);
+  glDeleteShader(fs);
+  GL_CEHCK_ERROR;
+
+  context->locationCurve.drawIndex  = glGetUniformLocation(context->progCurve, "drawIndex");
+  context->locationCurve.projection = glGetUniformLocation(context->progCurve, "sh_Ortho");
+  context->locationCurve.pivot      = glGetUniformLocation(context->progCurve, "curvePivot");
+  context->locationCurve.tolerance  = glGetUniformLocation(context->progCurve, "curveTolerance");
+  GL_CEHCK_ERROR;
+  
+  /* Same projection as the draw program */
+  float mat[16];
+  float volume = fmax(context->surfaceWidth, context->surfaceHeight) / 2;
+  shCalcOrtho2D(mat, 0, context->surfaceWidth , 0, context->surfaceHeight, -volume, volume);
+  shGLUseProgram(&context->gl, context->progCurve);
+  glUniformMatrix4fv(context->locationCurve.projection, 1, GL_FALSE, mat);
+  shGLUseProgram(&context->gl, context->progDraw);
+  GL_CEHCK_ERROR;
+}
+
+void shDeinitCurveShaders(void){
+  VG_GETCONTEXT(VG_NO_RETVAL);
+  glDeleteProgram(context->progCurve);
+}
+
 VG_API_CALL void vgShaderSourceSH(VGuint shadertype, const VGbyte* string){
     VG_GETCONTEXT(VG_NO_RETVAL);
 
@@ -379,61 +729,85 @@ VG_API_CALL void vgShaderSourceSH(VGuint shadertype, const VGbyte* string){
 }
 
 VG_API_CALL void vgCompileShaderSH(void){
+    VG_GETCONTEXT(VG_NO_RETVAL);
+    shFlushDrawCommands(context);
     shDeinitPiplelineShaders();
     shInitPiplelineShaders();
 }
 
 VG_API_CALL void vgUniform1fSH(VGint location, VGfloat v0){
+    VG_GETCONTEXT(VG_NO_RETVAL);
+    shFlushDrawCommands(context);
     glUniform1f(location, v0);                                                     
     GL_CEHCK_ERROR;
 }
 
 VG_API_CALL void vgUniform2fSH(VGint location, VGfloat v0, VGfloat v1){
+    VG_GETCONTEXT(VG_NO_RETVAL);
+    shFlushDrawCommands(context);
     glUniform2f(location, v0, v1);                                         
     GL_CEHCK_ERROR;
 }
 
 VG_API_CALL void vgUniform3fSH(VGint location, VGfloat v0, VGfloat v1, VGfloat v2){
+    VG_GETCONTEXT(VG_NO_RETVAL);
+    shFlushDrawCommands(context);
     glUniform3f(location, v0, v1, v2);                             
     GL_CEHCK_ERROR;
 }
 
 VG_API_CALL void vgUniform4fSH(VGint location, VGfloat v0, VGfloat v1, VGfloat v2, VGfloat v3){
+    VG_GETCONTEXT(VG_NO_RETVAL);
+    shFlushDrawCommands(context);
     glUniform4f(location, v0, v1, v2, v3);                 
     GL_CEHCK_ERROR;
 }
 
 VG_API_CALL void vgUniform1fvSH(VGint location, VGint count, const VGfloat *value){
+    VG_GETCONTEXT(VG_NO_RETVAL);
+    shFlushDrawCommands(context);
     glUniform1fv(location, count, value);                           
     GL_CEHCK_ERROR;
 }
 
 VG_API_CALL void vgUniform2fvSH(VGint location, VGint count, const VGfloat *value){
+    VG_GETCONTEXT(VG_NO_RETVAL);
+    shFlushDrawCommands(context);
     glUniform2fv(location, count, value);                           
     GL_CEHCK_ERROR;
 }
 
 VG_API_CALL void vgUniform3fvSH(VGint location, VGint count, const VGfloat *value){
+    VG_GETCONTEXT(VG_NO_RETVAL);
+    shFlushDrawCommands(context);
     glUniform3fv(location, count, value);                           
     GL_CEHCK_ERROR;
 }
 
 VG_API_CALL void vgUniform4fvSH(VGint location, VGint count, const VGfloat *value){
+    VG_GETCONTEXT(VG_NO_RETVAL);
+    shFlushDrawCommands(context);
     glUniform4fv(location, count, value);                           
     GL_CEHCK_ERROR;
 }
 
 VG_API_CALL void vgUniformMatrix2fvSH(VGint location, VGint count, VGboolean transpose, const VGfloat *value){
+    VG_GETCONTEXT(VG_NO_RETVAL);
+    shFlushDrawCommands(context);
     glUniformMatrix2fv(location, count, transpose, value);
     GL_CEHCK_ERROR;
 }
 
 VG_API_CALL void vgUniformMatrix3fvSH(VGint location, VGint count, VGboolean transpose, const VGfloat *value){
+    VG_GETCONTEXT(VG_NO_RETVAL);
+    shFlushDrawCommands(context);
     glUniformMatrix3fv(location, count, transpose, value);
     GL_CEHCK_ERROR;
 }
 
 VG_API_CALL void vgUniformMatrix4fvSH(VGint location, VGint count, VGboolean transpose, const VGfloat *value){
+    VG_GETCONTEXT(VG_NO_RETVAL);
+    shFlushDrawCommands(context);
     glUniformMatrix4fv(location, count, transpose, value);
     GL_CEHCK_ERROR;
 }
@@ -452,43 +826,191 @@ VG_API_CALL void vgGetUniformfvSH(VGint location, VGfloat *params){
 }
 
 VG_API_CALL void vgUniform1iSH (VGint location, VGint v0){
+    VG_GETCONTEXT(VG_NO_RETVAL);
+    shFlushDrawCommands(context);
     glUniform1i (location, v0);
     GL_CEHCK_ERROR;
 }
 
 VG_API_CALL void vgUniform2iSH (VGint location, VGint v0, VGint v1){
+    VG_GETCONTEXT(VG_NO_RETVAL);
+    shFlushDrawCommands(context);
     glUniform2i (location, v0, v1);
     GL_CEHCK_ERROR;
 }
 
 VG_API_CALL void vgUniform3iSH (VGint location, VGint v0, VGint v1, VGint v2){
+    VG_GETCONTEXT(VG_NO_RETVAL);
+    shFlushDrawCommands(context);
     glUniform3i (location,  v0,  v1, v2);
     GL_CEHCK_ERROR;
 }
 
 VG_API_CALL void vgUniform4iSH (VGint location, VGint v0, VGint v1, VGint v2, VGint v3){
+    VG_GETCONTEXT(VG_NO_RETVAL);
+    shFlushDrawCommands(context);
     glUniform4i (location, v0, v1, v2, v3);
     GL_CEHCK_ERROR;
 }
 
 VG_API_CALL void vgUniform1ivSH (VGint location, VGint count, const VGint *value){
+    VG_GETCONTEXT(VG_NO_RETVAL);
+    shFlushDrawCommands(context);
     glUniform1iv (location, count, value);
     GL_CEHCK_ERROR;
 }
 
 VG_API_CALL void vgUniform2ivSH (VGint location, VGint count, const VGint *value){
+    VG_GETCONTEXT(VG_NO_RETVAL);
+    shFlushDrawCommands(context);
     glUniform2iv (location, count, value);
     GL_CEHCK_ERROR;
 }
 
 VG_API_CALL void vgUniform3ivSH (VGint location, VGint count, const VGint *value){
+    VG_GETCONTEXT(VG_NO_RETVAL);
+    shFlushDrawCommands(context);
     glUniform3iv (location, count, value);
     GL_CEHCK_ERROR;
 }
 
 VG_API_CALL void vgUniform4ivSH (VGint location, VGint count, const VGint *value){
+    VG_GETCONTEXT(VG_NO_RETVAL);
+    shFlushDrawCommands(context);
     glUniform4iv (location, count, value);
     GL_CEHCK_ERROR;
 }
 
+void shInitImplicitShaders(void) {
 
+  VG_GETCONTEXT(VG_NO_RETVAL);
+  GLint  compileStatus;
+  const GLchar *buf[2];
+  GLint size[2];
+
+  GLuint vs = glCreateShader(GL_VERTEX_SHADER);
+  buf[0] = vgShaderDrawBlock;
+  buf[1] = vgShaderVertexImplicit;
+  size[0] = strlen(vgShaderDrawBlock);
+  size[1] = strlen(vgShaderVertexImplicit);
+  glShaderSource(vs, 2, buf, size);
+  glCompileShader(vs);
+  glGetShaderiv(vs, GL_COMPILE_STATUS, &compileStatus);
+  printf("Shader compile status :%d line:%d\n", compileStatus, __LINE__);
+  GL_CEHCK_ERROR;
+
+  GLuint fs = glCreateShader(GL_FRAGMENT_SHADER);
+  glShaderSource(fs, 1, &vgShaderFragmentImplicit, NULL);
+  glCompileShader(fs);
+  glGetShaderiv(fs, GL_COMPILE_STATUS, &compileStatus);
+  printf("Shader compile status :%d line:%d\n", compileStatus, __LINE__);
+  GL_CEHCK_ERROR;
+
+  context->progImplicit = glCreateProgram();
+  glAttachShader(context->progImplicit, vs);
+  glAttachShader(context->progImplicit, fs);
+  glBindAttribLocation(context->progImplicit, SH_ATTRIB_IMPLICIT_POS, "implicitPos");
+  glBindAttribLocation(context->progImplicit, SH_ATTRIB_IMPLICIT_COORD, "implicitCoord");
+  glBindAttribLocation(context->progImplicit, SH_ATTRIB_IMPLICIT_WEIGHT, "implicitWeight");
+  glLinkProgram(context->progImplicit);
+  glUniformBlockBinding(context->progImplicit,
+                        glGetUniformBlockIndex(context->progImplicit, "SHDrawBlock"),
+                        SH_DRAW_BLOCK_BINDING);
+  glDeleteShader(vs);
+  glDeleteShader(fs);
+  GL_CEHCK_ERROR;
+
+  context->locationImplicit.drawIndex  = glGetUniformLocation(context->progImplicit, "drawIndex");
+  context->locationImplicit.projection = glGetUniformLocation(context->progImplicit, "sh_Ortho");
+  GL_CEHCK_ERROR;
+  
+  /* Same projection as the draw program */
+  float mat[16];
+  float volume = fmax(context->surfaceWidth, context->surfaceHeight) / 2;
+  shCalcOrtho2D(mat, 0, context->surfaceWidth , 0, context->surfaceHeight, -volume, volume);
+  shGLUseProgram(&context->gl, context->progImplicit);
+  glUniformMatrix4fv(context->locationImplicit.projection, 1, GL_FALSE, mat);
+  shGLUseProgram(&context->gl, context->progDraw);
+  GL_CEHCK_ERROR;
+}
+
+void shDeinitImplicitShaders(void){
+  VG_GETCONTEXT(VG_NO_RETVAL);
+  glDeleteProgram(context->progImplicit);
+}
+
+void shInitStrokeShaders(void) {
+
+  VG_GETCONTEXT(VG_NO_RETVAL);
+  GLint  compileStatus;
+  const GLchar *buf[4];
+  GLint size[4];
+
+  GLuint vs = glCreateShader(GL_VERTEX_SHADER);
+  buf[0] = vgShaderDrawBlock;
+  buf[1] = vgShaderStrokeParams;
+  buf[2] = vgShaderVertexStroke;
+  size[0] = strlen(vgShaderDrawBlock);
+  size[1] = strlen(vgShaderStrokeParams);
+  size[2] = strlen(vgShaderVertexStroke);
+  glShaderSource(vs, 3, buf, size);
+  glCompileShader(vs);
+  glGetShaderiv(vs, GL_COMPILE_STATUS, &compileStatus);
+  printf("Shader compile status :%d line:%d\n", compileStatus, __LINE__);
+  GL_CEHCK_ERROR;
+
+  /* Paint comes from the pipeline, the stroke stage
+     stands in for the user defined one */
+  GLuint fs = glCreateShader(GL_FRAGMENT_SHADER);
+  buf[0] = vgShaderDrawBlock;
+  buf[1] = vgShaderStrokeParams;
+  buf[2] = vgShaderFragmentPipeline;
+  buf[3] = vgShaderFragmentStroke;
+  size[0] = strlen(vgShaderDrawBlock);
+  size[1] = strlen(vgShaderStrokeParams);
+  size[2] = strlen(vgShaderFragmentPipeline);
+  size[3] = strlen(vgShaderFragmentStroke);
+  glShaderSource(fs, 4, buf, size);
+  glCompileShader(fs);
+  glGetShaderiv(fs, GL_COMPILE_STATUS, &compileStatus);
+  printf("Shader compile status :%d line:%d\n", compileStatus, __LINE__);
+  GL_CEHCK_ERROR;
+
+  context->progStroke = glCreateProgram();
+  glAttachShader(context->progStroke, vs);
+  glAttachShader(context->progStroke, fs);
+  glBindAttribLocation(context->progStroke, SH_ATTRIB_STROKE_ENDS, "strokeEnds");
+  glBindAttribLocation(context->progStroke, SH_ATTRIB_STROKE_NEXT, "strokeNext");
+  glLinkProgram(context->progStroke);
+  glUniformBlockBinding(context->progStroke,
+                        glGetUniformBlockIndex(context->progStroke, "SHDrawBlock"),
+                        SH_DRAW_BLOCK_BINDING);
+  glDeleteShader(vs);
+  glDeleteShader(fs);
+  GL_CEHCK_ERROR;
+
+  context->locationStroke.drawIndex  = glGetUniformLocation(context->progStroke, "drawIndex");
+  context->locationStroke.projection = glGetUniformLocation(context->progStroke, "sh_Ortho");
+  context->locationStroke.params     = glGetUniformLocation(context->progStroke, "strokeParams");
+  context->locationStroke.pass       = glGetUniformLocation(context->progStroke, "strokePass");
+  GL_CEHCK_ERROR;
+  
+  /* Same projection, samplers and color transform as
+     the draw program */
+  float mat[16];
+  float volume = fmax(context->surfaceWidth, context->surfaceHeight) / 2;
+  GLfloat factor_bias[8] = {1.0,1.0,1.0,1.0,0.0,0.0,0.0,0.0};
+  shCalcOrtho2D(mat, 0, context->surfaceWidth , 0, context->surfaceHeight, -volume, volume);
+  shGLUseProgram(&context->gl, context->progStroke);
+  glUniformMatrix4fv(context->locationStroke.projection, 1, GL_FALSE, mat);
+  glUniform1i(glGetUniformLocation(context->progStroke, "rampSampler"), 1);
+  glUniform1i(glGetUniformLocation(context->progStroke, "patternSampler"), 1);
+  glUniform4fv(glGetUniformLocation(context->progStroke, "scaleFactorBias"), 2, factor_bias);
+  shGLUseProgram(&context->gl, context->progDraw);
+  GL_CEHCK_ERROR;
+}
+
+void shDeinitStrokeShaders(void){
+  VG_GETCONTEXT(VG_NO_RETVAL);
+  glDeleteProgram(context->progStroke);
+}
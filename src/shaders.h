@@ -27,4 +27,13 @@ void shDeinitPiplelineShaders(void);
 void shInitRampShaders(void);
 void shDeinitRampShaders(void);
 
+void shInitCurveShaders(void);
+void shDeinitCurveShaders(void);
+
+void shInitImplicitShaders(void);
+void shDeinitImplicitShaders(void);
+
+void shInitStrokeShaders(void);
+void shDeinitStrokeShaders(void);
+
 #endif /* __SHADERS_H */